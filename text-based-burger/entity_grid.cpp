@@ -0,0 +1,164 @@
+#include "entity_grid.h"
+#include "game_object.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void EntityGrid::update(const EntityStore& store, const MeshLibrary& meshes) {
+	size_t seen = entity_cell.size();
+	size_t count = store.size();
+	if (seen < count) {
+		entity_cell.resize(count, 0);
+		entity_in_grid.resize(count, false);
+		entity_always.resize(count, false);
+		entity_extent.resize(count, vec2());
+		entity_dirty.resize(count, false);
+	}
+
+	// Something finished loading, its bounds are different now. Doesnt say
+	// which mesh so everything gets looked at, this only happens on loads.
+	if (meshes.get_version() != mesh_version) {
+		mesh_version = meshes.get_version();
+		for (EntityId id = 0; id < seen; id++) {
+			mark_dirty(id);
+		}
+	}
+
+	for (EntityId id : dirty) {
+		entity_dirty[id] = false;
+		refresh(store, meshes, id);
+	}
+	dirty.clear();
+
+	// New since last time
+	for (EntityId id = (EntityId)seen; id < count; id++) {
+		refresh(store, meshes, id);
+	}
+
+	if (max_extent_stale) {
+		max_extent = vec2();
+		for (const auto& cell : cells) {
+			max_extent = maxv(max_extent, cell.second.extent);
+		}
+		max_extent_stale = false;
+	}
+
+	return;
+}
+
+void EntityGrid::refresh(const EntityStore& store, const MeshLibrary& meshes, EntityId id) {
+	EntityRenderMode mode = store.render_mode[id];
+
+	if (mode == ENTITY_RENDER_CUSTOM) {
+		if (entity_in_grid[id]) {
+			remove(id);
+		}
+		if (!entity_always[id]) {
+			always.push_back(id);
+			entity_always[id] = true;
+		}
+		return;
+	}
+
+	if (entity_always[id]) {
+		always.erase(find(always.begin(), always.end(), id));
+		entity_always[id] = false;
+	}
+
+	if (mode != ENTITY_RENDER_MESH) {
+		if (entity_in_grid[id]) {
+			remove(id);
+		}
+		return;
+	}
+
+	vec2 position = store.position[id];
+	uint64_t key = cell_key(
+		(int)floor(position.x / ENTITY_GRID_CELL_SIZE),
+		(int)floor(position.y / ENTITY_GRID_CELL_SIZE)
+	);
+
+	vec2 bounds_from, bounds_to;
+	entity_world_bounds(store, id, meshes.get(store.mesh[id]), bounds_from, bounds_to);
+	vec2 extent = maxv(position - bounds_from, bounds_to - position);
+
+	if (entity_in_grid[id]) {
+		if (entity_cell[id] == key && entity_extent[id] == extent) {
+			return;
+		}
+		remove(id);
+	}
+
+	Cell& cell = cells[key];
+	cell.ids.push_back(id);
+	cell.extent = maxv(cell.extent, extent);
+	max_extent = maxv(max_extent, extent);
+
+	entity_cell[id] = key;
+	entity_extent[id] = extent;
+	entity_in_grid[id] = true;
+	return;
+}
+
+void EntityGrid::remove(EntityId id) {
+	auto it = cells.find(entity_cell[id]);
+	if (it != cells.end()) {
+		// Order in a cell doesnt matter, swap with the back and pop
+		Cell& cell = it->second;
+		auto pos = find(cell.ids.begin(), cell.ids.end(), id);
+		if (pos != cell.ids.end()) {
+			*pos = cell.ids.back();
+			cell.ids.pop_back();
+		}
+
+		// If this was the one reaching furthest work it out again from what
+		// is left, cells are small
+		vec2 extent = entity_extent[id];
+		if (extent.x >= cell.extent.x || extent.y >= cell.extent.y) {
+			cell.extent = vec2();
+			for (EntityId other : cell.ids) {
+				cell.extent = maxv(cell.extent, entity_extent[other]);
+			}
+		}
+
+		if (extent.x >= max_extent.x || extent.y >= max_extent.y) {
+			max_extent_stale = true;
+		}
+	}
+	entity_in_grid[id] = false;
+	return;
+}
+
+void EntityGrid::query(vec2 from, vec2 to, vector<EntityId>& out) const {
+	out.insert(out.end(), always.begin(), always.end());
+
+	// Any cell that far out could have something hanging into the rect
+	int from_x = (int)floor((from.x - max_extent.x) / ENTITY_GRID_CELL_SIZE);
+	int from_y = (int)floor((from.y - max_extent.y) / ENTITY_GRID_CELL_SIZE);
+	int to_x = (int)floor((to.x + max_extent.x) / ENTITY_GRID_CELL_SIZE);
+	int to_y = (int)floor((to.y + max_extent.y) / ENTITY_GRID_CELL_SIZE);
+
+	for (int x = from_x; x <= to_x; x++) {
+		for (int y = from_y; y <= to_y; y++) {
+			auto it = cells.find(cell_key(x, y));
+			if (it == cells.end()) {
+				continue;
+			}
+
+			// Only if this cell's own entities reach that far
+			const Cell& cell = it->second;
+			float cell_x = x * ENTITY_GRID_CELL_SIZE;
+			float cell_y = y * ENTITY_GRID_CELL_SIZE;
+			if (cell_x + ENTITY_GRID_CELL_SIZE + cell.extent.x < from.x || cell_x - cell.extent.x > to.x ||
+				cell_y + ENTITY_GRID_CELL_SIZE + cell.extent.y < from.y || cell_y - cell.extent.y > to.y) {
+				continue;
+			}
+
+			out.insert(out.end(), cell.ids.begin(), cell.ids.end());
+		}
+	}
+
+	return;
+}
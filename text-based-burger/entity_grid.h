@@ -0,0 +1,88 @@
+#pragma once
+
+// Uniform grid over the entity store so rendering only has to look at
+// entities near the camera. Each entity sits in the one cell its position is
+// in, and every cell knows how far its biggest entity hangs out of it so
+// queries can still find those. Only worth it with a lot of entities, with a
+// few hundred just walking the store and checking bounds is faster.
+//
+// The grid does not watch the store. Whoever changes an entity's position,
+// scale, mesh or render mode marks it dirty and only those get looked at
+// again. Entities the grid has never seen get added on their own.
+
+#include "entity_store.h"
+#include "mesh_library.h"
+#include "math_utils.h"
+
+#include <unordered_dense.h>
+
+#include <vector>
+#include <cstdint>
+
+#define ENTITY_GRID_CELL_SIZE 256.0f
+
+// Above this many entities the handler culls through the grid instead of
+// walking every entity
+#define ENTITY_GRID_THRESHOLD 512
+
+class EntityGrid {
+public:
+	EntityGrid() = default;
+
+	// Something about this entity changed, look at it again next update. Fine
+	// to call more than once a frame.
+	void mark_dirty(EntityId id) {
+		if (id < entity_dirty.size() && !entity_dirty[id]) {
+			entity_dirty[id] = true;
+			dirty.push_back(id);
+		}
+	}
+
+	// Re-bin the dirty entities and add new ones, drop released or non
+	// rendering ones. Only touches what was marked unless the mesh library
+	// changed, then every bound is redone since loaded meshes change size.
+	void update(const EntityStore& store, const MeshLibrary& meshes);
+
+	// Append every entity that could be inside the rect. Custom rendered
+	// entities have no mesh bounds so they are always returned.
+	void query(vec2 from, vec2 to, std::vector<EntityId>& out) const;
+
+private:
+	uint64_t cell_key(int cell_x, int cell_y) const {
+		return ((uint64_t)(uint32_t)cell_x << 32) | (uint32_t)cell_y;
+	}
+
+	struct Cell {
+		std::vector<EntityId> ids;
+
+		// Furthest any entity in here reaches from its position
+		vec2 extent = vec2();
+	};
+
+	// Put one entity where it belongs now
+	void refresh(const EntityStore& store, const MeshLibrary& meshes, EntityId id);
+
+	void remove(EntityId id);
+
+	ankerl::unordered_dense::map<uint64_t, Cell> cells;
+
+	// Entities that render themselves, no bounds to go off
+	std::vector<EntityId> always;
+
+	// Where every entity currently is
+	std::vector<uint64_t> entity_cell;
+	std::vector<bool> entity_in_grid;
+	std::vector<bool> entity_always;
+	std::vector<vec2> entity_extent;
+
+	std::vector<EntityId> dirty;
+	std::vector<bool> entity_dirty;
+
+	// Mesh library version the extents were worked out with
+	uint32_t mesh_version = 0;
+
+	// Biggest extent of any cell, queries look this far out for cells that
+	// might reach in. Worked out again when the entity that set it leaves.
+	vec2 max_extent = vec2();
+	bool max_extent_stale = false;
+};
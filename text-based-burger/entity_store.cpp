@@ -0,0 +1,84 @@
+#include "entity_store.h"
+
+using namespace std;
+
+EntityId EntityStore::create(GameObject* owner) {
+	if (!free_slots.empty()) {
+		// Reuse a released slot, generation was already bumped on release so
+		// old handles to it stay dead.
+		EntityId id = free_slots.back();
+		free_slots.pop_back();
+
+		position[id] = vec2();
+		rotation[id] = 0.0f;
+		render_scale[id] = vec2(1.0f, 1.0f);
+
+		collision_type[id] = COLLISION_TYPE_NONE;
+		radius[id] = 0.0f;
+		aabb_from[id] = vec2();
+		aabb_to[id] = vec2();
+
+		color[id] = 0;
+		render_mode[id] = ENTITY_RENDER_MESH;
+		mesh[id] = MESH_ID_EMPTY;
+
+		info[id] = EntityInfo();
+		info[id].owner = owner;
+
+		return id;
+	}
+
+	EntityId id = (EntityId)position.size();
+
+	position.push_back(vec2());
+	rotation.push_back(0.0f);
+	render_scale.push_back(vec2(1.0f, 1.0f));
+
+	collision_type.push_back(COLLISION_TYPE_NONE);
+	radius.push_back(0.0f);
+	aabb_from.push_back(vec2());
+	aabb_to.push_back(vec2());
+
+	color.push_back(0);
+	render_mode.push_back(ENTITY_RENDER_MESH);
+	mesh.push_back(MESH_ID_EMPTY);
+
+	EntityInfo new_info;
+	new_info.owner = owner;
+	info.push_back(new_info);
+
+	generation.push_back(0);
+
+	return id;
+}
+
+void EntityStore::release(EntityId id) {
+	generation[id]++;
+
+	// Dead slots stay in the arrays until reused, make sure nothing walking
+	// the store touches them.
+	render_mode[id] = ENTITY_RENDER_NONE;
+	collision_type[id] = COLLISION_TYPE_NONE;
+	info[id] = EntityInfo();
+
+	free_slots.push_back(id);
+	return;
+}
+
+void EntityStore::reserve(size_t count) {
+	position.reserve(count);
+	rotation.reserve(count);
+	render_scale.reserve(count);
+
+	collision_type.reserve(count);
+	radius.reserve(count);
+	aabb_from.reserve(count);
+	aabb_to.reserve(count);
+
+	color.reserve(count);
+	render_mode.reserve(count);
+	mesh.reserve(count);
+
+	info.reserve(count);
+	generation.reserve(count);
+}
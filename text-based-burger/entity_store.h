@@ -0,0 +1,167 @@
+#pragma once
+
+// Flat storage for the parts of game objects that get touched every frame.
+// Instead of every object holding its own position, scale etc. next to a pile
+// of strings, all of it lives here in one array per field (structure of
+// arrays), indexed by entity id. Systems that only care about one or two fields
+// like the render pass can then just walk the arrays front to back instead of
+// jumping through every object on the heap.
+//
+// Game objects still exist and still hold their type specific state (npc
+// weapons, canvas lines etc) but they only hold an id into here for the common
+// stuff. Access it through the accessors on GameObject.
+
+#include "math_utils.h"
+#include "mesh_library.h"
+#include "line_palette.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class GameObject;
+
+// Entity ids are just indices into every array in the store
+typedef uint32_t EntityId;
+
+#define ENTITY_ID_INVALID 0xFFFFFFFF
+
+// Safe reference to an entity. Slots in the store get reused when entities are
+// released, so an id on its own might end up pointing at something completely
+// different. Every slot has a generation that is bumped when it is released,
+// and a handle only resolves if its generation still matches. Hold these
+// instead of GameObject pointers or targetnames.
+struct EntityHandle {
+	EntityId index = ENTITY_ID_INVALID;
+	uint32_t generation = 0;
+
+	bool is_null() const {
+		return index == ENTITY_ID_INVALID;
+	}
+
+	bool operator==(const EntityHandle& other) const {
+		return index == other.index && generation == other.generation;
+	}
+
+	// For passing handles through json script args
+	uint64_t to_bits() const {
+		return ((uint64_t)generation << 32) | index;
+	}
+
+	static EntityHandle from_bits(uint64_t bits) {
+		EntityHandle handle;
+		handle.index = (EntityId)(bits & 0xFFFFFFFF);
+		handle.generation = (uint32_t)(bits >> 32);
+		return handle;
+	}
+};
+
+enum CollisionType {
+	COLLISION_TYPE_NONE = 0, // No collision
+	COLLISION_TYPE_AABB = 1, // Axis aligned bounding box collision
+	COLLISION_TYPE_CIRCLE = 2 // Circle collision
+};
+
+enum EntityRenderMode {
+	// Not rendered by the object render pass at all. Meta objects like the
+	// possessor, or things that are rendered specially like the mouse.
+	ENTITY_RENDER_NONE,
+
+	// Plain mesh transformed by position and scale. This is what almost
+	// everything is and the render pass handles it without touching the object.
+	ENTITY_RENDER_MESH,
+
+	// Object has its own render function (line canvas etc), the render pass
+	// calls it through the object.
+	ENTITY_RENDER_CUSTOM
+};
+
+// Cold data, only looked at on load, by scripts, or for error messages.
+struct EntityInfo {
+	std::string targetname;
+
+	std::string update_script_name;
+
+	// Object that owns this entity
+	GameObject* owner = nullptr;
+};
+
+class EntityStore {
+public:
+	EntityStore() = default;
+
+	// Not copyable, objects point into this
+	EntityStore(const EntityStore&) = delete;
+	EntityStore& operator=(const EntityStore&) = delete;
+
+	// Add a new entity with default values in every array and return its id.
+	// Reuses released slots if there are any.
+	EntityId create(GameObject* owner);
+
+	// Give the slot back. Any handles to it stop resolving.
+	void release(EntityId id);
+
+	// Get a handle to a live entity
+	EntityHandle handle(EntityId id) const {
+		return EntityHandle{ id, generation[id] };
+	}
+
+	// Get the owner of a handle, or nullptr if it is null or stale. O(1), no
+	// lookups, fine to call every frame.
+	GameObject* resolve(EntityHandle handle) const {
+		if (handle.index >= generation.size() || generation[handle.index] != handle.generation) {
+			return nullptr;
+		}
+		return info[handle.index].owner;
+	}
+
+	// Reserve space in every array up front if you know how many you will have
+	void reserve(size_t count);
+
+	size_t size() const {
+		return position.size();
+	}
+
+	// ---- Transform ----
+
+	// Safe to assume all objects have a world space position
+	std::vector<vec2> position;
+
+	// This is the rotation of the object in radians. This should only be used
+	// for rendering, you should not have rotating collision, use a circle to
+	// approximate the collision front instead.
+	std::vector<float> rotation;
+
+	// This is the scale of the object
+	std::vector<vec2> render_scale;
+
+	// ---- Collision ----
+
+	std::vector<CollisionType> collision_type;
+
+	// Radius if you are COLLISION_TYPE_CIRCLE
+	std::vector<float> radius;
+
+	// AABB if you are COLLISION_TYPE_AABB
+	std::vector<vec2> aabb_from;
+	std::vector<vec2> aabb_to;
+
+	// ---- Render ----
+
+	// Line palette material, the color got turned into this when loaded
+	std::vector<LineMaterial> color;
+	std::vector<EntityRenderMode> render_mode;
+
+	// Mesh that this entity uses, interned in the mesh library
+	std::vector<MeshId> mesh;
+
+	// ---- Cold ----
+
+	std::vector<EntityInfo> info;
+
+	// Bumped every time the slot is released
+	std::vector<uint32_t> generation;
+
+private:
+	std::vector<EntityId> free_slots;
+};
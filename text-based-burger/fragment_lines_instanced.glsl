@@ -0,0 +1,20 @@
+//! #version 460
+// This is for the glsl addon the compiler adds the version
+// Fragment half of the instanced mesh lines. The vertex shader already pulled
+// the line out of the mesh so we dont have to look anything up.
+out vec4 FragColor;
+in vec2 TexCoords;
+
+flat in vec2 lineStart;
+flat in vec2 lineEnd;
+flat in uint lineColor;
+
+uniform float aspectRatio;
+uniform float aspectRatioSmall;
+
+void main() {
+    vec2 fragPosNDC = TexCoords * vec2(aspectRatioSmall * aspectRatio, 1.0);
+
+    FragColor.rgb += beam_color(fragPosNDC, lineStart, lineEnd, lineColor);
+    FragColor.a = 1.0;
+}
@@ -0,0 +1,110 @@
+#include "frame_limiter.h"
+
+#include <thread>
+#include <algorithm>
+#include <ctime>
+
+// Windows sleeps in 15.6 ms steps unless told otherwise, which is most of a
+// frame at 60 fps. Ask for 1 ms while a limiter is around.
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+using namespace std;
+
+FrameLimiter::FrameLimiter(double target_fps, double idle_fps) : target_fps(target_fps), idle_fps(idle_fps) {
+#ifdef _WIN32
+	timeBeginPeriod(1);
+#endif
+}
+
+FrameLimiter::~FrameLimiter() {
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+double get_process_cpu_time() {
+#ifdef _WIN32
+	// clock() is wall time on windows
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+		return 0.0;
+	}
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (k.QuadPart + u.QuadPart) / 10000000.0; // 100 ns steps
+#else
+	return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+void FrameLimiter::set_target_fps(double fps) {
+	target_fps = fps;
+	return;
+}
+
+void FrameLimiter::set_idle_fps(double fps) {
+	idle_fps = fps;
+	return;
+}
+
+void FrameLimiter::wait(bool idle) {
+	clock::time_point now = clock::now();
+
+	if (!started) {
+		started = true;
+		next_frame = now;
+	}
+
+	idle_frames = idle ? idle_frames + 1 : 0;
+
+	double fps = target_fps;
+	if (idle_fps > 0.0 && idle_frames >= FRAME_LIMITER_IDLE_FRAMES) {
+		fps = target_fps > 0.0 ? min(target_fps, idle_fps) : idle_fps;
+	}
+
+	if (fps > 0.0) {
+		next_frame += chrono::duration_cast<clock::duration>(chrono::duration<double>(1.0 / fps));
+
+		// Fell behind, start the next frame right away instead of trying to
+		// catch up with a burst of short frames
+		if (next_frame < now) {
+			next_frame = now;
+		}
+
+		// Sleep for most of it
+		double spin = sleep_overshoot + FRAME_LIMITER_MIN_SPIN;
+		double sleep_time = chrono::duration<double>(next_frame - now).count() - spin;
+		if (sleep_time > 0.0) {
+			this_thread::sleep_for(chrono::duration<double>(sleep_time));
+
+			// Jump up to a worse overshoot straight away, come back down slowly
+			double slept = chrono::duration<double>(clock::now() - now).count();
+			double overshoot = max(0.0, slept - sleep_time);
+			if (overshoot > sleep_overshoot) {
+				sleep_overshoot = overshoot;
+			}
+			else {
+				sleep_overshoot = sleep_overshoot * 0.95 + overshoot * 0.05;
+			}
+		}
+
+		// And spin the rest
+		while (clock::now() < next_frame) {
+			this_thread::yield();
+		}
+	}
+	else {
+		next_frame = now;
+	}
+
+	return;
+}
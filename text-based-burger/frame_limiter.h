@@ -0,0 +1,64 @@
+#pragma once
+
+// Frame limiter for the main loop. Without one the loop just goes as fast as
+// it can and burns a whole core drawing a menu thousands of times a second.
+//
+// Waiting is a sleep for most of the time left in the frame and then a short
+// spin for the rest, because sleeps on most systems wake up late by anything
+// up to a couple ms. How late they actually wake up gets measured and the
+// spin is sized off that, so it only spins as long as it has to.
+//
+// There is also an idle rate, for frames where nothing happened (no input, no
+// text changed, no object did anything). The loop drops to that until
+// something happens again so sitting in a menu costs next to nothing.
+
+#include <chrono>
+
+// Used when going idle and no idle rate was set
+#define FRAME_LIMITER_DEFAULT_IDLE_FPS 15.0
+
+// Never spin for less than this, sleeps always wake up a bit late
+#define FRAME_LIMITER_MIN_SPIN 0.0002
+
+// How many frames in a row have to be idle before dropping to the idle rate,
+// so a single quiet frame in the middle of something doesnt stutter
+#define FRAME_LIMITER_IDLE_FRAMES 30
+
+// Cpu time used by the whole process so far in seconds, every thread added
+// up. Over wall time that is how much cpu a run took, spinning included.
+double get_process_cpu_time();
+
+class FrameLimiter {
+public:
+	// 0 fps means no limit. idle_fps 0 means never go idle.
+	FrameLimiter(double target_fps = 0.0, double idle_fps = 0.0);
+	~FrameLimiter();
+
+	// Change the cap, 0 for no limit
+	void set_target_fps(double fps);
+	void set_idle_fps(double fps);
+
+	double get_target_fps() const {
+		return target_fps;
+	}
+
+	// Call once at the end of every frame, waits until the next one should
+	// start. idle says nothing happened this frame.
+	void wait(bool idle);
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	double target_fps;
+	double idle_fps;
+
+	// When the next frame is supposed to start
+	clock::time_point next_frame;
+	bool started = false;
+
+	int idle_frames = 0;
+
+	// How late sleeps have been waking up, decays slowly so one bad wake up
+	// doesnt make it spin forever
+	double sleep_overshoot = 0.001;
+};
@@ -1,4 +1,6 @@
 #include "game_object.h"
+#include "game_object_handler.h"
+#include "mesh_utils.h"
 #include "scripts.h"
 #include <iostream>
 #include <fstream>
@@ -10,34 +12,63 @@ using namespace std;
 
 // GAME OBJECT
 
-GameObject::GameObject(json data, ObjectIO& io) : io(io) {
-	targetname = data["targetname"].get_ref<const string&>();
-
-	update_script_name = data["update_script"].get_ref<const string&>();
+GameObject::GameObject(const json& data, ObjectIO& io) : io(io) {
+	// Read everything before taking a slot in the entity store. If the json
+	// is missing something this throws and our destructor never runs, so
+	// the slot would never be given back.
+	const string& new_targetname = data.at("targetname").get_ref<const string&>();
+	const string& new_update_script = data.at("update_script").get_ref<const string&>();
 
 	// For non rendering objects you can probably not even write these, if you
 	// know you will never need to render it is probably fine if they are null.
-	mesh = data["mesh"].get_ref<const string&>();
+	const string& new_mesh = data.at("mesh").get_ref<const string&>();
 
-	position = vec2(data["position"]);
+	vec2 new_position = vec2(data.at("position"));
 
 	//rotation = data["rotation"];
-	render_scale = vec2(data["scale"][0].get<int>(), data["scale"][1]);
-	color = data["color"];
+	vec2 new_scale = vec2(data.at("scale")[0].get<int>(), data.at("scale")[1]);
+	uint32_t new_color = data.at("color");
+
+	// Grab a slot in the entity store for all our common data
+	entity = io.entities->create(this);
+
+	targetname() = new_targetname;
+	update_script_name() = new_update_script;
+
+	// Name gets turned into an id here once, nothing after this looks it up.
+	// If the mesh file is cooked this also starts loading it.
+	mesh() = io.meshes->intern(new_mesh);
+	io.meshes->request(mesh());
+
+	position() = new_position;
+	render_scale() = new_scale;
+	color() = get_line_palette().intern(new_color);
 
 	// None by default
-	collision_type = COLLISION_TYPE_NONE;
+	collision_type() = COLLISION_TYPE_NONE;
 
 	return;
 }
 
+GameObject::~GameObject() {
+	io.entities->release(entity);
+	return;
+}
+
 void GameObject::update(ObjectUpdateData data) {
-	// This is the update function.
+	// This is the update function. Generic objects dont do anything on their
+	// own so there is no point waking up until something happens to us.
+	sleep();
 
 	return;
 }
 
-int GameObject::render(float* lines_list, int offset, uint32_t* colors, vec2 camera) {
+void GameObject::wake() {
+	io.handler->wake(this);
+	return;
+}
+
+int GameObject::render(float* lines_list, int offset, LineMaterial* colors, vec2 camera) {
 	// Render function is called every frame. You are given a pointer to an array
 	// and should append yourself to it if you need to be rendered. Not appending
 	// yourself will cause you to not be rendered, even if you were rendered the
@@ -45,47 +76,68 @@ int GameObject::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 	// render if you are within some distance of the camera position you get from
 	// updata data. Note that you should output NDC here not world space.
 
+	return render_entity_mesh(*io.entities, entity, io.meshes->get(mesh()), lines_list, offset, colors, camera);
+}
+
+void entity_world_bounds(const EntityStore& store, EntityId id, const MeshSpan& mesh, vec2& from, vec2& to) {
+	vec2 scale = store.render_scale[id];
+
+	// Negative scale flips the box so min max it again
+	vec2 a = mesh.bounds_from * scale;
+	vec2 b = mesh.bounds_to * scale;
+
+	from = minv(a, b) + store.position[id];
+	to = maxv(a, b) + store.position[id];
+	return;
+}
+
+bool entity_on_screen(const EntityStore& store, EntityId id, const MeshSpan& mesh, vec2 camera) {
 	// Hard coded screen size whatever
-	float scrn_width = 960.0f;
-	float scrn_height = 536.0f;
+	vec2 screen_size = vec2(960.0f, 536.0f);
 
-	// TODO: add distance to camera check if we need to render at all
+	vec2 bounds_from, bounds_to;
+	entity_world_bounds(store, id, mesh, bounds_from, bounds_to);
 
-	vec2 screen_position = position - camera; // Offset the position by the camera position
-	// Centre the position on the screen
-	screen_position.x += scrn_width / 2.0f;
-	screen_position.y += scrn_height / 2.0f;
+	vec2 view_from = camera - screen_size / 2.0f - vec2(VIEW_CULL_MARGIN, VIEW_CULL_MARGIN);
+	vec2 view_to = camera + screen_size / 2.0f + vec2(VIEW_CULL_MARGIN, VIEW_CULL_MARGIN);
 
-	int vert_count = io.meshes->at(mesh).size();
+	return !(bounds_to.x < view_from.x || bounds_from.x > view_to.x ||
+		bounds_to.y < view_from.y || bounds_from.y > view_to.y);
+}
 
-	// Loop over the mesh array of coordinates and transform and copy to lines list until done
-	for (int i = 0; i < vert_count; i++) {
+int render_entity_mesh(EntityStore& store, EntityId id, MeshSpan mesh,
+	float* lines_list, int offset, LineMaterial* colors, vec2 camera) {
 
-		// This should probably be a vec2 instead of one float at a time, but whatever
-		float number = (*io.meshes)[mesh][i];
-		
-		// It goes x, y, x, y so if offset % 2 == 0 then we are at x
-		if (offset % 2 == 0) {
-			// Transform the x coordinate
-			number = (number * render_scale.x) + screen_position.x;
-			number = number / scrn_width; // Normalize to screen width
-		}
-		else {
-			// Transform the y coordinate
-			number = (number * render_scale.y) + screen_position.y;
-			number = number / scrn_height; // Normalize to screen height
-		}
-		// Normalize to full screen ndc -1 to 1
-		number = (number * 2.0f) - 1.0f; // Convert to NDC space
+	// Hard coded screen size whatever
+	vec2 screen_size = vec2(960.0f, 536.0f);
 
-		lines_list[offset] = number;
+	// Is any of us on screen
+	if (!entity_on_screen(store, id, mesh, camera)) {
+		return offset;
+	}
 
-		// Every 4th number is a complete line so add new color
-		if (offset % 4 == 0) {
-			colors[offset / 4] = color; // Set the color for the line
-		}
+	vec2 screen_position = store.position[id] - camera; // Offset the position by the camera position
+	// Centre the position on the screen
+	screen_position += screen_size / 2.0f;
 
-		offset++;
+	vec2 scale = store.render_scale[id];
+	LineMaterial color = store.color[id];
+
+	// Loop over the mesh lines and transform and copy to lines list until done
+	for (const MeshLine& line : mesh.lines) {
+		vec2 from = (line.from * scale) + screen_position;
+		vec2 to = (line.to * scale) + screen_position;
+
+		// Normalize to screen size, then to full screen ndc -1 to 1
+		from = (from / screen_size) * 2.0f - 1.0f;
+		to = (to / screen_size) * 2.0f - 1.0f;
+
+		colors[offset / 4] = color; // Set the color for the line
+
+		lines_list[offset++] = from.x;
+		lines_list[offset++] = from.y;
+		lines_list[offset++] = to.x;
+		lines_list[offset++] = to.y;
 	}
 
 	return offset; // Return the new offset
@@ -93,37 +145,18 @@ int GameObject::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 
 void GameObject::move(vec2 velocity) {
 	// Generic game objects always move
-	position += velocity;
+	position() += velocity;
 	return;
 }
 
-using ObjectFactory = std::function<std::unique_ptr<GameObject>(json, ObjectIO&)>;
-
-std::unique_ptr<GameObject> object_type_selector(json data, ObjectIO& io) {
-	static const std::map<std::string, ObjectFactory> factory_map = {
-		{"generic", [](json data, ObjectIO& io) { 
-			return std::make_unique<GameObject>(data, io); 
-		}},
-		{"point_view_control", [](json data, ObjectIO& io) { 
-			return std::make_unique<PointViewControl>(data, io); 
-		}},
-		{"npc", [](json data, ObjectIO& io) {
-			return std::make_unique<NPC>(data, io);
-		}},
-		{"line_canvas", [](json data, ObjectIO& io) {
-			return std::make_unique<LineCanvas>(data, io);
-		}},
-
-		// Dont add types that shouldnt be spawned by the user like mouse renderer
-	};
-
-	auto it = factory_map.find(data["type"].get_ref<const string&>());
-	if (it != factory_map.end()) {
-		return it->second(data, io);
-	}
-	else {
-		throw std::runtime_error("Unknown game object type: " + data["type"].get_ref<const string&>());
+PooledObject object_type_selector(const string& type, const json& data, ObjectIO& io, ObjectPools& pools) {
+	// Dont add types that shouldnt be spawned by the user like mouse renderer
+	// to ObjectTypes
+	PooledObject object = ObjectTypes::create(type, data, io, pools);
+	if (!object) {
+		throw std::runtime_error("Unknown game object type: " + type);
 	}
+	return object;
 }
 
 // Mouse renderer
@@ -133,20 +166,26 @@ MouseRenderer::MouseRenderer(ObjectIO& io) : GameObject(json::object(
 		{"targetname", "mouse_renderer"},
 		{"position", {0, 0}},
 		{"scale", {1, 1}},
-		{"mesh", "gen_props/pointers/point"},
+		{"mesh", "pointer_aim"},
 		{"color", generate_line_color(LINE_COLOR_PRESET_CURSOR)},
 		{"update_script", "none"}
 
 	}), io) {
 
-	collision_type = COLLISION_TYPE_NONE;
+	collision_type() = COLLISION_TYPE_NONE;
+
+	// Handler renders us specially so we always end up in the reserved lines
+	io.entities->render_mode[entity] = ENTITY_RENDER_NONE;
+
+	mesh_aim = io.meshes->intern("pointer_aim");
+	mesh_click = io.meshes->intern("pointer_click");
 
 	mouse_state = MOUSE_NORMAL;
 	return;
 }
 
 void MouseRenderer::update(ObjectUpdateData data) {
-	position = vec2(data.mouse_pos.x, 536.0f - data.mouse_pos.y);
+	position() = vec2(data.mouse_pos.x, 536.0f - data.mouse_pos.y);
 
 	if (data.is_clicking) {
 		mouse_state = MOUSE_CLICKING;
@@ -158,11 +197,11 @@ void MouseRenderer::update(ObjectUpdateData data) {
 	// Mouse state switcher. Modify mouse state to change the mesh.
 	switch (mouse_state) {
 		case MOUSE_NORMAL:
-			mesh = "pointer_aim";
+			mesh() = mesh_aim;
 			break;
 	
 		case MOUSE_CLICKING:
-			mesh = "pointer_click";
+			mesh() = mesh_click;
 			break;
 	}
 
@@ -170,7 +209,7 @@ void MouseRenderer::update(ObjectUpdateData data) {
 }
 
 // Point view control
-PointViewControl::PointViewControl(json data, ObjectIO& io) : GameObject(json::object(
+PointViewControl::PointViewControl(const json& data, ObjectIO& io) : GameObject(json::object(
 	{  // Dummy data that will never change on init
 		{"targetname", "view_controller_" + data["controller_num"]},
 		{"position", {0, 0}},
@@ -202,7 +241,10 @@ PointViewControl::PointViewControl(json data, ObjectIO& io) : GameObject(json::o
 	// but if you do it will just snap the camera for a frame
 	prev_position = vec2(0xB00B1E5);
 
-	rotation = 0.0f;
+	view_rotation = 0.0f;
+
+	// Cameras are never rendered
+	io.entities->render_mode[entity] = ENTITY_RENDER_NONE;
 	return;
 }
 
@@ -255,15 +297,20 @@ void PointViewControl::update(ObjectUpdateData data) {
 		return;
 	}
 
-	// Get the object we are following
-	auto obj = io.get_object(follow_name);
+	// Get the object we are following. Only go through the name registry if
+	// we dont have a handle yet or the one we had died.
+	GameObject* obj = io.get_object(follow_handle);
+	if (!obj) {
+		follow_handle = io.find_object(follow_name);
+		obj = io.get_object(follow_handle);
+	}
 	if (!obj) {
 		io.report_error("PointViewControl: Object to follow '" + follow_name + "' does not exist.");
 		return;
 	}
 
 	// Get the position of the object we are following
-	vec2 new_pos = obj->position;
+	vec2 new_pos = obj->position();
 
 	if (new_pos == prev_position) {
 		// If the position has not changed, we dont need to update anything
@@ -273,12 +320,12 @@ void PointViewControl::update(ObjectUpdateData data) {
 	if (prev_position == vec2(0xB00B1E5)) {
 		// If this is the first update just snap the camera
 		prev_position = new_pos;
-		position = new_pos;
+		position() = new_pos;
 		return;
 	}
 	
 	bool extended_look = false;
-	if (glfwGetKey(data.window, GLFW_KEY_B) == GLFW_PRESS) { // bzoom
+	if (data.input.is_down(INPUT_KEY_B)) { // bzoom
 		extended_look = true;
 	}
 
@@ -286,20 +333,20 @@ void PointViewControl::update(ObjectUpdateData data) {
 	switch (mode) {
 	case CAMERA_MODE_WELD:
 		// Snap follow
-		prev_position = position;
-		position = new_pos;
+		prev_position = position();
+		position() = new_pos;
 		break;
 
 	case CAMERA_MODE_FOLLOW:
 		// Follow target but smoothly
-		prev_position = position;
-		position = smooth_follow(position, new_pos, new_pos, data.frame_time, extended_look);
+		prev_position = position();
+		position() = smooth_follow(position(), new_pos, new_pos, data.frame_time, extended_look);
 		break;
 
 	case CAMERA_MODE_GAMEPLAY:
 		// Same as follow cam but we actually supply aim position
-		prev_position = position;
-		position = smooth_follow(position, new_pos, data.mouse_pos, data.frame_time, extended_look);
+		prev_position = position();
+		position() = smooth_follow(position(), new_pos, data.mouse_pos, data.frame_time, extended_look);
 		break;
 	default:
 		io.report_error("PointViewControl: Unknown camera mode.");
@@ -318,11 +365,12 @@ void PointViewControl::set_mode(CameraMode new_mode) {
 void PointViewControl::set_target(std::string targetname) {
 	// Set the target to follow
 	follow_name = targetname;
+	follow_handle = EntityHandle(); // Resolve the new name on next update
 	return;
 }
 
 // Possesor
-Possessor::Possessor(json data, ObjectIO& io) : GameObject(json::object(
+Possessor::Possessor(const json& data, ObjectIO& io) : GameObject(json::object(
 	{  // Dummy data that will never change on init
 		{"targetname", "possesor"},
 		{"position", {0, 0}},
@@ -335,6 +383,9 @@ Possessor::Possessor(json data, ObjectIO& io) : GameObject(json::object(
 	// Since this is a meta entity, it should only ever be created by the objects habndler
 	// similarly to MouseRenderer
 	victim_name = data["victim"].get_ref<const string&>();
+
+	// Possessor is never rendered
+	io.entities->render_mode[entity] = ENTITY_RENDER_NONE;
 	return;
 }
 
@@ -344,7 +395,11 @@ void Possessor::update(ObjectUpdateData data) {
 		return;
 	}
 	// Get the object we are possessing
-	auto obj = io.get_object(victim_name);
+	GameObject* obj = io.get_object(victim_handle);
+	if (!obj) {
+		victim_handle = io.find_object(victim_name);
+		obj = io.get_object(victim_handle);
+	}
 	if (!obj) {
 		io.report_error("Possessor cannot posses '" + victim_name + "' has invisibility cloak");
 		return;
@@ -353,16 +408,16 @@ void Possessor::update(ObjectUpdateData data) {
 	vec2 move = vec2();
 
 	// Handle camera movement
-	if (glfwGetKey(data.window, GLFW_KEY_W) == GLFW_PRESS) {
+	if (data.input.is_down(INPUT_KEY_W)) {
 		move += vec2(0.0f, 1.0f);
 	}
-	if (glfwGetKey(data.window, GLFW_KEY_S) == GLFW_PRESS) {
+	if (data.input.is_down(INPUT_KEY_S)) {
 		move += vec2(0.0f, -1.0f);
 	}
-	if (glfwGetKey(data.window, GLFW_KEY_A) == GLFW_PRESS) {
+	if (data.input.is_down(INPUT_KEY_A)) {
 		move += vec2(-1.0f, 0.0f);
 	}
-	if (glfwGetKey(data.window, GLFW_KEY_D) == GLFW_PRESS) {
+	if (data.input.is_down(INPUT_KEY_D)) {
 		move += vec2(1.0f, 0.0f);
 	}
 
@@ -371,14 +426,14 @@ void Possessor::update(ObjectUpdateData data) {
 	float move_speed = 4.0f * 100.0f;
 
 	// are we crouching
-	if (glfwGetKey(data.window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) {
+	if (data.input.is_down(INPUT_KEY_LEFT_SHIFT)) {
 		move_speed *= 0.4f; // Crouch speed
 	}
 
 	move *= move_speed * data.frame_time;
 
 	// Attempt to move
-	obj->move(move);
+	io.move_object(victim_handle, move);
 
 	return;
 }
@@ -386,13 +441,14 @@ void Possessor::update(ObjectUpdateData data) {
 void Possessor::set_target(std::string targetname) {
 	// Set the target to possess
 	victim_name = targetname;
+	victim_handle = EntityHandle();
 	return;
 }
 
-NPC::NPC(json data, ObjectIO& io) : GameObject(data, io) {
+NPC::NPC(const json& data, ObjectIO& io) : GameObject(data, io) {
 
 	// TEMP
-	color = generate_line_color(LINE_COLOR_PRESET_NPC_FRIENDLY);
+	color() = preset_material(LINE_COLOR_PRESET_NPC_FRIENDLY);
 
 	return;
 }
@@ -402,13 +458,18 @@ void NPC::update(ObjectUpdateData data) {
 	// Try to move
 	if (!move_velocity.is_zero()) {
 		io.call_script("npc_move", {
-			{"caller", targetname + " update"},
-			{"targetname", targetname},
+			{"caller", targetname() + " update"},
+			{"targetname", targetname()},
+			{"handle", handle().to_bits()},
 			{"x", move_velocity.x},
 			{"y", move_velocity.y}
 			});
 		move_velocity.blank();
 	}
+	else {
+		// Nothing to do until someone moves us
+		sleep();
+	}
 
 	return;
 }
@@ -432,7 +493,7 @@ void NPC::attack() {
 	return;
 }
 
-LineCanvas::LineCanvas(json data, ObjectIO& io) : GameObject(json::object(
+LineCanvas::LineCanvas(const json& data, ObjectIO& io) : GameObject(json::object(
 	{  // Dummy data that will never change on init
 		{"targetname", "line_canvas"},
 		{"position", {0, 0}},
@@ -441,7 +502,15 @@ LineCanvas::LineCanvas(json data, ObjectIO& io) : GameObject(json::object(
 		{"color", generate_line_color(LINE_COLOR_PRESET_EDITOR_LINE)},
 		{"update_script", "none"}
 	}), io) {
-	collision_type = COLLISION_TYPE_NONE;
+	collision_type() = COLLISION_TYPE_NONE;
+
+	// We have our own render function
+	io.entities->render_mode[entity] = ENTITY_RENDER_CUSTOM;
+
+	// Drawing, undo and redo intern colors into the line palette, and that is
+	// main thread only
+	main_thread_update = true;
+
 	active_color = generate_line_color(LINE_COLOR_PRESET_EDITOR_LINE);
 	
 	// Save initial state to history
@@ -456,8 +525,7 @@ void LineCanvas::update(ObjectUpdateData data) {
 	// Handle delete key for selected lines (works in both select and edit modes)
 	if ((tool == CANVAS_TOOL_SELECT || tool == CANVAS_TOOL_EDIT) && 
 	    (selected_line >= 0 || !selected_lines.empty())) {
-		static bool delete_key_was_pressed = false;
-		bool delete_key_pressed = glfwGetKey(data.window, GLFW_KEY_DELETE) == GLFW_PRESS;
+		bool delete_key_pressed = data.input.is_down(INPUT_KEY_DELETE);
 		
 		if (delete_key_pressed && !delete_key_was_pressed) {
 			// Get all lines to delete (combine single selection and multi-selection)
@@ -482,6 +550,7 @@ void LineCanvas::update(ObjectUpdateData data) {
 						canvas_lines.erase(canvas_lines.begin() + start_index, canvas_lines.begin() + start_index + 2);
 						// Remove the color for this line  
 						canvas_colors.erase(canvas_colors.begin() + line_index);
+						canvas_materials.erase(canvas_materials.begin() + line_index);
 						
 						// Adjust indices in selected_lines that are higher than the deleted line
 						for (auto& sel_line : selected_lines) {
@@ -511,14 +580,10 @@ void LineCanvas::update(ObjectUpdateData data) {
 	}
 	
 	// Handle undo/redo keyboard shortcuts (Ctrl+Z and Ctrl+Y)
-	bool ctrl_pressed = glfwGetKey(data.window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || 
-	                   glfwGetKey(data.window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS;
+	bool ctrl_pressed = data.input.ctrl_down();
 	
-	static bool z_key_was_pressed = false;
-	static bool y_key_was_pressed = false;
-	
-	bool z_key_pressed = glfwGetKey(data.window, GLFW_KEY_Z) == GLFW_PRESS;
-	bool y_key_pressed = glfwGetKey(data.window, GLFW_KEY_Y) == GLFW_PRESS;
+	bool z_key_pressed = data.input.is_down(INPUT_KEY_Z);
+	bool y_key_pressed = data.input.is_down(INPUT_KEY_Y);
 	
 	if (ctrl_pressed) {
 		if (z_key_pressed && !z_key_was_pressed) {
@@ -580,6 +645,7 @@ void LineCanvas::on_press(ObjectUpdateData data) {
 		canvas_lines.push_back(snapped_start_pos);
 
 		canvas_colors.push_back(active_color);
+		canvas_materials.push_back(get_line_palette().intern(active_color));
 
 		return;
 	}
@@ -592,8 +658,7 @@ void LineCanvas::on_press(ObjectUpdateData data) {
 		
 		if (line_at_click >= 0) {
 			// Clicking on a line
-			bool ctrl_pressed = glfwGetKey(data.window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || 
-			                   glfwGetKey(data.window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS;
+			bool ctrl_pressed = data.input.ctrl_down();
 			
 			if (is_line_selected(line_at_click) && !selected_lines.empty()) {
 				// Clicking on an already selected line - start multi-line drag
@@ -635,8 +700,7 @@ void LineCanvas::on_press(ObjectUpdateData data) {
 			box_selection_end = data.mouse_pos;
 			
 			// Clear selection unless Ctrl is held
-			bool ctrl_pressed = glfwGetKey(data.window, GLFW_KEY_LEFT_CONTROL) == GLFW_PRESS || 
-			                   glfwGetKey(data.window, GLFW_KEY_RIGHT_CONTROL) == GLFW_PRESS;
+			bool ctrl_pressed = data.input.ctrl_down();
 			if (!ctrl_pressed) {
 				clear_selection();
 			}
@@ -791,6 +855,7 @@ void LineCanvas::on_release(ObjectUpdateData data) {
 			canvas_lines.pop_back(); // Remove the last point
 			canvas_lines.pop_back(); // Remove the second last point
 			canvas_colors.pop_back(); // Remove the last color
+			canvas_materials.pop_back();
 		}
 		return;
 		
@@ -802,7 +867,7 @@ void LineCanvas::on_release(ObjectUpdateData data) {
 	}
 }
 
-int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 camera) {
+int LineCanvas::render(float* lines_list, int offset, LineMaterial* colors, vec2 camera) {
 	// Render function is called every frame. You are given a pointer to an array
 	// and should append yourself to it if you need to be rendered. Not appending
 	// yourself will cause you to not be rendered, even if you were rendered the
@@ -813,10 +878,12 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 	// Hard coded screen size whatever;
 	vec2 screen_size = vec2(960, 536);
 
-	vec2 screen_position = position - camera; // Offset the position by the camera position
+	vec2 screen_position = position() - camera; // Offset the position by the camera position
 	// Centre the position on the screen
 	screen_position += screen_size / 2.0f;
 
+	vec2 scale = render_scale();
+
 	int vert_count = canvas_lines.size();
 
 	// Loop over the mesh array of coordinates and transform and copy to lines list until done
@@ -824,7 +891,7 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 
 		vec2 vertex = canvas_lines[i];
 
-		vertex = vertex * render_scale;
+		vertex = vertex * scale;
 		vertex = vertex / screen_size;
 
 		// Normalize to full screen ndc -1 to 1
@@ -838,11 +905,11 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 		// Every 2nd nmuber is a complete line so add new color
 		if (i % 2 == 0) {
 			int line_index = i / 2;
-			uint32_t line_color = canvas_colors[line_index];
+			LineMaterial line_color = canvas_materials[line_index];
 			
 			// Highlight selected lines with preset color
 			if (line_index == selected_line || is_line_selected(line_index)) {
-				line_color = generate_line_color(LINE_COLOR_PRESET_EDITOR_SELECTED);
+				line_color = preset_material(LINE_COLOR_PRESET_EDITOR_SELECTED);
 			}
 			
 			colors[offset / 4] = line_color;
@@ -855,11 +922,11 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 		vec2 end_vertex = canvas_lines[selected_line * 2 + 1];
 		
 		float marker_size = 10.0f;
-		uint32_t marker_color = generate_line_color(LINE_COLOR_PRESET_CURSOR);
+		LineMaterial marker_color = preset_material(LINE_COLOR_PRESET_CURSOR);
 		
 		// Transform vertices to NDC
 		auto transform_vertex = [&](vec2 v) -> vec2 {
-			v = v * render_scale;
+			v = v * scale;
 			v = v / screen_size;
 			return (v * 2.0f) - 1.0f;
 		};
@@ -900,7 +967,7 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 	if (is_box_selecting && tool == CANVAS_TOOL_SELECT) {
 		// Transform box selection coordinates to NDC
 		auto transform_vertex = [&](vec2 v) -> vec2 {
-			v = v * render_scale;
+			v = v * scale;
 			v = v / screen_size;
 			return (v * 2.0f) - 1.0f;
 		};
@@ -908,7 +975,7 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 		vec2 start_ndc = transform_vertex(box_selection_start);
 		vec2 end_ndc = transform_vertex(box_selection_end);
 		
-		uint32_t box_color = generate_line_color(LINE_COLOR_PRESET_CURSOR);
+		LineMaterial box_color = preset_material(LINE_COLOR_PRESET_CURSOR);
 		
 		// Draw box outline (4 lines)
 		// Top line
@@ -943,6 +1010,22 @@ int LineCanvas::render(float* lines_list, int offset, uint32_t* colors, vec2 cam
 	return offset; // Return the new offset
 }
 
+void LineCanvas::set_canvas_color(int line, uint32_t color) {
+	canvas_colors[line] = color;
+	canvas_materials[line] = get_line_palette().intern(color);
+	return;
+}
+
+void LineCanvas::rebuild_canvas_materials() {
+	// For when all the colors get swapped out at once (undo, loading)
+	LinePalette& palette = get_line_palette();
+	canvas_materials.resize(canvas_colors.size());
+	for (size_t i = 0; i < canvas_colors.size(); i++) {
+		canvas_materials[i] = palette.intern(canvas_colors[i]);
+	}
+	return;
+}
+
 int LineCanvas::find_line_at_position(vec2 pos, float tolerance) {
 	for (int i = 0; i < canvas_lines.size(); i += 2) {
 		if (i + 1 >= canvas_lines.size()) break;
@@ -1054,28 +1137,28 @@ vec2 LineCanvas::snap_to_grid(vec2 pos) {
 void LineCanvas::set_selected_line_hue(float hue) {
 	current_hue = std::max(0.0f, std::min(1.0f, hue));
 	if (selected_line >= 0 && selected_line < canvas_colors.size()) {
-		canvas_colors[selected_line] = generate_line_color(current_hue, current_intensity, current_alpha, current_thickness);
+		set_canvas_color(selected_line, generate_line_color(current_hue, current_intensity, current_alpha, current_thickness));
 	}
 }
 
 void LineCanvas::set_selected_line_intensity(float intensity) {
 	current_intensity = std::max(0.0f, std::min(1.0f, intensity));
 	if (selected_line >= 0 && selected_line < canvas_colors.size()) {
-		canvas_colors[selected_line] = generate_line_color(current_hue, current_intensity, current_alpha, current_thickness);
+		set_canvas_color(selected_line, generate_line_color(current_hue, current_intensity, current_alpha, current_thickness));
 	}
 }
 
 void LineCanvas::set_selected_line_alpha(float alpha) {
 	current_alpha = std::max(0.0f, std::min(1.0f, alpha));
 	if (selected_line >= 0 && selected_line < canvas_colors.size()) {
-		canvas_colors[selected_line] = generate_line_color(current_hue, current_intensity, current_alpha, current_thickness);
+		set_canvas_color(selected_line, generate_line_color(current_hue, current_intensity, current_alpha, current_thickness));
 	}
 }
 
 void LineCanvas::set_selected_line_thickness(float thickness) {
 	current_thickness = std::max(-1.0f, std::min(1.0f, thickness));
 	if (selected_line >= 0 && selected_line < canvas_colors.size()) {
-		canvas_colors[selected_line] = generate_line_color(current_hue, current_intensity, current_alpha, current_thickness);
+		set_canvas_color(selected_line, generate_line_color(current_hue, current_intensity, current_alpha, current_thickness));
 	}
 }
 
@@ -1135,6 +1218,7 @@ void LineCanvas::undo() {
 	canvas_lines = state.lines;
 	canvas_colors = state.colors;
 	canvas_z_height = state.z_heights;
+	rebuild_canvas_materials();
 	
 	// Clear selection since line indices might have changed
 	selected_line = -1;
@@ -1152,6 +1236,7 @@ void LineCanvas::redo() {
 	canvas_lines = state.lines;
 	canvas_colors = state.colors;
 	canvas_z_height = state.z_heights;
+	rebuild_canvas_materials();
 	
 	// Clear selection since line indices might have changed
 	selected_line = -1;
@@ -1211,16 +1296,20 @@ bool LineCanvas::is_line_selected(int line_index) const {
 
 json LineCanvas::export_mesh_to_json() const {
 	json mesh_data = json::object();
+
+	// Clean up what was drawn before it goes in a file, hand drawn meshes
+	// are full of doubled up lines and straight edges made of lots of bits.
+	// Colors are not saved so nothing is lost.
+	std::vector<MeshLine> lines;
+	for (size_t i = 0; i + 1 < canvas_lines.size(); i += 2) {
+		lines.push_back(MeshLine{ canvas_lines[i], canvas_lines[i + 1] });
+	}
+	optimize_mesh_lines(lines);
 	
 	// Create arrays for each line in the format [x1, y1, x2, y2]
-	for (int i = 0; i < canvas_lines.size(); i += 2) {
-		if (i + 1 < canvas_lines.size()) {
-			vec2 start = canvas_lines[i];
-			vec2 end = canvas_lines[i + 1];
-			
-			std::string line_name = "line_" + std::to_string(i / 2);
-			mesh_data[line_name] = {start.x, start.y, end.x, end.y};
-		}
+	for (size_t i = 0; i < lines.size(); i++) {
+		std::string line_name = "line_" + std::to_string(i);
+		mesh_data[line_name] = {lines[i].from.x, lines[i].from.y, lines[i].to.x, lines[i].to.y};
 	}
 	
 	return mesh_data;
@@ -1246,12 +1335,15 @@ bool LineCanvas::import_mesh_from_json(const json& mesh_data) {
 				canvas_z_height.push_back(0.0f);
 			}
 		}
+		rebuild_canvas_materials();
 		
 		// Save initial state to history
 		save_state_to_history();
 		
 		return true;
 	} catch (const json::exception& e) {
+		// Whatever got read in before the error stays, so keep the materials matching
+		rebuild_canvas_materials();
 		return false;
 	}
 }
@@ -4,31 +4,36 @@
 using json = nlohmann::json;
 
 #include "object_utils.h"
+#include "entity_store.h"
 #include "math_utils.h"
 #include "npc_behaviors.hpp"
+#include "object_pool.hpp"
 
 #include <vector>
 #include <string>
 #include <map>
 #include <cfloat>
+#include <tuple>
+#include <type_traits>
+#include <cstdint>
 
 // This is all the game objects. Game objects are responcible for their own
 // interaction and submitting their own rendering data to the handler.
 
-enum CollisionType {
-	COLLISION_TYPE_NONE = 0, // No collision
-	COLLISION_TYPE_AABB = 1, // Axis aligned bounding box collision
-	COLLISION_TYPE_CIRCLE = 2 // Circle collision
-};
-
 class GameObject {
 public:
 	// Game objects only have once constructor because they dont need
 	// Recursive construction like components do
-	GameObject(json data, ObjectIO& io);
+	GameObject(const json& data, ObjectIO& io);
+
+	// Gives our slot in the entity store back
+	virtual ~GameObject();
 
 	// This is the update function. It is called every frame and should
-	// return true if the object needs to be rerendered
+	// return true if the object needs to be rerendered. Unless you set
+	// main_thread_update this runs on a worker thread at the same time as
+	// other objects, so only touch yourself and go through the io (scripts,
+	// errors, move_object) for anything else.
 	virtual void update(ObjectUpdateData data);
 
 	// Render function is called every frame. You are given a pointer to
@@ -37,7 +42,7 @@ public:
 	// were rendered the previous frame. The entire array is cleared. For optimization
 	// you should only render if you are within some distance of the camera position
 	// you get from updata data. Note that you should output NDC here not world space.
-	virtual int render(float* lines_list, int offset, uint32_t* colors, vec2 camera);
+	virtual int render(float* lines_list, int offset, LineMaterial* colors, vec2 camera);
 
 	// Attempt to move in the direction and distance of velocity. note that this
 	// is an attempt to move, you are given the raw desired velocity and it is
@@ -45,48 +50,97 @@ public:
 	// you are a car for example.
 	virtual void move(vec2 velocity);
 
-	std::string targetname;
-
-	// This is the color of the object
-	uint32_t color;
-
 	// This is the object io instance. It is used to call scripts and report errors
 	ObjectIO& io;
 
-	// Name of the (mesh?) that this object uses
-	std::string mesh;
+	// Our id in the entity store. Everything common to all objects (position,
+	// scale, color etc) lives in the store, not in here. See entity_store.h
+	EntityId entity;
+
+	// Handle to ourselves, this is what other things should hold on to
+	EntityHandle handle() const { return io.entities->handle(entity); }
+
+	// Set this if your update has to run on the main thread, for example if it
+	// touches something outside itself that the command buffer doesnt cover.
+	// Input is fine, it is a snapshot in the update data. These get updated
+	// after the parallel ones.
+	bool main_thread_update = false;
+
+	// Set by destroy. We stay alive until the end of the frame and then the
+	// handler actually removes us.
+	bool pending_destroy = false;
+
+	// Sleeping objects dont get updated at all. Call this from your update
+	// when there is nothing left for you to do and the handler takes you off
+	// the awake list after the frame. You get woken up when something moves
+	// you, a script gets you by name, the possessed object comes within
+	// OBJECT_WAKE_RADIUS, or your timer runs out (see sleep_until).
+	void sleep() {
+		wants_sleep = true;
+		wake_time = -1.0f;
+	}
 
-	std::string update_script_name;
+	// Same as sleep but also wake up at this time, same clock as
+	// ObjectUpdateData::time
+	void sleep_until(float time) {
+		wants_sleep = true;
+		wake_time = time;
+	}
+
+	// Put us back on the awake list. Main thread only, during the parallel
+	// update go through the io (move_object etc) and let it wake us.
+	void wake();
 
-	// Safe to assume all objects have a world space position
-	vec2 position;
+	// Where we are in ObjectTypes, set by object_type_selector. The handler
+	// buckets awake objects by this. Meta objects are never bucketed so it
+	// does not matter for them.
+	uint8_t type_index = 0;
 
-	// This is the rotation of the object in radians. This should only be used
-	// for rendering, you should not have rotating collision, use a circle to
-	// approximate the collision front instead.
-	float rotation;
+	// Only the handler should touch these
+	bool sleeping = false;
+	bool wants_sleep = false;
+	float wake_time = -1.0f;
 
-	// This is the scale of the object
-	vec2 render_scale;
+	// Accessors for our data in the entity store. These return references so
+	// you can use them the same way as normal members, just dont hold on to
+	// the reference, it is invalidated when new entities get created.
+	std::string& targetname() { return io.entities->info[entity].targetname; }
+	MeshId& mesh() { return io.entities->mesh[entity]; }
+	std::string& update_script_name() { return io.entities->info[entity].update_script_name; }
 
-	CollisionType collision_type;
+	vec2& position() { return io.entities->position[entity]; }
+	float& rotation() { return io.entities->rotation[entity]; }
+	vec2& render_scale() { return io.entities->render_scale[entity]; }
 
-	// Radius if you are COLLISION_TYPE_CIRCLE 
-	float radius;
+	CollisionType& collision_type() { return io.entities->collision_type[entity]; }
+	float& radius() { return io.entities->radius[entity]; }
+	vec2& aabb_from() { return io.entities->aabb_from[entity]; }
+	vec2& aabb_to() { return io.entities->aabb_to[entity]; }
 
-	// AABB if you are COLLISION_TYPE_AABB
-	vec2 aabb_from, aabb_to;
+	// This is the color of the object
+	LineMaterial& color() { return io.entities->color[entity]; }
 
 protected:
 	// For now everything is publically acessible becasuse getters and setters are a waste of time a lot of the time
 };
 
-// Type selector for game objects
-// This function LOVES to explode the linker. Or not this function, but VS loves
-// to. There is nothing wrong, you probably just edited a contructor or
-// something, and now visual studio is angry. Just clean and rebuild, it will
-// fix it.
-std::unique_ptr<GameObject> object_type_selector(json data, ObjectIO& io);
+// How far outside the screen (native pixels) something can be and still get
+// rendered. Thick lines and their glow bleed past the actual line.
+#define VIEW_CULL_MARGIN 64.0f
+
+// World space bounds of an entity's mesh after scale and position
+void entity_world_bounds(const EntityStore& store, EntityId id, const MeshSpan& mesh, vec2& from, vec2& to);
+
+// Are an entity's mesh bounds within VIEW_CULL_MARGIN of the screen
+bool entity_on_screen(const EntityStore& store, EntityId id, const MeshSpan& mesh, vec2 camera);
+
+// Render a plain mesh entity straight from the entity store. This is what
+// GameObject::render does, but the objects handler calls it directly for
+// ENTITY_RENDER_MESH entities so it never has to touch the object itself.
+// Entities whose mesh bounds are off screen are skipped without touching a
+// single vertex.
+int render_entity_mesh(EntityStore& store, EntityId id, MeshSpan mesh,
+	float* lines_list, int offset, LineMaterial* colors, vec2 camera);
 
 enum MouseState {
 	MOUSE_NORMAL,
@@ -103,6 +157,10 @@ public:
 	virtual void update(ObjectUpdateData data) override;
 
 	MouseState mouse_state;
+
+	// Interned once on construction so switching cursors is just an int copy
+	MeshId mesh_aim;
+	MeshId mesh_click;
 };
 
 enum CameraMode {
@@ -126,7 +184,7 @@ enum CameraMode {
 // conjunction with the possesor object, although not always.
 class PointViewControl : public GameObject {
 public:
-	PointViewControl(json data, ObjectIO& io);
+	PointViewControl(const json& data, ObjectIO& io);
 
 	virtual void update(ObjectUpdateData data) override;
 
@@ -136,9 +194,14 @@ public:
 
 protected:
 	std::string follow_name;
+
+	// Resolved from follow_name the first time we need it, then reused every
+	// frame. Null until the target exists.
+	EntityHandle follow_handle;
+
 	CameraMode mode;
 	vec2 prev_position;
-	float rotation;
+	float view_rotation;
 };
 
 // Possessor is the main input method for gameplay. Attaches to a gameobject and
@@ -151,7 +214,7 @@ protected:
 // because sometimes you want to follow an object but not posses it.
 class Possessor : public GameObject {
 public:
-	Possessor(json data, ObjectIO& io);
+	Possessor(const json& data, ObjectIO& io);
 
 	virtual void update(ObjectUpdateData data) override;
 
@@ -159,8 +222,16 @@ public:
 	// possessing.
 	void set_target(std::string targetname);
 
+	// What we are possessing, null until it has been found
+	EntityHandle get_victim() const {
+		return victim_handle;
+	}
+
 protected:
 	std::string victim_name;
+
+	// Same deal as the view control, resolved once from the name
+	EntityHandle victim_handle;
 };
 
 // How the agression mechanic works:
@@ -206,7 +277,7 @@ protected:
 // Base npc class
 class NPC : public GameObject {
 public:
-	NPC(json data, ObjectIO& io);
+	NPC(const json& data, ObjectIO& io);
 
 	virtual void update(ObjectUpdateData data) override;
 	virtual void move(vec2 velocity) override;
@@ -259,12 +330,12 @@ enum CanvasTool {
 // Line canvas is a special object that lets you draw lines on the screen. Used for mesh and map editors.
 class LineCanvas : public GameObject {
 public:
-	LineCanvas(json data, ObjectIO& io);
+	LineCanvas(const json& data, ObjectIO& io);
 
 	virtual void update(ObjectUpdateData data) override;
 
 	// Canvas renders in a special way
-	virtual int render(float* lines_list, int offset, uint32_t* colors, vec2 camera);
+	virtual int render(float* lines_list, int offset, LineMaterial* colors, vec2 camera);
 
 	void set_active_tool(CanvasTool new_tool) {
 		tool = new_tool;
@@ -356,6 +427,12 @@ protected:
 
 	std::vector<vec2> canvas_lines;
 	std::vector<int> canvas_colors;
+
+	// canvas_colors turned into palette materials. Kept in step with
+	// canvas_colors everywhere that changes, so rendering never looks up a color.
+	std::vector<LineMaterial> canvas_materials;
+	void set_canvas_color(int line, uint32_t color);
+	void rebuild_canvas_materials();
 	std::vector<float> canvas_z_height;
 
 	bool do_parrallax = false;
@@ -366,6 +443,11 @@ protected:
 	bool is_clicking = false;
 	bool is_click_start_inside = false;
 	bool have_already_fired = false;
+
+	// Keys held last frame, shortcuts only fire on the press
+	bool delete_key_was_pressed = false;
+	bool z_key_was_pressed = false;
+	bool y_key_was_pressed = false;
 	
 	// Selection and editing state
 	int selected_line = -1;
@@ -400,4 +482,95 @@ protected:
 	std::vector<HistoryState> history_stack;
 	size_t current_history_index = 0;
 	static const size_t max_history_size = 50;
-};
\ No newline at end of file
+};
+
+// Name every spawnable type goes by in map json
+template <typename T> struct ObjectTypeName;
+template <> struct ObjectTypeName<GameObject> { static constexpr const char* value = "generic"; };
+template <> struct ObjectTypeName<PointViewControl> { static constexpr const char* value = "point_view_control"; };
+template <> struct ObjectTypeName<NPC> { static constexpr const char* value = "npc"; };
+template <> struct ObjectTypeName<LineCanvas> { static constexpr const char* value = "line_canvas"; };
+
+// Updates every object in a bucket of one type
+typedef void (*ObjectBatchUpdate)(GameObject* const* objects, size_t count, const ObjectUpdateData& data);
+
+// Compile time list of every type that can be spawned by name. The pools,
+// the type selector and the batched update are all generated from this, so
+// nothing has to look a type up at runtime apart from the name on spawn.
+template <typename... Ts>
+struct ObjectRegistry {
+	static constexpr size_t count = sizeof...(Ts);
+	static_assert(count <= 255, "type_index is a uint8_t");
+
+	template <typename T>
+	static constexpr size_t index_of() {
+		constexpr bool matches[] = { std::is_same_v<T, Ts>... };
+		for (size_t i = 0; i < count; i++) {
+			if (matches[i]) {
+				return i;
+			}
+		}
+		return count;
+	}
+
+	// One pool per type
+	class Pools {
+	public:
+		template <typename T>
+		ObjectPool<T>& get() {
+			return std::get<ObjectPool<T>>(pools);
+		}
+
+	private:
+		std::tuple<ObjectPool<Ts>...> pools;
+	};
+
+	// Make an object by its type name, null if no type has that name
+	static PooledObject create(const std::string& type, const json& data, ObjectIO& io, Pools& pools) {
+		PooledObject object;
+
+		// Unrolls into one string compare per type, stops at the first match
+		((type == ObjectTypeName<Ts>::value && (object = create_as<Ts>(data, io, pools), true)) || ...);
+
+		return object;
+	}
+
+	// Calls T::update directly on every object so there is no virtual call
+	// per object, the compiler can inline it and the loop stays in one
+	// type's code. Skips main thread objects, those get their own pass.
+	// Anything subclassing a registered type has to be registered itself or
+	// it gets updated as its parent.
+	template <typename T>
+	static void update_batch(GameObject* const* objects, size_t count, const ObjectUpdateData& data) {
+		for (size_t i = 0; i < count; i++) {
+			T* object = static_cast<T*>(objects[i]);
+			if (!object->main_thread_update) {
+				object->T::update(data);
+			}
+		}
+	}
+
+	// Indexed by type_index
+	static constexpr ObjectBatchUpdate batch_updates[count] = { &update_batch<Ts>... };
+
+private:
+	template <typename T>
+	static PooledObject create_as(const json& data, ObjectIO& io, Pools& pools) {
+		PooledObject object = pools.template get<T>().create(data, io);
+		object->type_index = (uint8_t)index_of<T>();
+		return object;
+	}
+};
+
+// Add new spawnable types here and give them an ObjectTypeName
+typedef ObjectRegistry<GameObject, PointViewControl, NPC, LineCanvas> ObjectTypes;
+
+typedef ObjectTypes::Pools ObjectPools;
+
+// Type selector for game objects
+// This function LOVES to explode the linker. Or not this function, but VS loves
+// to. There is nothing wrong, you probably just edited a contructor or
+// something, and now visual studio is angry. Just clean and rebuild, it will
+// fix it.
+// Objects come out of the per type pools, the json is only read, never copied.
+PooledObject object_type_selector(const std::string& type, const json& data, ObjectIO& io, ObjectPools& pools);
\ No newline at end of file
@@ -1,11 +1,15 @@
 #include "game_object_handler.h"
+#include "systems_controller.h"
+#include "threading_utils.h"
 
 #include <fstream> // Include this header to use ifstream
+#include <algorithm>
 
 using namespace std;
 
 
-ObjectsHandler::ObjectsHandler(string filename, SystemsController& new_controller) : object_io(new_controller) {
+ObjectsHandler::ObjectsHandler(string filename, SystemsController& new_controller) :
+	object_io(new_controller), meshes(new_controller.get_mesh_library()) {
 	// How this works is that when a map is loaded the vdg file is given to the 
 	// map loader, and the partner json file is sent here to load all the
 	// various entities and other things. The map loader also parses the json
@@ -25,6 +29,14 @@ ObjectsHandler::ObjectsHandler(string filename, SystemsController& new_controlle
 
 	
 
+	// Objects put their common data in the entity store as they are
+	// constructed so it needs to be visible before anything gets created
+	object_io.entities = &entities;
+	object_io.meshes = &meshes;
+	object_io.handler = this;
+
+	worker_pool = new_controller.get_worker_pool();
+
 	// Create the mouse renderer object
 	mouse_renderer = std::make_unique<MouseRenderer>(object_io);
 
@@ -35,6 +47,9 @@ ObjectsHandler::ObjectsHandler(string filename, SystemsController& new_controlle
 	}
 	json data = json::parse(f);
 
+	// Mouse, possessor and camera plus every entity in the map
+	entities.reserve(3 + data["entities"].size());
+
 	possessor = std::make_unique<Possessor>(json::object({ // Dummy data that will never change on init
 			{"victim", data["start_controllable"].get_ref<const string&>()}
 		}), object_io);
@@ -47,13 +62,16 @@ ObjectsHandler::ObjectsHandler(string filename, SystemsController& new_controlle
 		{"mode", 2}
 		}), object_io));
 
-	for (auto entity_data : data["entities"]) {
-		objects.push_back(move(object_type_selector(entity_data, object_io)));
+	for (const auto& entity_data : data["entities"]) {
+		objects.push_back(object_type_selector(entity_data["type"].get_ref<const string&>(), entity_data, object_io, pools));
 
 		// TODO: point_viewcontrols should probably be specially acessible
 
 		// Register the object in the io
 		object_io.register_object(entity_data["targetname"].get_ref<const string&>(), objects.back().get());
+
+		// Everything starts awake and goes to sleep on its own
+		awake_objects[objects.back()->type_index].push_back(objects.back().get());
 	}
 
 	vector<string> mesh_files_to_load;
@@ -65,59 +83,315 @@ ObjectsHandler::ObjectsHandler(string filename, SystemsController& new_controlle
 	// By default looks for meshes in the directory /gamedata/meshes/[filename].json
 	// You can also specify a special search path in the map json file with "extra_mesh_paths"
 	// but probably dont.
-	vector<string> paths = { "gamedata/meshes/" };
+	vector<string> paths = { MESH_DIRECTORY };
 	for (auto path : data["extra_mesh_paths"]) {
 		paths.push_back(path);
 	}
 
-	// empty mesh
-	meshes[""] = std::vector<float>();
-
-	// Now load the meshes
+	// Now load the meshes. The library is shared between maps, so anything
+	// the last map already had just gets another reference and is not
+	// parsed again. Cooked files are not parsed at all here, see below.
 	for (auto mesh_file : mesh_files_to_load) {
-		// Load the mesh file
+		bool found = false;
 		for (auto path : paths) {
-			ifstream f(path + mesh_file + ".json");
-			// If we cant find the file with the last path then something went wrong
-			if (!f.is_open() && path == paths.back()) {
-				// You should really not have missing mesh files, that will break a lot of things.
-				// Maybe you just mispelled a mesh name in the wrong place but i dont know that
-				throw runtime_error("Could not find mesh file " + mesh_file + ".json");
-			}
-			else if (!f.is_open()) {
+			string full_path = path + mesh_file + ".json";
+			if (!meshes.acquire_file(full_path)) {
 				continue; // Try the next path
 			}
 
-			// Loop over every mesh (they should be flat packed). Meshes follow format
-			// "name": [1, 2, 3, 4] // where each two numbers are a vertex
-			json mesh_data = json::parse(f);
-			for (auto& mesh : mesh_data.items()) {
-				meshes[mesh.key()] = mesh.value().get<std::vector<float>>();
+			mesh_files.push_back(full_path);
+			found = true;
+		}
+
+		if (!found) {
+			// You should really not have missing mesh files, that will break a lot of things.
+			// Maybe you just mispelled a mesh name in the wrong place but i dont know that
+			throw runtime_error("Could not find mesh file " + mesh_file + ".json");
+		}
+	}
+
+	// Anything our objects asked for that none of the files had. Used to
+	// blow up at render time, now it just renders nothing. Only look at our
+	// own entities, the library also has names from every other map.
+	// Everything that is there but not loaded yet gets prefetched in the
+	// background, in entity order, so the map starts right away.
+	ankerl::unordered_dense::set<MeshId> reported;
+	auto prefetch_mesh = [&](MeshId mesh) {
+		if (!meshes.is_available(mesh)) {
+			if (reported.insert(mesh).second) {
+				object_io.report_error("Could not find mesh " + meshes.name(mesh));
 			}
+			return;
 		}
+		meshes.request(mesh);
+	};
+
+	prefetch_mesh(mouse_renderer->mesh_aim);
+	prefetch_mesh(mouse_renderer->mesh_click);
+	for (EntityId id = 0; id < entities.size(); id++) {
+		prefetch_mesh(entities.mesh[id]);
 	}
+}
 
-	// Give the ref for the meshes to the object io
-	object_io.meshes = &meshes;
+ObjectsHandler::~ObjectsHandler() {
+	// Meshes stay in the library until the controller collects them, so the
+	// next map can pick them back up for free
+	for (const string& path : mesh_files) {
+		meshes.release_file(path);
+	}
 }
 
 ObjectUpdateReturnData ObjectsHandler::update(ObjectUpdateData data) {
 	mouse_renderer->update(data); // Update the mouse renderer
 	possessor->update(data); // Update the possessor
 
-	// Update all the objects
-	for (auto& obj : objects) {
-		obj->update(data);
+	woken_count = 0;
+	wake_objects(data);
+
+	// Update all the awake objects. Every type's bucket gets split into
+	// chunks and updated in parallel, anything an object does outside of
+	// itself gets recorded into its chunk's command buffer instead of
+	// happening right away. A chunk is only ever one type so it goes through
+	// that type's batch update, no virtual call per object.
+	update_tasks.clear();
+	for (size_t type = 0; type < ObjectTypes::count; type++) {
+		int count = (int)awake_objects[type].size();
+		for (int begin = 0; begin < count; begin += OBJECT_UPDATE_CHUNK_SIZE) {
+			update_tasks.push_back(ObjectUpdateTask{ (uint8_t)type, begin, min(count, begin + OBJECT_UPDATE_CHUNK_SIZE) });
+		}
+	}
+
+	int chunk_count = (int)update_tasks.size();
+	if ((int)command_buffers.size() < chunk_count) {
+		command_buffers.resize(chunk_count);
+	}
+
+	worker_pool->run(chunk_count, [&](int chunk) {
+		ObjectIO::set_command_buffer(&command_buffers[chunk]);
+
+		const ObjectUpdateTask& task = update_tasks[chunk];
+		ObjectTypes::batch_updates[task.type_index](
+			awake_objects[task.type_index].data() + task.begin, task.end - task.begin, data);
+
+		ObjectIO::set_command_buffer(nullptr);
+	});
+
+	// Sync point. Tasks are in type order then object order, going through
+	// them in order is the same as updating every bucket serially.
+	size_t command_count = 0;
+	for (int chunk = 0; chunk < chunk_count; chunk++) {
+		command_count += command_buffers[chunk].size();
+		object_io.apply_commands(command_buffers[chunk]);
+	}
+
+	// Now the ones that cant leave the main thread, these can do whatever.
+	// There are only ever a few so they just go through the virtual call.
+	// Anything they wake gets appended, so dont use iterators here.
+	for (auto& bucket : awake_objects) {
+		for (size_t i = 0; i < bucket.size(); i++) {
+			if (bucket[i]->main_thread_update) {
+				bucket[i]->update(data);
+			}
+		}
 	}
 
 	camera_controllers[active_camera_controller]->update(data);
+
+	// Only awake objects can have moved or changed their mesh, anything moved
+	// from outside got woken first. Before sleeping so this frame's count.
+	for (auto& bucket : awake_objects) {
+		for (GameObject* object : bucket) {
+			entity_grid.mark_dirty(object->entity);
+		}
+	}
+
+	put_objects_to_sleep();
+
+	// End of the frame as far as objects are concerned
+	apply_spawns_and_destroys();
+
 	ObjectUpdateReturnData ret_data;
-	ret_data.camera_pos = camera_controllers[active_camera_controller]->position;
+	ret_data.camera_pos = camera_controllers[active_camera_controller]->position();
+	ret_data.objects_active = command_count > 0 || woken_count > 0;
 
 	return ret_data;
 }
 
-int ObjectsHandler::render(float* lines_list, uint32_t* colors) {
+EntityHandle ObjectsHandler::spawn(const string& type, const json& params) {
+	PooledObject object;
+	try {
+		object = object_type_selector(type, params, object_io, pools);
+	}
+	catch (const exception& e) {
+		// Unlike loading a map a bad spawn shouldnt take the game down
+		object_io.report_error("ERROR: Could not spawn object of type " + type + ": " + e.what());
+		return EntityHandle();
+	}
+
+	EntityHandle handle = object->handle();
+
+	// Might be in a slot the grid already knows about
+	entity_grid.mark_dirty(handle.index);
+
+	if (!object->targetname().empty()) {
+		object_io.register_object(object->targetname(), object.get());
+	}
+
+	spawned_objects.push_back(move(object));
+	return handle;
+}
+
+void ObjectsHandler::destroy(EntityHandle handle) {
+	GameObject* object = object_io.get_object(handle);
+	if (object == nullptr) {
+		object_io.report_error("ERROR: Tried to destroy an object that does not exist");
+		return;
+	}
+
+	object->pending_destroy = true;
+	has_pending_destroy = true;
+	return;
+}
+
+void ObjectsHandler::wake(GameObject* object) {
+	// Might have been about to go to sleep this frame, not anymore
+	object->wants_sleep = false;
+
+	if (!object->sleeping) {
+		return;
+	}
+
+	object->sleeping = false;
+	awake_objects[object->type_index].push_back(object);
+	woken_count++;
+	return;
+}
+
+void ObjectsHandler::wake_objects(ObjectUpdateData& data) {
+	// Timers. Anything that was woken and went back to sleep with a different
+	// time since has a stale timer in here, the wake time wont match.
+	while (!wake_timers.empty() && wake_timers.top().time <= data.time) {
+		ObjectWakeTimer timer = wake_timers.top();
+		wake_timers.pop();
+
+		GameObject* object = object_io.get_object(timer.handle);
+		if (object && object->sleeping && object->wake_time == timer.time) {
+			wake(object);
+		}
+	}
+
+	// Whatever we are playing as wakes up things around it
+	GameObject* possessed = object_io.get_object(possessor->get_victim());
+	if (!possessed) {
+		return;
+	}
+
+	vec2 center = possessed->position();
+	vec2 wake_extent = vec2(OBJECT_WAKE_RADIUS, OBJECT_WAKE_RADIUS);
+	float radius_sq = OBJECT_WAKE_RADIUS * OBJECT_WAKE_RADIUS;
+
+	auto wake_if_close = [&](EntityId id) {
+		GameObject* owner = entities.info[id].owner;
+		if (owner == nullptr || !owner->sleeping) {
+			return;
+		}
+
+		vec2 diff = entities.position[id] - center;
+		if (diff.x * diff.x + diff.y * diff.y <= radius_sq) {
+			wake(owner);
+		}
+	};
+
+	if (entities.size() > ENTITY_GRID_THRESHOLD) {
+		// The grid is kept up to date by render, a frame old is close enough
+		// for this. Only has rendered entities in it but that is almost
+		// everything. Cells only get looked at if something in them reaches
+		// the radius.
+		nearby_entities.clear();
+		entity_grid.query(center - wake_extent, center + wake_extent, nearby_entities);
+		for (EntityId id : nearby_entities) {
+			wake_if_close(id);
+		}
+	}
+	else {
+		// Not worth it, just check every position
+		for (EntityId id = 0; id < (EntityId)entities.size(); id++) {
+			wake_if_close(id);
+		}
+	}
+
+	return;
+}
+
+void ObjectsHandler::put_objects_to_sleep() {
+	for (auto& bucket : awake_objects) {
+		size_t kept = 0;
+		for (GameObject* object : bucket) {
+			if (object->wants_sleep) {
+				object->wants_sleep = false;
+				object->sleeping = true;
+
+				if (object->wake_time >= 0.0f) {
+					wake_timers.push(ObjectWakeTimer{ object->wake_time, object->handle() });
+				}
+				continue;
+			}
+
+			bucket[kept++] = object;
+		}
+		bucket.resize(kept);
+	}
+
+	return;
+}
+
+void ObjectsHandler::apply_spawns_and_destroys() {
+	// New objects start updating next frame
+	for (auto& object : spawned_objects) {
+		awake_objects[object->type_index].push_back(object.get());
+		objects.push_back(move(object));
+	}
+	spawned_objects.clear();
+
+	if (!has_pending_destroy) {
+		return;
+	}
+	has_pending_destroy = false;
+
+	// Names first while they are still around, and the grid drops the slot
+	// next time it updates
+	for (auto& object : objects) {
+		if (object->pending_destroy) {
+			object_io.unregister_object(object->targetname(), object->handle());
+			entity_grid.mark_dirty(object->entity);
+		}
+	}
+
+	// Off the awake list before the pointers go bad
+	for (auto& bucket : awake_objects) {
+		bucket.erase(
+			remove_if(bucket.begin(), bucket.end(), [](GameObject* object) {
+				return object->pending_destroy;
+			}),
+			bucket.end()
+		);
+	}
+
+	// Keep everything else in the same order so updates stay deterministic.
+	// Dropping the pointer gives the object back to its pool, and the object
+	// gives its entity slot back, so any handles to it stop resolving.
+	objects.erase(
+		remove_if(objects.begin(), objects.end(), [](const PooledObject& object) {
+			return object->pending_destroy;
+		}),
+		objects.end()
+	);
+
+	return;
+}
+
+int ObjectsHandler::render(float* lines_list, LineMaterial* colors,
+	LineInstance* instances, std::vector<LineInstanceBatch>& batches, LineBudget& budget) {
 	// Render all the objects
 
 	int counter = 0;
@@ -130,21 +404,113 @@ int ObjectsHandler::render(float* lines_list, uint32_t* colors) {
 	// lines will not be stenciled like normal because we want to always see the
 	// mouse cursor. The mouse cursor can render to any number of lines within
 	// that number, if it uses <25 lines the rest are left empty.
-	int reserved_lines = 25;
+	int reserved_lines = LINE_BUDGET_CURSOR_LINES;
+	budget.take(LINE_PRIORITY_CURSOR, reserved_lines);
 
-	// Set all lines from mouse_lines to reserved_lines to black in case on this frame
+	// Set all lines from mouse_lines to reserved_lines to nothing in case on this frame
 	// we went from a cursor with a lines to b lines where a > b. Dont need to rouch the 
 	// actual vertex data, since it doesnt matter.
 	for (int i = mouse_lines; i < reserved_lines; i++) {
-		colors[i] = 0; // Black color
+		colors[i] = preset_material(LINE_COLOR_PRESET_NONE);
 	}
 
 	counter = reserved_lines * 4;
 
-	vec2 camera_pos = camera_controllers[active_camera_controller]->position;
+	vec2 camera_pos = camera_controllers[active_camera_controller]->position();
+
+	// Walk the entity store front to back. Plain meshes get rendered straight
+	// from the arrays, only objects with their own render function get called.
+	// render_entity_mesh culls anything whose mesh bounds are off screen, and
+	// with enough entities we dont even look at the far away ones, the grid
+	// hands back only the ones near the camera.
+	visible_entities.clear();
+	size_t entity_count = entities.size();
+	if (entity_count > ENTITY_GRID_THRESHOLD) {
+		vec2 half_view = vec2(480.0f + VIEW_CULL_MARGIN, 268.0f + VIEW_CULL_MARGIN);
+		entity_grid.update(entities, meshes);
+		entity_grid.query(camera_pos - half_view, camera_pos + half_view, visible_entities);
+	}
+	else {
+		for (EntityId id = 0; id < entity_count; id++) {
+			visible_entities.push_back(id);
+		}
+	}
+
+	instanced_entities.clear();
+	mesh_instance_counts.assign(meshes.size(), 0);
+
+	for (EntityId id : visible_entities) {
+		switch (entities.render_mode[id]) {
+		case ENTITY_RENDER_MESH: {
+			// Just collect these, they are drawn instanced below
+			MeshId mesh = entities.mesh[id];
+			MeshSpan span = meshes.get(mesh);
+			if (span.lines.empty()) {
+				// Might just not be streamed in yet
+				meshes.request(mesh);
+				break;
+			}
+			if (!entity_on_screen(entities, id, span, camera_pos)) {
+				break;
+			}
+			if (instanced_entities.size() >= MAX_LINE_INSTANCES) {
+				break;
+			}
+			if (!budget.take(LINE_PRIORITY_OBJECTS, (int)span.lines.size())) {
+				break;
+			}
+			instanced_entities.push_back(id);
+			mesh_instance_counts[mesh]++;
+			break;
+		}
+
+		case ENTITY_RENDER_CUSTOM: {
+			// No way to know how many lines it draws until it has, if that
+			// didnt fit throw them away again
+			int before = counter;
+			counter = entities.info[id].owner->render(lines_list, counter, colors, camera_pos);
+			if (!budget.take(LINE_PRIORITY_OBJECTS, (counter - before) / 4)) {
+				counter = before;
+			}
+			break;
+		}
+
+		case ENTITY_RENDER_NONE:
+		default:
+			break;
+		}
+	}
+
+	// Group instances by mesh so every mesh is one draw call. Counting sort,
+	// work out where each mesh's run starts then drop everything in.
+	batches.clear();
+	uint32_t next_instance = 0;
+	for (MeshId mesh = 0; mesh < mesh_instance_counts.size(); mesh++) {
+		uint32_t count = mesh_instance_counts[mesh];
+		if (count == 0) {
+			continue;
+		}
+
+		batches.push_back(LineInstanceBatch{ meshes.entry(mesh).line_count, next_instance, count });
+
+		// Reuse the count as the write cursor for this mesh
+		mesh_instance_counts[mesh] = next_instance;
+		next_instance += count;
+	}
 
-	for (std::unique_ptr<GameObject>& obj : objects) {
-		counter = obj->render(lines_list, counter, colors, camera_pos);
+	// Same as render_entity_mesh but only for the origin, the shader does
+	// the per vertex part.
+	vec2 screen_size = vec2(960.0f, 536.0f);
+	for (EntityId id : instanced_entities) {
+		MeshId mesh = entities.mesh[id];
+
+		LineInstance& instance = instances[mesh_instance_counts[mesh]++];
+		instance.position = ((entities.position[id] - camera_pos + screen_size / 2.0f) / screen_size) * 2.0f - 1.0f;
+		instance.scale = entities.render_scale[id];
+		instance.rotation = entities.rotation[id];
+		instance.material = entities.color[id];
+		instance.first_line = meshes.first_line(mesh);
+		instance.pad = 0;
 	}
 
 	return counter / 4; // Return the number of lines rendered
@@ -4,17 +4,48 @@
 
 #include "object_utils.h"
 #include "game_object.h"
+#include "entity_store.h"
+#include "mesh_library.h"
+#include "entity_grid.h"
+#include "line_budget.h"
 
 #include <unordered_dense.h>
 
 #include <string>
 #include <vector>
 #include <map>
+#include <queue>
+#include <array>
 
 #include "json.hpp"
 using json = nlohmann::json;
 
 class SystemsController;
+class WorkerPool;
+
+// How many objects one task in the parallel update gets. Small enough that
+// a few hundred npcs still spread across cores.
+#define OBJECT_UPDATE_CHUNK_SIZE 64
+
+// One chunk of one type's awake objects in the parallel update
+struct ObjectUpdateTask {
+	uint8_t type_index;
+	int begin;
+	int end;
+};
+
+// Sleeping objects this close to whatever is possessed get woken up
+#define OBJECT_WAKE_RADIUS 512.0f
+
+// Sleeping object that wants to be woken at some time
+struct ObjectWakeTimer {
+	float time;
+	EntityHandle handle;
+
+	bool operator>(const ObjectWakeTimer& other) const {
+		return time > other.time;
+	}
+};
 
 class ObjectsHandler {
 
@@ -22,12 +53,19 @@ public:
 	// Constructor
 	ObjectsHandler(std::string filename, SystemsController& new_controller);
 
+	// Gives our references on mesh files back
+	~ObjectsHandler();
+
 	// Update the objects
 	ObjectUpdateReturnData update(ObjectUpdateData data);
 
 	// Render the objects
 	// !! this must be the first thing rendered to not screw up cursor rendering !!
-	int render(float* lines_list, uint32_t* colors);
+	// Plain mesh objects dont go into the lines list, they get written to
+	// instances and batches and the line shader expands them. Their lines
+	// still count against the budget, objects that dont fit are not drawn.
+	int render(float* lines_list, LineMaterial* colors,
+		LineInstance* instances, std::vector<LineInstanceBatch>& batches, LineBudget& budget);
 
 	// Cant just directly render the error log, so just return strings
 	std::vector<std::string> get_error_log();
@@ -37,11 +75,33 @@ public:
 		return &object_io;
 	}
 
+	// Spawn an object at runtime, see ObjectIO::spawn. Returns a null handle
+	// and reports an error if it cant be made.
+	EntityHandle spawn(const std::string& type, const json& params);
+
+	// Mark an object to be removed at the end of the frame
+	void destroy(EntityHandle handle);
+
+	// Put a sleeping object back on the awake list. Use GameObject::wake
+	void wake(GameObject* object);
+
 private:
 
 	// The common object io
 	ObjectIO object_io;
 
+	// Every mesh objects can use. Objects intern their mesh names in here as
+	// they are created, the mesh files fill in the data afterwards. Held by
+	// the controller and shared by every map.
+	MeshLibrary& meshes;
+
+	// Mesh files we hold a reference on
+	std::vector<std::string> mesh_files;
+
+	// Hot data for every object, including the meta objects below. Declared
+	// before the objects so it outlives them.
+	EntityStore entities;
+
 	// Meta objects
 	std::unique_ptr<MouseRenderer> mouse_renderer;
 	std::unique_ptr<Possessor> possessor;
@@ -49,10 +109,61 @@ private:
 	std::vector<std::unique_ptr<PointViewControl>> camera_controllers;
 	int active_camera_controller = 0; // Index of the active camera controller
 
+	// Every spawnable object lives in one of these. Declared before the
+	// objects so the pools outlive them.
+	ObjectPools pools;
+
 	// Holds all the game objects. Note that this is just a flat array, and if
 	// you want get objects by targetname you should use the io, as that holds
-	// the object registry.
-	std::vector<std::unique_ptr<GameObject>> objects;
+	// the object registry. Rendering does not go through this, it walks the
+	// entity store instead.
+	std::vector<PooledObject> objects;
+
+	// Spawned this frame, moved into objects at the end of the frame so
+	// nothing spawns into the array while it is being walked
+	std::vector<PooledObject> spawned_objects;
+	bool has_pending_destroy = false;
+
+	// End of frame, move spawned objects in and remove destroyed ones
+	void apply_spawns_and_destroys();
+
+	// Only these get updated. Most of a big map is props and idle npcs that
+	// have nothing to do, they sleep until something wakes them. One bucket
+	// per type in ObjectTypes so each type gets updated in one go without
+	// virtual calls. Kept in the order things were woken so updates stay
+	// deterministic.
+	std::array<std::vector<GameObject*>, ObjectTypes::count> awake_objects;
+
+	// Rebuilt every frame from the buckets
+	std::vector<ObjectUpdateTask> update_tasks;
+
+	// Soonest first
+	std::priority_queue<ObjectWakeTimer, std::vector<ObjectWakeTimer>, std::greater<ObjectWakeTimer>> wake_timers;
+
+	// Timers and the possessed object walking up to things
+	void wake_objects(ObjectUpdateData& data);
+
+	// How many things got woken this frame, reset at the start of update
+	int woken_count = 0;
+
+	// Take everything that called sleep this frame off the awake list
+	void put_objects_to_sleep();
+
+	// Only used for culling once there are a lot of entities
+	EntityGrid entity_grid;
+	std::vector<EntityId> visible_entities;
+
+	// Scratch for waking things near the possessed object
+	std::vector<EntityId> nearby_entities;
+
+	// Scratch for sorting instances by mesh
+	std::vector<EntityId> instanced_entities;
+	std::vector<uint32_t> mesh_instance_counts;
+
+	// Shared with everything else, held by the systems controller
+	WorkerPool* worker_pool;
 
-	ankerl::unordered_dense::map<std::string, std::vector<float>> meshes;
+	// One per chunk of objects in the parallel update. Kept around between
+	// frames so they dont reallocate every time.
+	std::vector<ObjectCommandBuffer> command_buffers;
 };
\ No newline at end of file
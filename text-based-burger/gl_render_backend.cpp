@@ -0,0 +1,834 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <imgui/imgui.h>
+#include <imgui/imgui_impl_glfw.h>
+#include <imgui/imgui_impl_opengl3.h>
+
+#include <iostream>
+#include <stdexcept>
+
+#include "gl_render_backend.h"
+#include "font_loader.h"
+#include "line_quantize.h"
+
+using namespace std;
+
+// These are not constants 
+int window_width = 1300;
+int window_height = 720;
+
+// Character dimensions
+int CHAR_WIDTH = 8;
+int CHAR_HEIGHT = 16;
+int CHAR_RATIO = CHAR_HEIGHT / CHAR_WIDTH;
+
+// Character columns on screen
+int CHAR_COLS = 120;
+int CHAR_ROWS = 68;
+
+// 960 * 544
+int SMALL_WINDOW_WIDTH = CHAR_WIDTH * CHAR_COLS;
+int SMALL_WINDOW_HEIGHT = (CHAR_ROWS * CHAR_HEIGHT) / CHAR_RATIO;
+
+// Mouse position in character space
+int mouse_char_x = 0;
+int mouse_char_y = 0;
+
+float scroll_x = 0.0f, scroll_y = 0.0f;
+
+float native_x, native_y = 0;
+
+const char* WINDOW_TITLE = "Text based burger";
+
+float aspect_ratio = (float)window_width / (float)window_height;
+float aspect_ratio_small = (float)SMALL_WINDOW_HEIGHT / (float)SMALL_WINDOW_WIDTH;
+
+float dval1 = 10.0f;
+float dval2 = 0.0f;
+
+//GLuint fullTex;
+GLuint compositeTex;
+GLuint depthStencilRBO;
+//GLuint blurTex;
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
+	glViewport(0, 0, width, height);
+
+	window_width = width;
+	window_height = height;
+
+	aspect_ratio = (float)window_width / (float)window_height;
+
+	// Resize fbos that are not the native one
+	/*glBindTexture(GL_TEXTURE_2D, fullTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);*/
+
+	glBindTexture(GL_TEXTURE_2D, compositeTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// Resize depth-stencil renderbuffer
+	glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	/*glBindTexture(GL_TEXTURE_2D, blurTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);*/
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+	scroll_x += (float)xoffset;
+	scroll_y += (float)yoffset;
+}
+
+void processInput(GLFWwindow* window) {
+	// Mouse position
+	double xpos, ypos;
+	glfwGetCursorPos(window, &xpos, &ypos);
+
+	// Convert from window space to native space
+	float scale = (float)window_height / 536.0; // more hard coded numbers oh yeah
+	int offset_x = (window_width - 960.0 * scale) / 2.0;
+
+	native_x = (xpos - offset_x) / scale;
+	native_y = (ypos - 0)        / scale;
+
+	// i have no idea why this is needed but without it the cursor position desynchs with the character grid
+	// by half a character at the bottom of the screen why ???????????
+	float shader_scale = 1.01f + (1.0f / ((float)CHAR_ROWS) / (float)CHAR_RATIO);
+
+	// Convert to character space
+	mouse_char_x = (int)(native_x / CHAR_WIDTH);
+	mouse_char_y = (int)((native_y * shader_scale) / (CHAR_HEIGHT)); // shader offset
+}
+
+void draw_imgui() {
+	// Start the Dear ImGui frame
+	ImGui_ImplOpenGL3_NewFrame();
+	ImGui_ImplGlfw_NewFrame();
+	
+	ImGui::NewFrame();
+
+	// Because imgui hijacks things thanks imgui
+	ImGui::SetMouseCursor(ImGuiMouseCursor_None);
+	
+	// return here to not draw imgui
+	return;
+
+	ImGui::SliderFloat("dval1", &dval1, 0.5f, 10.0f);
+	ImGui::SliderFloat("dval2", &dval2, 0.0f, 255.0f);
+	
+	return;
+}
+
+void set_uniforms() {
+	// Set uniforms here
+}
+
+// glfw key for every InputKey, same order as the enum
+static const int input_key_glfw[INPUT_KEY_COUNT] = {
+	GLFW_KEY_W,
+	GLFW_KEY_A,
+	GLFW_KEY_S,
+	GLFW_KEY_D,
+	GLFW_KEY_B,
+	GLFW_KEY_Y,
+	GLFW_KEY_Z,
+	GLFW_KEY_DELETE,
+	GLFW_KEY_LEFT_SHIFT,
+	GLFW_KEY_LEFT_CONTROL,
+	GLFW_KEY_RIGHT_CONTROL,
+	GLFW_KEY_F6,
+	GLFW_KEY_F11
+};
+
+// Create a window for 2d rendering
+
+GLRenderBackend::GLRenderBackend(bool compact_line_verts) : compact_line_verts(compact_line_verts) {
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	// No depth buffer only stencil if you crash you are probably on iphone 4
+	glfwWindowHint(GLFW_STENCIL_BITS, 8);
+
+	window = glfwCreateWindow(window_width, window_height, WINDOW_TITLE, NULL, NULL);
+    if (window == NULL)
+    {
+        glfwTerminate();
+        throw runtime_error("Failed to create GLFW window");
+    }
+    glfwMakeContextCurrent(window);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
+	glfwSwapInterval(0); // Disable vsync
+
+	glfwSetScrollCallback(window, scroll_callback);
+
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		throw runtime_error("Failed to initialize GLAD");
+	}
+
+	// Setup Dear ImGui context
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+	ImGuiIO& io = ImGui::GetIO();
+	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
+
+	// Setup Platform/Renderer backends
+	ImGui_ImplGlfw_InitForOpenGL(window, true);          // Second param install_callback=true will install GLFW callbacks and chain to existing ones.
+	ImGui_ImplOpenGL3_Init();
+
+	glViewport(0, 0, window_width, window_height);
+
+	// Name            || Samples from   || Writes to    || Purpose
+	// 
+	// raster_shader   || ---			 || nativeFBO    || Render text to native size
+	// pass_shader     || nativeFBO      || fullFBO      || Upscale text to full screen size
+	// scanline_shader || fullFBO        || compositeFBO || Draw raster glow to composite FBO 
+	// stencil_shader  || ---            || compositeFBO || Draw stencil for lines
+	// line_shader     || ---		     || compositeFBO || Draw vector lines
+	// instanced_line_shader || ---      || compositeFBO || Draw instanced object meshes
+
+	// the scanline shader could be done in the pass shader, but both 
+
+	// Compile shaders
+	raster_shader   = make_unique<Shader>("vertex.glsl", "fragment.glsl",				std::vector<std::string>(), 460);
+	pass_shader     = make_unique<Shader>("vertex.glsl", "fragment_pass.glsl",		std::vector<std::string>(), 460);
+	scanline_shader = make_unique<Shader>("vertex.glsl", "fragment_scanline.glsl",	std::vector<std::string>(), 460);
+	stencil_shader  = make_unique<Shader>("vertex.glsl", "fragment_stencil.glsl",		std::vector<std::string>(), 460);
+	line_shader     = make_unique<Shader>("vertex_lines.glsl", "fragment_lines.glsl",	std::vector<std::string>{ "line_beam.glsl" }, 460);
+	instanced_line_shader = make_unique<Shader>("vertex_lines_instanced.glsl", "fragment_lines_instanced.glsl", std::vector<std::string>{ "line_beam.glsl" }, 460);
+	//Shader blur_shader     = Shader("vertex.glsl", "fragment_blur.glsl",        std::vector<std::string>(), 460);
+	//Shader crt_shader      = Shader("vertex.glsl", "fragment_crt.glsl",         std::vector<std::string>(), 460);
+
+#pragma region General loading
+
+	// Load font, this had to be done first and on the main thread
+	vector<uint32_t> font_data = load_font("gamedata\\fonts\\font.txt"); // Enter your font path here
+
+	// Bind the main shader and set uniform
+	raster_shader->use();
+
+	// Uniform array of uint32_t
+	uint32_t* font_data_array = new uint32_t[1024];
+
+	// Copy font data to the array
+	for (int i = 0; i < font_data.size(); i++) {
+		font_data_array[i] = font_data[i];
+	}
+
+	// Set the uniform
+	glUniform4uiv(glGetUniformLocation(raster_shader->ID, "glyphs"), 256, font_data_array);
+
+	// Internal render targets. These are persistently mapped gpu buffers, the
+	// systems render straight into them and there is nothing to upload. Each
+	// one is triple buffered, see ring_buffer.h.
+	NUM_CHARS = CHAR_COLS * CHAR_ROWS;
+
+	// Character grid buffer
+	// Holds CHAR_COLS by CHAR_ROWS characters
+	// Stores uints for character and color
+	// First 8 bits are character, next 8 are color, next 8 are background color, and 8 unused
+	char_grid_ring = make_unique<PersistentRingBuffer>(NUM_CHARS * sizeof(uint32_t));
+
+	// 2 vertices per line, 2 floats or 2 snorm16s per vertex
+	if (compact_line_verts) {
+		line_verts_ring = make_unique<PersistentRingBuffer>(MAX_LINES * 4 * sizeof(int16_t));
+		line_verts_staging.resize(MAX_LINES * 4, 0.0f);
+	}
+	else {
+		line_verts_ring = make_unique<PersistentRingBuffer>(MAX_LINES * 4 * sizeof(float));
+	}
+	// 1 16 bit palette material per line, the shader reads them two to a uint
+	line_materials_ring = make_unique<PersistentRingBuffer>((MAX_LINES + 1) / 2 * sizeof(uint32_t));
+
+	// Objects that use a plain mesh get drawn instanced, one of these each
+	line_instances_ring = make_unique<PersistentRingBuffer>(MAX_LINE_INSTANCES * sizeof(LineInstance));
+
+	frame_fences = make_unique<FrameFences>();
+
+#pragma endregion
+#pragma region Vertex Buffers
+
+	// Vertex is simple we only render a screen quad
+
+	// Full-screen quad vertices and indices
+	float vertices[] = {
+		// Positions   // Texture Coords
+		-1.0f, -1.0f,  0.0f, 0.0f,
+		 1.0f, -1.0f,  1.0f, 0.0f,
+		 1.0f,  1.0f,  1.0f, 1.0f,
+		-1.0f,  1.0f,  0.0f, 1.0f
+	};
+
+	unsigned int indices[] = {
+		0, 1, 2,   // First triangle
+		0, 2, 3    // Second triangle
+	};
+
+	// Create and bind VAO and VBO
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(VAO);
+
+	// Bind vertex buffer
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+
+	// Bind index buffer
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+
+	// Set vertex attributes
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+	glEnableVertexAttribArray(0); // Position
+
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+	glEnableVertexAttribArray(1); // Texture Coordinates
+
+	// Unbind VAO
+	glBindVertexArray(0);
+
+
+	// Line drawing vertex buffer and color buffer
+	// Vertex buffer is just draw elements, unindexed. Monolithic buffer, so lines can be any random
+	// object so no indeces, gldrawarrays(gl_lines)
+	// Color buffer is array of 32 bit uints.
+
+	// Lines are drawn as quads but there is no quad vertex buffer anymore, the
+	// line shader pulls the raw endpoints out of the line data SSBO with
+	// gl_VertexID and expands them itself. GL still wants some VAO bound to
+	// draw so this one is empty.
+	glGenVertexArrays(1, &line_VAO);
+
+#pragma endregion
+#pragma region Framebuffers
+
+	//  ==== Native framebuffer for raster text rendering 
+
+	// Create framebuffer
+	glGenFramebuffers(1, &nativeFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, nativeFBO);
+
+	// Create texture for framebuffer attachment
+	glGenTextures(1, &nativeTex);
+	glBindTexture(GL_TEXTURE_2D, nativeTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, SMALL_WINDOW_WIDTH, SMALL_WINDOW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+	// Set texture border color to black
+	glm::vec4 border_color(0.0f, 0.0f, 0.0f, 1.0f);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
+
+	// Attach texture to the framebuffer
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, nativeTex, 0);
+
+	// Check framebuffer completeness
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0); // Unbind framebuffer
+
+	//// ==== Fullscreen framebuffer for upscaling text
+
+	//GLuint fullFBO;
+	//glGenFramebuffers(1, &fullFBO);
+	//glBindFramebuffer(GL_FRAMEBUFFER, fullFBO);
+
+	//glGenTextures(1, &fullTex);
+	//glBindTexture(GL_TEXTURE_2D, fullTex);
+	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+	//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
+
+	//glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fullTex, 0);
+
+	//if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+	//	std::cerr << "ERROR: Fullscreen framebuffer is not complete!" << std::endl;
+	//}
+	//glBindFramebuffer(GL_FRAMEBUFFER, 0); // Unbind framebuffer
+
+	// ==== Composite for vector lines and raster text
+
+	glGenFramebuffers(1, &compositeFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, compositeFBO);
+
+	glGenTextures(1, &compositeTex);
+	glBindTexture(GL_TEXTURE_2D, compositeTex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositeTex, 0);
+
+	// ----- Create Depth + Stencil Renderbuffer -----
+	glGenRenderbuffers(1, &depthStencilRBO);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRBO);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
+
+	// Attach renderbuffer to framebuffer
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRBO);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "ERROR: Composite framebuffer is not complete!" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+
+	//// ==== Blur framebuffer for intermediate step
+	//GLuint blurFBO;
+	//glGenFramebuffers(1, &blurFBO);
+	//glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+
+	//glGenTextures(1, &blurTex);
+	//glBindTexture(GL_TEXTURE_2D, blurTex);
+	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
+
+	//glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTex, 0);
+
+	//if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+	//	std::cerr << "ERROR: Blur framebuffer is not complete!" << std::endl;
+	//}
+	//glBindFramebuffer(GL_FRAMEBUFFER, 0); // Unbind framebuffer
+
+#pragma endregion
+#pragma region SSBOs
+
+	// The char grid (binding 0), line materials (1), raw line data (3) and line
+	// instances (5) are ring buffers made up top, they get bound to the right
+	// slot every frame.
+
+#define MAX_STENCIL_REGIONS 16
+	// Stencil regions buffer
+	// Holds 4 * sizof(float) * MAX_STENCIL_REGIONS bytes
+	// Each region is two vec2s [x1, y1], [x2, y2] in native space
+	stencil_regions = new float[MAX_STENCIL_REGIONS * 4]; // 4 floats per region (2 vec2s)
+	region_count = 0;
+
+	glGenBuffers(1, &stencil_regions_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stencil_regions_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_STENCIL_REGIONS * 4 * sizeof(float), stencil_regions, GL_DYNAMIC_COPY);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, stencil_regions_buffer); // bind to 2
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Mesh lines for the instanced path. Every mesh packed together, only
+	// uploaded when the mesh library changes so this starts empty.
+	mesh_lines_version = 0;
+
+	glGenBuffers(1, &mesh_lines_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_lines_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(float), nullptr, GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, mesh_lines_buffer); // bind to 4
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Line palette, every material's packed color. Both line shaders look
+	// colors up in it, uploaded when something new gets added to it.
+	palette_version = 0;
+
+	glGenBuffers(1, &palette_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, palette_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t), nullptr, GL_STATIC_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, palette_buffer); // bind to 6
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The instanced shader pulls everything out of the SSBOs, but GL still
+	// wants some VAO bound to draw
+	glGenVertexArrays(1, &instanced_VAO);
+
+	glGenQueries(RING_BUFFER_FRAMES * (GL_RENDER_PASS_COUNT + 1), &pass_queries[0][0]);
+
+#pragma endregion
+}
+
+GLRenderBackend::~GLRenderBackend() {
+	// Ring buffers have to be unmapped while there is still a context
+	frame_fences.reset();
+	char_grid_ring.reset();
+	line_verts_ring.reset();
+	line_materials_ring.reset();
+	line_instances_ring.reset();
+
+	glfwTerminate();
+}
+
+bool GLRenderBackend::is_running() {
+	return !glfwWindowShouldClose(window);
+}
+
+GlobalUpdateData GLRenderBackend::poll_input() {
+	processInput(window);
+
+	GlobalUpdateData global_update_data;
+	global_update_data.mouse_pos_native = vec2(native_x, native_y);
+	global_update_data.mouse_pos_char = vec2(mouse_char_x, mouse_char_y);
+	global_update_data.scroll_delta = vec2(scroll_x, scroll_y);
+	global_update_data.time = glfwGetTime();
+
+	// Snapshot every key anything cares about, nothing past here talks to glfw
+	for (int key = 0; key < INPUT_KEY_COUNT; key++) {
+		global_update_data.input.keys[key] = glfwGetKey(window, input_key_glfw[key]) == GLFW_PRESS;
+	}
+	global_update_data.input.mouse_left = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+
+	// f11 to toggle fullscreen, this is the only thing that needs the window
+	if (global_update_data.input.is_down(INPUT_KEY_F11)) {
+		if (!fullscreen_key_down) {
+			toggle_fullscreen();
+		}
+		fullscreen_key_down = true;
+	}
+	else {
+		fullscreen_key_down = false;
+	}
+
+	return global_update_data;
+}
+
+void GLRenderBackend::toggle_fullscreen() {
+	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+	if (glfwGetWindowMonitor(window) == NULL) {
+		glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
+	}
+	else {
+		glfwSetWindowMonitor(window, NULL, 100, 100, 1300, 720, 0);
+	}
+	return;
+}
+
+double GLRenderBackend::get_refresh_rate() {
+	// Whatever monitor we are fullscreen on, otherwise assume the primary one
+	GLFWmonitor* monitor = glfwGetWindowMonitor(window);
+	if (monitor == NULL) {
+		monitor = glfwGetPrimaryMonitor();
+	}
+	if (monitor == NULL) {
+		return 0.0;
+	}
+	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+	return mode != NULL ? (double)mode->refreshRate : 0.0;
+}
+
+void GLRenderBackend::mark_pass(int pass) {
+	glQueryCounter(pass_queries[frame][pass], GL_TIMESTAMP);
+	return;
+}
+
+void GLRenderBackend::read_pass_timings() {
+	static const char* pass_names[GL_RENDER_PASS_COUNT] = {
+		"text", "composite", "stencil", "lines", "crt", "imgui"
+	};
+
+	GLuint64 timestamps[GL_RENDER_PASS_COUNT + 1];
+	for (int i = 0; i <= GL_RENDER_PASS_COUNT; i++) {
+		glGetQueryObjectui64v(pass_queries[frame][i], GL_QUERY_RESULT, &timestamps[i]);
+	}
+
+	pass_timings.resize(GL_RENDER_PASS_COUNT);
+	for (int i = 0; i < GL_RENDER_PASS_COUNT; i++) {
+		pass_timings[i].name = pass_names[i];
+		pass_timings[i].ms = (timestamps[i + 1] - timestamps[i]) / 1000000.0; // ns
+	}
+	return;
+}
+
+RenderTargets GLRenderBackend::begin_frame() {
+	// Move on to the next ring slot, waits if the gpu is somehow still
+	// reading it from 3 frames ago
+	frame = frame_fences->begin_frame();
+
+	return RenderTargets{
+		(uint32_t*)char_grid_ring->slot(frame),
+		compact_line_verts ? line_verts_staging.data() : (float*)line_verts_ring->slot(frame),
+		(LineMaterial*)line_materials_ring->slot(frame),
+		(LineInstance*)line_instances_ring->slot(frame)
+	};
+}
+
+void GLRenderBackend::end_frame(const RenderData& render_data) {
+	int num_lines = render_data.lines_counter;
+
+	if (compact_line_verts) {
+		quantize_line_verts(line_verts_staging.data(), (uint32_t*)line_verts_ring->slot(frame), min(num_lines, MAX_LINES));
+	}
+
+	// vec2s are just float x, y; so you can cast them directly
+	stencil_regions = reinterpret_cast<const float*>(render_data.stencil_regions.data());
+	region_count = render_data.stencil_regions.size() / 2; // each region is two vec2s
+
+	// This slot's timestamps from last time around are done by now
+	if (pass_queries_issued[frame]) {
+		read_pass_timings();
+	}
+	mark_pass(0);
+
+	// Rendering starts here
+	draw_imgui();
+	set_uniforms();
+
+#pragma region raster_shader
+	// Text only gets rastered again when some of it changed, otherwise last
+	// frame's nativeTex is still right. Only the changed rows get drawn.
+	int dirty_from = render_data.char_rows_dirty_from;
+	int dirty_to = render_data.char_rows_dirty_to;
+	if (!native_valid) {
+		// Nothing in it yet, do all of it
+		dirty_from = 0;
+		dirty_to = SMALL_WINDOW_HEIGHT / CHAR_HEIGHT;
+	}
+
+	if (dirty_from < dirty_to) {
+		glBindFramebuffer(GL_FRAMEBUFFER, nativeFBO);
+		glViewport(0, 0, SMALL_WINDOW_WIDTH, SMALL_WINDOW_HEIGHT); // Match the framebuffer size
+
+		// Rows go down from the top, row 0 is the top 16 pixels
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(0, SMALL_WINDOW_HEIGHT - dirty_to * CHAR_HEIGHT, SMALL_WINDOW_WIDTH, (dirty_to - dirty_from) * CHAR_HEIGHT);
+		glClear(GL_COLOR_BUFFER_BIT); // Clear the framebuffer
+
+		raster_shader->use();
+
+		// The screen was rendered straight into this slot, nothing to copy
+		char_grid_ring->bind(0, frame);
+
+		glBindVertexArray(VAO);							// Fullscreen quad VAO
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);  // Correct 		// Draw the quad
+
+		glDisable(GL_SCISSOR_TEST);
+
+		// bind texture and generate mipmaps
+		glBindTexture(GL_TEXTURE_2D, nativeTex);		// Bind texture to unit 0
+		glGenerateMipmap(GL_TEXTURE_2D);				// Generate mipmaps for the texture
+		glBindTexture(GL_TEXTURE_2D, 0);				// Unbind texture
+
+		native_valid = true;
+	}
+
+	mark_pass(1);
+
+#pragma endregion
+#pragma region pass_shader
+	// Finally unbind the small framebuffer
+	// ---- ALL IN SOFTWARE RASTER ELEMENTS MUST BE DRAWN ABOVE THIS LINE ----
+	glBindFramebuffer(GL_FRAMEBUFFER, compositeFBO);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glViewport(0, 0, window_width, window_height);	// Fullscreen viewport
+
+	pass_shader->use();							// Use shader first
+	glActiveTexture(GL_TEXTURE0);					// Activate texture unit 0
+	glBindTexture(GL_TEXTURE_2D, nativeTex);		// Bind texture to unit 0
+	pass_shader->setInt("screenTexture", 0);		// Set uniform to use unit 0
+
+	// Set uniforms
+	pass_shader->setFloat("aspectRatio", aspect_ratio);
+	pass_shader->setFloat("aspectRatioSmall", aspect_ratio_small);
+
+	glBindVertexArray(VAO);							// Fullscreen quad VAO
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);  // Correct              // Draw the quad
+
+	mark_pass(2);
+
+#pragma endregion
+#pragma region stencil_shader
+	glBindFramebuffer(GL_FRAMEBUFFER, compositeFBO);
+	glEnable(GL_STENCIL_TEST); // Enable stencil test
+
+	// Draw to stencil buffer for lines
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE); // Don't draw colors
+	glStencilFunc(GL_ALWAYS, 1, 0xFF);                  // Always pass stencil test
+	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);          // Replace stencil with ref=1 on pass
+	glStencilMask(0xFF);
+
+	stencil_shader->use();
+	stencil_shader->setFloat("aspectRatio", aspect_ratio);
+	stencil_shader->setFloat("aspectRatioSmall", aspect_ratio_small);
+	stencil_shader->setInt("zone_count", region_count); // whatever
+
+	// Upload stencil regions to the shader
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stencil_regions_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, MAX_STENCIL_REGIONS * 4 * sizeof(float), stencil_regions);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Draw fullscreen quad only the fragement is different so we can use the same VAO
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+	// Step 2: Only allow drawing where stencil == 1
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE); // Enable color writes
+	glStencilMask(0x00);                             // Disable writing to stencil
+
+	mark_pass(3);
+
+#pragma endregion
+#pragma region line_shader 
+	// Draw electron beam lines as quads (two triangles each)
+	// The vertex shader expands every line into its quad, all the cpu does is
+	// upload the endpoints and palette materials
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	glEnable(GL_BLEND);
+	glDisable(GL_CULL_FACE); // Important for quads
+
+	// Thickness parameter - adjust as needed
+	float thickness = dval1; // You can make this a uniform or parameter
+
+	if (render_data.palette_version != palette_version) {
+		const vector<uint32_t>& palette = *render_data.palette;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, palette_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, palette.size() * sizeof(uint32_t), palette.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		palette_version = render_data.palette_version;
+	}
+
+	line_shader->use();
+
+	// Set uniforms 
+	line_shader->setFloat("aspectRatio", aspect_ratio);
+	line_shader->setFloat("aspectRatioSmall", aspect_ratio_small);
+	line_shader->setFloat("thickness", thickness);
+	line_shader->setFloat("thickness_test", dval2);
+	line_shader->setBool("compactVertices", compact_line_verts);
+	line_shader->setFloat("compactRange", LINE_QUANTIZE_RANGE);
+
+	// Materials and raw line data, 18 bytes a line (10 with compact line
+	// verts), already sitting in this frame's slots
+	line_materials_ring->bind(1, frame);
+	line_verts_ring->bind(3, frame);
+
+	// Nothing in it, everything comes out of the SSBOs
+	glBindVertexArray(line_VAO);
+
+	// Draw the first 25 quads that are reserved for the cursor without stencil
+	glDrawArrays(GL_TRIANGLES, 0, min(num_lines, LINE_BUDGET_CURSOR_LINES) * 6); // 25 quads * 6 vertices each
+
+	// Turn on the stencil finally 
+	glStencilFunc(GL_EQUAL, render_data.stencil_state, 0xFF);
+
+	// Only bother drawing any other quads if we have more than 25 lines 
+	if (num_lines > LINE_BUDGET_CURSOR_LINES) {
+		glDrawArrays(GL_TRIANGLES, LINE_BUDGET_CURSOR_LINES * 6, (num_lines - LINE_BUDGET_CURSOR_LINES) * 6); // Remaining quads
+	}
+
+	// Object meshes, still stenciled. Every mesh is uploaded once and each
+	// object is just one instance record, one draw per mesh.
+	if (render_data.mesh_lines_version != mesh_lines_version) {
+		// The arena goes up as is, it is already laid out how the shader wants
+		const vector<MeshLine>& mesh_lines = *render_data.mesh_lines;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mesh_lines_buffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, max((size_t)1, mesh_lines.size()) * sizeof(MeshLine), nullptr, GL_STATIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mesh_lines.size() * sizeof(MeshLine), mesh_lines.data());
+		mesh_lines_version = render_data.mesh_lines_version;
+	}
+
+	if (render_data.instance_count > 0) {
+		instanced_line_shader->use();
+		instanced_line_shader->setFloat("aspectRatio", aspect_ratio);
+		instanced_line_shader->setFloat("aspectRatioSmall", aspect_ratio_small);
+		instanced_line_shader->setFloat("thickness", thickness);
+		glUniform2f(glGetUniformLocation(instanced_line_shader->ID, "ndc_scale"), 2.0f / 960.0f, 2.0f / 536.0f);
+
+		line_instances_ring->bind(5, frame);
+
+		glBindVertexArray(instanced_VAO);
+		for (const LineInstanceBatch& batch : render_data.instance_batches) {
+			glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, batch.line_count * 6,
+				batch.instance_count, batch.first_instance);
+		}
+	}
+
+	// Clear the stencil right away 
+	glStencilMask(0xFF);
+	glClear(GL_STENCIL_BUFFER_BIT);
+
+	// Unbind for cleanliness 
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_CULL_FACE); // Re-enable if it was on before
+
+	mark_pass(4);
+
+#pragma endregion
+#pragma region scanline_shader
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	scanline_shader->use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, compositeTex); // Bind the composite texture
+	scanline_shader->setInt("buffer_texture", 0);
+
+	// bind native texture to unit 1
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, nativeTex);
+
+	// linear filtering for "blur"
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	scanline_shader->setInt("native_texture", 1);
+
+	scanline_shader->setFloat("resy", window_height);
+	scanline_shader->setFloat("resx", window_width);
+
+	//scanline_shader->setFloat("dval1", dval1);
+
+	pass_shader->setFloat("aspectRatio", aspect_ratio);
+	pass_shader->setFloat("aspectRatioSmall", aspect_ratio_small);
+
+	glBindVertexArray(VAO);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+	// reset filtering mode
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	mark_pass(5);
+
+#pragma endregion
+
+	// Draw Dear ImGui
+	ImGui::Render();
+	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+	mark_pass(6);
+	pass_queries_issued[frame] = true;
+
+	// Everything reading this frame's slots has been submitted
+	frame_fences->end_frame();
+
+	glfwSwapBuffers(window);
+	glfwPollEvents();
+	return;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+// The real renderer. Opens the window, owns every shader, framebuffer and gpu
+// buffer, and draws whatever the systems rendered into the render targets.
+// This all used to live straight in main.cpp.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "render_backend.h"
+#include "shader.h"
+#include "ring_buffer.h"
+
+#include <memory>
+#include <vector>
+
+// Text raster, composite, stencil, lines, crt, imgui
+#define GL_RENDER_PASS_COUNT 6
+
+class GLRenderBackend : public RenderBackend {
+public:
+	// Opens the window and sets up gl. Throws if either fails.
+	// compact_line_verts sends line vertices up as snorm16, see line_quantize.h
+	GLRenderBackend(bool compact_line_verts = false);
+	~GLRenderBackend();
+
+	bool is_running() override;
+	GlobalUpdateData poll_input() override;
+	RenderTargets begin_frame() override;
+	void end_frame(const RenderData& render_data) override;
+	double get_refresh_rate() override;
+
+	// Timed on the gpu with timestamp queries
+	std::vector<RenderPassTiming> get_pass_timings() override {
+		return pass_timings;
+	}
+
+private:
+	GLFWwindow* window = nullptr;
+
+	// f11 only toggles once per press
+	bool fullscreen_key_down = false;
+	void toggle_fullscreen();
+
+	std::unique_ptr<Shader> raster_shader;
+	std::unique_ptr<Shader> pass_shader;
+	std::unique_ptr<Shader> scanline_shader;
+	std::unique_ptr<Shader> stencil_shader;
+	std::unique_ptr<Shader> line_shader;
+	std::unique_ptr<Shader> instanced_line_shader;
+
+	// Fullscreen quad
+	unsigned int VBO, VAO, EBO;
+
+	// Both line shaders pull everything out of the SSBOs, these are empty
+	unsigned int line_VAO;
+	unsigned int instanced_VAO;
+
+	GLuint nativeFBO;
+	GLuint nativeTex;
+
+	// nativeTex has been rastered at least once, after that it only gets
+	// redrawn where the char grid changed
+	bool native_valid = false;
+	GLuint compositeFBO;
+
+	const float* stencil_regions;
+	int region_count;
+	unsigned int stencil_regions_buffer;
+
+	unsigned int mesh_lines_buffer;
+	uint32_t mesh_lines_version;
+
+	// Line palette, same idea as the mesh lines
+	unsigned int palette_buffer;
+	uint32_t palette_version;
+
+	// Per frame render targets, see ring_buffer.h
+	int NUM_CHARS;
+	std::unique_ptr<PersistentRingBuffer> char_grid_ring;
+	std::unique_ptr<PersistentRingBuffer> line_verts_ring;
+	std::unique_ptr<PersistentRingBuffer> line_materials_ring;
+	std::unique_ptr<PersistentRingBuffer> line_instances_ring;
+	std::unique_ptr<FrameFences> frame_fences;
+
+	// Ring slot being written this frame
+	int frame = 0;
+
+	// Systems still render float lines, with compact line verts they go here
+	// and get quantized into line_verts_ring at the end of the frame
+	bool compact_line_verts;
+	std::vector<float> line_verts_staging;
+
+	// Gpu timestamps before and after every pass, one set per ring slot. A
+	// slot's results only get read when we come back around to it, its fence
+	// has been waited on by then so they are already there.
+	unsigned int pass_queries[RING_BUFFER_FRAMES][GL_RENDER_PASS_COUNT + 1];
+	bool pass_queries_issued[RING_BUFFER_FRAMES] = {};
+	std::vector<RenderPassTiming> pass_timings;
+	void mark_pass(int pass);
+	void read_pass_timings();
+};
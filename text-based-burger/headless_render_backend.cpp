@@ -0,0 +1,43 @@
+#include "headless_render_backend.h"
+
+using namespace std;
+
+HeadlessRenderBackend::HeadlessRenderBackend() {
+	// Same sizes as the gl backend so anything that overflows there overflows
+	// here too
+	char_grid.resize(CHAR_GRID_SIZE, 0);
+	line_verts.resize(MAX_LINES * 4, 0.0f);
+	line_materials.resize(MAX_LINES, 0);
+	line_instances.resize(MAX_LINE_INSTANCES);
+}
+
+bool HeadlessRenderBackend::is_running() {
+	return true;
+}
+
+GlobalUpdateData HeadlessRenderBackend::poll_input() {
+	GlobalUpdateData global_update_data;
+
+	// Mouse just sits in the middle of the screen
+	global_update_data.mouse_pos_native = vec2(480.0f, 268.0f);
+	global_update_data.mouse_pos_char = vec2(60.0f, 16.0f);
+	global_update_data.scroll_delta = vec2();
+	global_update_data.time = frames * HEADLESS_FRAME_TIME;
+
+	return global_update_data;
+}
+
+RenderTargets HeadlessRenderBackend::begin_frame() {
+	return RenderTargets{
+		char_grid.data(),
+		line_verts.data(),
+		line_materials.data(),
+		line_instances.data()
+	};
+}
+
+void HeadlessRenderBackend::end_frame(const RenderData& /*render_data*/) {
+	// Nothing to show, just move the clock on
+	frames++;
+	return;
+}
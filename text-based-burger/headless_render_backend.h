@@ -0,0 +1,35 @@
+#pragma once
+
+// Render backend with no window and no gpu. The render targets are plain cpu
+// arrays that get thrown away at the end of every frame, so the whole engine
+// still runs (simulation, scripts, every system's render pass) but nothing is
+// drawn. Time advances by a fixed step per frame instead of the clock so runs
+// are repeatable, and there is never any input.
+
+#include "render_backend.h"
+
+#include <vector>
+#include <cstdint>
+
+// 60 fps worth of game time per frame
+#define HEADLESS_FRAME_TIME (1.0 / 60.0)
+
+class HeadlessRenderBackend : public RenderBackend {
+public:
+	HeadlessRenderBackend();
+
+	// Never closes by itself, the main loop stops it after --frames
+	bool is_running() override;
+	GlobalUpdateData poll_input() override;
+	RenderTargets begin_frame() override;
+	void end_frame(const RenderData& render_data) override;
+
+protected:
+	std::vector<uint32_t> char_grid;
+	std::vector<float> line_verts;
+	std::vector<LineMaterial> line_materials;
+	std::vector<LineInstance> line_instances;
+
+	// Frames drawn so far, this is the clock
+	uint64_t frames = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+// Snapshot of the keyboard and mouse for one frame. The render backend fills
+// this in once at the start of the frame and everything else reads it from
+// here instead of asking glfw, so nothing outside the backend needs a window.
+// Headless runs just leave everything up.
+
+#include <bitset>
+
+// Only the keys something actually reads. Add new ones before
+// INPUT_KEY_COUNT and to the glfw table in gl_render_backend.cpp.
+enum InputKey {
+	INPUT_KEY_W,
+	INPUT_KEY_A,
+	INPUT_KEY_S,
+	INPUT_KEY_D,
+	INPUT_KEY_B,
+	INPUT_KEY_Y,
+	INPUT_KEY_Z,
+	INPUT_KEY_DELETE,
+	INPUT_KEY_LEFT_SHIFT,
+	INPUT_KEY_LEFT_CONTROL,
+	INPUT_KEY_RIGHT_CONTROL,
+	INPUT_KEY_F6,
+	INPUT_KEY_F11,
+
+	INPUT_KEY_COUNT
+};
+
+struct InputState {
+	std::bitset<INPUT_KEY_COUNT> keys;
+	bool mouse_left = false;
+
+	bool is_down(InputKey key) const {
+		return keys[key];
+	}
+
+	// Either control key
+	bool ctrl_down() const {
+		return keys[INPUT_KEY_LEFT_CONTROL] || keys[INPUT_KEY_RIGHT_CONTROL];
+	}
+};
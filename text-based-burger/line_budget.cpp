@@ -0,0 +1,64 @@
+#include "line_budget.h"
+
+#include <algorithm>
+
+using namespace std;
+
+LineBudget::LineBudget(int budget) {
+	set_budget(budget);
+	begin_frame();
+}
+
+void LineBudget::set_budget(int lines) {
+	// Always room for the cursor
+	budget = clamp(lines, LINE_BUDGET_CURSOR_LINES, LINE_BUDGET_DEFAULT);
+	return;
+}
+
+void LineBudget::begin_frame() {
+	remaining = budget;
+	for (int i = 0; i < LINE_PRIORITY_COUNT; i++) {
+		wanted[i] = 0;
+		granted[i] = 0;
+		pending[i] = 0;
+	}
+	return;
+}
+
+bool LineBudget::take(LinePriority priority, int lines) {
+	wanted[priority] += lines;
+	if (lines > remaining) {
+		return false;
+	}
+
+	granted[priority] += lines;
+	remaining -= lines;
+	return true;
+}
+
+void LineBudget::want(LinePriority priority, int lines) {
+	wanted[priority] += lines;
+	pending[priority] += lines;
+	return;
+}
+
+void LineBudget::allocate() {
+	for (int i = 0; i < LINE_PRIORITY_COUNT; i++) {
+		int lines = min(pending[i], remaining);
+		granted[i] += lines;
+		remaining -= lines;
+		pending[i] = 0;
+	}
+	return;
+}
+
+const char* LineBudget::get_priority_name(LinePriority priority) {
+	switch (priority) {
+	case LINE_PRIORITY_CURSOR: return "cursor";
+	case LINE_PRIORITY_OBJECTS: return "objects";
+	case LINE_PRIORITY_WALLS: return "walls";
+	case LINE_PRIORITY_COSMETIC: return "cosmetic";
+	case LINE_PRIORITY_PARALLAX: return "parallax";
+	default: return "unknown";
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+// Per frame line budget. Every system that emits lines used to just append
+// to the lines list until it ran out, so a busy scene meant a long frame (or
+// writing off the end). Now every line belongs to a priority class and when a
+// frame wants more lines than the budget the lowest classes lose out first.
+//
+// There are two ways to get lines:
+// - take() is all or nothing, for things that cant be cut up like the cursor
+//   or one object. It comes straight out of whatever is left.
+// - want() then allocate() is for things that know up front how many lines
+//   they would draw (map walls, parallax). allocate() funds them highest
+//   priority first, and a class that only partly fits gets decimated evenly
+//   with keep() instead of losing its tail.
+// The systems controller calls these in priority order so take()s for high
+// classes always happen before the rest gets allocated.
+
+#include <cstdint>
+
+// Lines at the very start of the lines list that only the cursor uses. These
+// are never stenciled.
+#define LINE_BUDGET_CURSOR_LINES 25
+
+// Default budget, also the most it can be set to. One custom object can go
+// over before it gets rolled back, so leave room for that before MAX_LINES.
+#define LINE_BUDGET_DEFAULT 9000
+#define LINE_BUDGET_OBJECT_HEADROOM 1000
+
+// Highest priority first
+enum LinePriority {
+	LINE_PRIORITY_CURSOR,
+	LINE_PRIORITY_OBJECTS,
+	LINE_PRIORITY_WALLS, // map lines with collision
+	LINE_PRIORITY_COSMETIC, // map lines without collision, debug overlays
+	LINE_PRIORITY_PARALLAX, // the raised copies of map lines
+	LINE_PRIORITY_COUNT
+};
+
+class LineBudget {
+public:
+	LineBudget(int budget = LINE_BUDGET_DEFAULT);
+
+	// Can only go down from the default, anything else is clamped
+	void set_budget(int lines);
+	int get_budget() const {
+		return budget;
+	}
+
+	// Forget last frame
+	void begin_frame();
+
+	// All or nothing. False means there wasnt room and the lines were shed.
+	bool take(LinePriority priority, int lines);
+
+	// How many lines a class would draw with no budget
+	void want(LinePriority priority, int lines);
+
+	// Hand out whatever is left to everything that wanted lines, highest
+	// priority first
+	void allocate();
+
+	// Should the index'th line this class wanted be drawn. Exactly as many
+	// lines as the class was given get kept, spread out over all of them.
+	bool keep(LinePriority priority, int index) const {
+		if (index >= wanted[priority]) {
+			return false; // More than was asked for
+		}
+		int64_t w = wanted[priority];
+		int64_t g = granted[priority];
+		return ((index + 1) * g) / w > (index * g) / w;
+	}
+
+	// Counters for this frame
+	int get_wanted(LinePriority priority) const {
+		return wanted[priority];
+	}
+	int get_drawn(LinePriority priority) const {
+		return granted[priority];
+	}
+	int get_shed(LinePriority priority) const {
+		return wanted[priority] - granted[priority];
+	}
+
+	static const char* get_priority_name(LinePriority priority);
+
+private:
+	int budget;
+
+	// Lines not taken or allocated yet this frame
+	int remaining;
+
+	int wanted[LINE_PRIORITY_COUNT];
+	int granted[LINE_PRIORITY_COUNT];
+
+	// want()ed but not allocated yet
+	int pending[LINE_PRIORITY_COUNT];
+};
@@ -1,5 +1,4 @@
 #include <cstdint>
-#include <unordered_map>
 
 #ifndef LINE_COLOR_GEN_HPP
 #define LINE_COLOR_GEN_HPP
@@ -11,8 +10,15 @@
 // bits 24-31: line width, note that this is the only paramater that is not treated as 0-1 but as a raw value.
 // Width of 0 means default width, 1-127 is more thick, 128-255 is less thick.
 
+// Lines dont carry these around though. Every color a line can have lives in
+// the line palette (see line_palette.h) and lines only carry a 16 bit index
+// into it, a material. Presets are always the first entries of the palette so
+// the material of a preset is just the preset.
+typedef uint16_t LineMaterial;
+
 // Line type presets you can use
 enum LineTypePreset {
+	LINE_COLOR_PRESET_NONE, // Nothing, 0 alpha. Zeroed lines end up this.
 	LINE_COLOR_PRESET_CURSOR, // Mouse cursor lines
 	LINE_COLOR_PRESET_NPC_FRIENDLY,
 	LINE_COLOR_PRESET_NPC_FRIENDLY_SELECTED,
@@ -20,28 +26,35 @@ enum LineTypePreset {
 	LINE_COLOR_PRESET_WALL_GENERIC,
 	LINE_COLOR_PRESET_WALL_SECONDARY,
 	LINE_COLOR_PRESET_EDITOR_LINE,
-	LINE_COLOR_PRESET_EDITOR_SELECTED
+	LINE_COLOR_PRESET_EDITOR_SELECTED,
+	LINE_COLOR_PRESET_COUNT
 };
 
-// Lookup table for presets - more efficient than switch statement
-static const std::unordered_map<LineTypePreset, uint32_t> preset_colors = {
-	{LINE_COLOR_PRESET_CURSOR,              64 | (0 << 8) | (255 << 16)}, // 255 hue, 127 intensity, 255 alpha
+// Preset colors, in the same order as the enum
+constexpr uint32_t preset_colors[LINE_COLOR_PRESET_COUNT] = {
+	0, // LINE_COLOR_PRESET_NONE
+
+	64 | (0 << 8) | (255 << 16), // LINE_COLOR_PRESET_CURSOR: 255 hue, 127 intensity, 255 alpha
 
-	{LINE_COLOR_PRESET_NPC_FRIENDLY,        0x00FF7FFF}, // 255 hue, 127 intensity, 255 alpha
-	{LINE_COLOR_PRESET_NPC_FRIENDLY_SELECTED, 0x00FFFFFF}, // 255 hue, 255 intensity, 255 alpha
-	{LINE_COLOR_PRESET_NPC_ENEMY,           0x00FF7FFF}, // 255 hue, 127 intensity, 255 alpha
+	0x00FF7FFF, // LINE_COLOR_PRESET_NPC_FRIENDLY: 255 hue, 127 intensity, 255 alpha
+	0x00FFFFFF, // LINE_COLOR_PRESET_NPC_FRIENDLY_SELECTED: 255 hue, 255 intensity, 255 alpha
+	0x00FF7FFF, // LINE_COLOR_PRESET_NPC_ENEMY: 255 hue, 127 intensity, 255 alpha
 
-	{LINE_COLOR_PRESET_WALL_GENERIC,        191 | (191 << 8) | (255 << 16)}, // 191 hue, 191 intensity, 255 alpha
-	{LINE_COLOR_PRESET_WALL_SECONDARY,      191 | (191 << 8) | (127 << 16) | ((127 + int(0.5 * 127.0)) << 24)}, // 191 hue, 191 intensity, 127 alpha, -0.5 width
+	191 | (191 << 8) | (255 << 16), // LINE_COLOR_PRESET_WALL_GENERIC: 191 hue, 191 intensity, 255 alpha
+	191 | (191 << 8) | (127 << 16) | ((uint32_t)(127 + int(0.5 * 127.0)) << 24), // LINE_COLOR_PRESET_WALL_SECONDARY: 191 hue, 191 intensity, 127 alpha, -0.5 width
 
-	{LINE_COLOR_PRESET_EDITOR_LINE,         191 | (191 << 8) | (255 << 16)}, // 191 hue, 191 intensity, 255 alpha - same as wall generic
-	{LINE_COLOR_PRESET_EDITOR_SELECTED,     191 | (255 << 8) | (255 << 16) | (5 << 24)} // 191 hue, 255 intensity, 255 alpha, thicker
+	191 | (191 << 8) | (255 << 16), // LINE_COLOR_PRESET_EDITOR_LINE: 191 hue, 191 intensity, 255 alpha - same as wall generic
+	191 | (255 << 8) | (255 << 16) | (5 << 24) // LINE_COLOR_PRESET_EDITOR_SELECTED: 191 hue, 255 intensity, 255 alpha, thicker
 };
 
 // First 8 bits are hue, next are intensity, next are alpha. 8 unused.
-inline uint32_t generate_line_color(LineTypePreset preset) {
-	auto it = preset_colors.find(preset);
-	return (it != preset_colors.end()) ? it->second : 255 << 16;
+constexpr uint32_t generate_line_color(LineTypePreset preset) {
+	return preset_colors[preset];
+}
+
+// What a line using a preset should carry
+constexpr LineMaterial preset_material(LineTypePreset preset) {
+	return (LineMaterial)preset;
 }
 
 // Generate color from given colors. Colors should be 0-1 range.
@@ -0,0 +1,54 @@
+#include "line_palette.h"
+
+#include <iostream>
+
+using namespace std;
+
+LinePalette::LinePalette() {
+	reset();
+}
+
+void LinePalette::reset() {
+	colors.clear();
+	materials.clear();
+	full_reported = false;
+
+	// The backend has to notice the palette changed even if it is the same
+	// size as before
+	version++;
+
+	for (int i = 0; i < LINE_COLOR_PRESET_COUNT; i++) {
+		colors.push_back(preset_colors[i]);
+
+		// Presets can share a color, the first one wins
+		materials.emplace(preset_colors[i], (LineMaterial)i);
+	}
+
+	return;
+}
+
+LineMaterial LinePalette::intern(uint32_t color) {
+	auto it = materials.find(color);
+	if (it != materials.end()) {
+		return it->second;
+	}
+
+	if (colors.size() >= LINE_PALETTE_SIZE) {
+		if (!full_reported) {
+			cout << "Line palette is full, new colors fall back to the wall color" << endl;
+			full_reported = true;
+		}
+		return preset_material(LINE_COLOR_PRESET_WALL_GENERIC);
+	}
+
+	LineMaterial material = (LineMaterial)colors.size();
+	colors.push_back(color);
+	materials.emplace(color, material);
+	version++;
+	return material;
+}
+
+LinePalette& get_line_palette() {
+	static LinePalette palette;
+	return palette;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// The line palette, every color any line is drawn with. Lines only carry a 16
+// bit material index into this, the palette itself goes up to the gpu once and
+// then again only when something new gets added to it. That keeps the per line
+// data small and means emitting a line never has to build or look up a color.
+//
+// Colors get turned into materials when they are loaded or edited (object
+// json, the line canvas), never while rendering. Presets from
+// line_color_gen.hpp are always the first entries, see preset_material.
+//
+// Nothing is ever taken out on its own, every color any object or editor
+// stroke ever had stays until the map unloads and the whole palette is reset.
+
+#include "line_color_gen.hpp"
+
+#include <unordered_dense.h>
+
+#include <vector>
+#include <cstdint>
+
+// Materials are 16 bit
+#define LINE_PALETTE_SIZE 65536
+
+class LinePalette {
+public:
+	// Starts out with just the presets
+	LinePalette();
+
+	// Material for a packed color, adds it if it is new. Main thread only, same
+	// as loading objects. If the palette is full this gives back
+	// LINE_COLOR_PRESET_WALL_GENERIC.
+	LineMaterial intern(uint32_t color);
+
+	// Back to just the presets. Every material handed out before is invalid
+	// after this, only call it once everything holding one is gone.
+	void reset();
+
+	uint32_t get_color(LineMaterial material) const {
+		return colors[material];
+	}
+
+	// Everything in the palette, index is the material
+	const std::vector<uint32_t>& get_colors() const {
+		return colors;
+	}
+
+	// Goes up whenever something is added so the backend knows to upload again
+	uint32_t get_version() const {
+		return version;
+	}
+
+private:
+	std::vector<uint32_t> colors;
+	ankerl::unordered_dense::map<uint32_t, LineMaterial> materials;
+	uint32_t version = 1;
+	bool full_reported = false;
+};
+
+// There is only ever one palette
+LinePalette& get_line_palette();
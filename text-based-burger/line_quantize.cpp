@@ -0,0 +1,113 @@
+#include "line_quantize.h"
+
+#include <cmath>
+#include <algorithm>
+
+// SSE2 is always there on x64, and on x86 if the compiler is allowed to use it.
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LINE_QUANTIZE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Clip a line to the -1 to 1 box (liang barsky). False if none of it is inside.
+static bool clip_to_unit(float& ax, float& ay, float& bx, float& by) {
+	float dx = bx - ax;
+	float dy = by - ay;
+	float p[4] = { -dx, dx, -dy, dy };
+	float q[4] = { ax + 1.0f, 1.0f - ax, ay + 1.0f, 1.0f - ay };
+
+	float t0 = 0.0f;
+	float t1 = 1.0f;
+	for (int i = 0; i < 4; i++) {
+		if (p[i] == 0.0f) {
+			if (q[i] < 0.0f) {
+				return false; // Parallel to this edge and outside it
+			}
+			continue;
+		}
+
+		float t = q[i] / p[i];
+		if (p[i] < 0.0f) {
+			t0 = max(t0, t);
+		}
+		else {
+			t1 = min(t1, t);
+		}
+		if (t0 > t1) {
+			return false;
+		}
+	}
+
+	float start_x = ax;
+	float start_y = ay;
+	ax = start_x + t0 * dx;
+	ay = start_y + t0 * dy;
+	bx = start_x + t1 * dx;
+	by = start_y + t1 * dy;
+	return true;
+}
+
+static uint32_t pack_vertex(float x, float y) {
+	// Same rounding as _mm_cvtps_epi32, clamped in case clipping landed a hair
+	// outside
+	int16_t qx = (int16_t)lrintf(clamp(x, -1.0f, 1.0f) * 32767.0f);
+	int16_t qy = (int16_t)lrintf(clamp(y, -1.0f, 1.0f) * 32767.0f);
+	return (uint16_t)qx | ((uint32_t)(uint16_t)qy << 16);
+}
+
+static void quantize_line(const float* verts, uint32_t* out) {
+	const float scale = 1.0f / LINE_QUANTIZE_RANGE;
+	float ax = verts[0] * scale;
+	float ay = verts[1] * scale;
+	float bx = verts[2] * scale;
+	float by = verts[3] * scale;
+
+	bool inside = fabsf(ax) <= 1.0f && fabsf(ay) <= 1.0f && fabsf(bx) <= 1.0f && fabsf(by) <= 1.0f;
+	if (!inside && !clip_to_unit(ax, ay, bx, by)) {
+		// Nothing left to draw, a zero length line collapses to nothing
+		out[0] = 0;
+		out[1] = 0;
+		return;
+	}
+
+	out[0] = pack_vertex(ax, ay);
+	out[1] = pack_vertex(bx, by);
+	return;
+}
+
+void quantize_line_verts(const float* verts, uint32_t* out, int num_lines) {
+	int i = 0;
+
+#ifdef LINE_QUANTIZE_SSE2
+	// Two lines at a time, 8 floats in and 8 int16s out. packs saturates but
+	// anything that would saturate goes the slow way so it gets clipped.
+	const __m128 scale = _mm_set1_ps(32767.0f / LINE_QUANTIZE_RANGE);
+	const __m128 limit = _mm_set1_ps(32767.0f);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	for (; i + 2 <= num_lines; i += 2) {
+		__m128 first = _mm_mul_ps(_mm_loadu_ps(verts + i * 4), scale);
+		__m128 second = _mm_mul_ps(_mm_loadu_ps(verts + i * 4 + 4), scale);
+
+		__m128 outside = _mm_or_ps(
+			_mm_cmpgt_ps(_mm_and_ps(first, abs_mask), limit),
+			_mm_cmpgt_ps(_mm_and_ps(second, abs_mask), limit));
+		if (_mm_movemask_ps(outside) != 0) {
+			quantize_line(verts + i * 4, out + i * 2);
+			quantize_line(verts + i * 4 + 4, out + i * 2 + 2);
+			continue;
+		}
+
+		__m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(first), _mm_cvtps_epi32(second));
+		_mm_storeu_si128((__m128i*)(out + i * 2), packed);
+	}
+#endif
+
+	for (; i < num_lines; i++) {
+		quantize_line(verts + i * 4, out + i * 2);
+	}
+
+	return;
+}
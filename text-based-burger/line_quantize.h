@@ -0,0 +1,29 @@
+#pragma once
+
+// Compact line vertices. Normally every line is 4 floats (16 bytes) of NDC in
+// the lines list, with this every coordinate goes up as a snorm16 instead so a
+// line is 8 bytes. vertex_lines.glsl unpacks them with unpackSnorm2x16, one
+// uint per vertex.
+//
+// snorm16 only covers -1 to 1 and lines are allowed to hang off the screen
+// (the map clips with a margin, objects dont clip at all), so coordinates get
+// divided by LINE_QUANTIZE_RANGE first. Lines that still go past that get
+// clipped to it so they keep their direction instead of getting squashed.
+//
+// How far off a vertex can end up:
+// - one snorm16 step is LINE_QUANTIZE_RANGE / 32767 = 6.1e-5 NDC, and
+//   rounding is at most half a step, 3.05e-5 NDC
+// - native res is 960x536 so 1 NDC is 480 pixels across and 268 pixels up
+// - worst case is 0.0146 pixels across and 0.0082 pixels up, one step is
+//   0.029 pixels. Even scaled up to a 4k window the worst case is 0.06 pixels
+//   so nothing moves by a visible amount, and the beam glow is several pixels
+//   wide anyway.
+
+#include <cstdint>
+
+// Coordinates from -2 to 2 NDC fit, which is a whole screen off every edge
+#define LINE_QUANTIZE_RANGE 2.0f
+
+// Pack num_lines lines from verts (4 floats each, x y x y) into out (2 uints
+// each, x in the low 16 bits and y in the high 16 bits of every vertex)
+void quantize_line_verts(const float* verts, uint32_t* out, int num_lines);
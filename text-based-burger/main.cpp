@@ -1,769 +1,288 @@
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#include <glm/glm.hpp>
-
-#include <imgui/imgui.h>
-#include <imgui/imgui_impl_glfw.h>
-#include <imgui/imgui_impl_opengl3.h>
-
 #include <iostream>
-
-#include "shader.h"
-#include "font_loader.h"
+#include <chrono>
+#include <string>
+#include <cstdlib>
 
 #include "systems_controller.h"
+#include "gl_render_backend.h"
+#include "headless_render_backend.h"
+#include "software_render_backend.h"
+#include "frame_limiter.h"
+#include "render_capture.h"
+#include "object_benchmark.h"
+#include "map_utils.h"
 
 using namespace std;
 
-// These are not constants 
-int window_width = 1300;
-int window_height = 720;
-
-// Character dimensions
-int CHAR_WIDTH = 8;
-int CHAR_HEIGHT = 16;
-int CHAR_RATIO = CHAR_HEIGHT / CHAR_WIDTH;
-
-// Character columns on screen
-int CHAR_COLS = 120;
-int CHAR_ROWS = 68;
-
-// 960 * 544
-int SMALL_WINDOW_WIDTH = CHAR_WIDTH * CHAR_COLS;
-int SMALL_WINDOW_HEIGHT = (CHAR_ROWS * CHAR_HEIGHT) / CHAR_RATIO;
-
-// Mouse position in character space
-int mouse_char_x = 0;
-int mouse_char_y = 0;
-
-float scroll_x = 0.0f, scroll_y = 0.0f;
-
-float native_x, native_y = 0;
-
-const char* WINDOW_TITLE = "Text based burger";
-
-float aspect_ratio = (float)window_width / (float)window_height;
-float aspect_ratio_small = (float)SMALL_WINDOW_HEIGHT / (float)SMALL_WINDOW_WIDTH;
-
 unique_ptr<SystemsController> systems_controller;
 
-double last_time = 0;
-double frame_time = 0;
-
-float dval1 = 10.0f;
-float dval2 = 0.0f;
-
-//GLuint fullTex;
-GLuint compositeTex;
-GLuint depthStencilRBO;
-//GLuint blurTex;
-
-void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-	glViewport(0, 0, width, height);
-
-	window_width = width;
-	window_height = height;
-
-	aspect_ratio = (float)window_width / (float)window_height;
-
-	// Resize fbos that are not the native one
-	/*glBindTexture(GL_TEXTURE_2D, fullTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glBindTexture(GL_TEXTURE_2D, 0);*/
-
-	glBindTexture(GL_TEXTURE_2D, compositeTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	// Resize depth-stencil renderbuffer
-	glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
-	glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-	/*glBindTexture(GL_TEXTURE_2D, blurTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-	glBindTexture(GL_TEXTURE_2D, 0);*/
-}
-
-void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-	scroll_x += (float)xoffset;
-	scroll_y += (float)yoffset;
-}
-
-void processInput(GLFWwindow* window) {
-	// Mouse position
-	double xpos, ypos;
-	glfwGetCursorPos(window, &xpos, &ypos);
-
-	// Convert from window space to native space
-	float scale = (float)window_height / 536.0; // more hard coded numbers oh yeah
-	int offset_x = (window_width - 960.0 * scale) / 2.0;
+// Arguments:
+// --headless    run without a window or gpu, see headless_render_backend.h
+// --software    like headless but draw every frame on the cpu, see
+//               software_render_backend.h
+// --dump dir    software render and write every frame into dir as a ppm
+// --frames N    stop after N frames and print how long they took
+// --map name    load this map straight away instead of starting in the menu
+// --fps N       cap the frame rate, 0 for no cap. --fps display caps it at the
+//               display refresh rate, which is the default with a window.
+// --idle-fps N  frame rate to drop to when nothing is happening, 0 to never
+//               drop. Defaults to FRAME_LIMITER_DEFAULT_IDLE_FPS with a window.
+// --line-budget N  most lines a frame can draw, lower priority lines get shed
+//                  past that. Can only go below LINE_BUDGET_DEFAULT.
+// --compact-lines  send line vertices to the gpu as snorm16 instead of floats,
+//                  half the size. See line_quantize.h.
+// --capture file   write every frame's render inputs to file, see
+//                  render_capture.h
+// --replay file    draw a capture with whichever backend as fast as it goes
+//                  and print per pass timings, no game runs at all
+// --bench-update N time updating N objects of mixed types with and without
+//                  the per type batches, see object_benchmark.h. Use with
+//                  --headless, --frames sets how many frames.
+// --check-clip N   check the batch segment clipper against the reference on
+//                  N random segments and exit, nonzero if they disagree. See
+//                  check_clip_segments_aabb_x4 in map_utils.h.
+
+// Nothing happened this frame, no input, no text changed and the objects did
+// nothing. Whatever is on screen is not looked at, a map full of sleeping
+// objects is still idle.
+static bool frame_is_idle(const GlobalUpdateData& update, const GlobalUpdateData& last_update,
+	const RenderData& render_data, bool objects_active) {
+
+	if (update.input.keys != last_update.input.keys || update.input.mouse_left != last_update.input.mouse_left) {
+		return false;
+	}
+	// scroll_delta is really how far it has scrolled in total, so it only
+	// moved if it differs from last frame
+	if (!(update.mouse_pos_native == last_update.mouse_pos_native) || !(update.scroll_delta == last_update.scroll_delta)) {
+		return false;
+	}
 
-	native_x = (xpos - offset_x) / scale;
-	native_y = (ypos - 0)        / scale;
+	// Text changed
+	if (render_data.char_rows_dirty_from < render_data.char_rows_dirty_to) {
+		return false;
+	}
 
-	// i have no idea why this is needed but without it the cursor position desynchs with the character grid
-	// by half a character at the bottom of the screen why ???????????
-	float shader_scale = 1.01f + (1.0f / ((float)CHAR_ROWS) / (float)CHAR_RATIO);
+	// Recorded commands or woke something up
+	if (objects_active) {
+		return false;
+	}
 
-	// Convert to character space
-	mouse_char_x = (int)(native_x / CHAR_WIDTH);
-	mouse_char_y = (int)((native_y * shader_scale) / (CHAR_HEIGHT)); // shader offset
+	return true;
 }
 
-void draw_imgui() {
-	// Start the Dear ImGui frame
-	ImGui_ImplOpenGL3_NewFrame();
-	ImGui_ImplGlfw_NewFrame();
-	
-	ImGui::NewFrame();
-
-	// Because imgui hijacks things thanks imgui
-	ImGui::SetMouseCursor(ImGuiMouseCursor_None);
-	
-	// return here to not draw imgui
-	return;
-
-	ImGui::SliderFloat("dval1", &dval1, 0.5f, 10.0f);
-	ImGui::SliderFloat("dval2", &dval2, 0.0f, 255.0f);
-	
-	return;
-}
+int main(int argc, char** argv) {
+	bool headless = false;
+	bool software = false;
+	string dump_directory;
+	long long max_frames = -1;
+	string start_map;
+
+	// -1 is not set, picked once we know which backend
+	double fps = -1.0;
+	double idle_fps = -1.0;
+	bool fps_display = false;
+	int line_budget = -1;
+	bool compact_lines = false;
+	string capture_path;
+	string replay_path;
+	long long bench_update_objects = -1;
+	int check_clip_segments = -1;
+
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "--headless") {
+			headless = true;
+		}
+		else if (arg == "--software") {
+			software = true;
+		}
+		else if (arg == "--dump" && i + 1 < argc) {
+			software = true;
+			dump_directory = argv[++i];
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			max_frames = atoll(argv[++i]);
+		}
+		else if (arg == "--map" && i + 1 < argc) {
+			start_map = argv[++i];
+		}
+		else if (arg == "--fps" && i + 1 < argc) {
+			string value = argv[++i];
+			if (value == "display") {
+				fps_display = true;
+			}
+			else {
+				fps = atof(value.c_str());
+			}
+		}
+		else if (arg == "--idle-fps" && i + 1 < argc) {
+			idle_fps = atof(argv[++i]);
+		}
+		else if (arg == "--line-budget" && i + 1 < argc) {
+			line_budget = atoi(argv[++i]);
+		}
+		else if (arg == "--compact-lines") {
+			compact_lines = true;
+		}
+		else if (arg == "--capture" && i + 1 < argc) {
+			capture_path = argv[++i];
+		}
+		else if (arg == "--replay" && i + 1 < argc) {
+			replay_path = argv[++i];
+		}
+		else if (arg == "--bench-update" && i + 1 < argc) {
+			bench_update_objects = atoll(argv[++i]);
+		}
+		else if (arg == "--check-clip" && i + 1 < argc) {
+			check_clip_segments = atoi(argv[++i]);
+		}
+		else {
+			cout << "Unknown argument " << arg << endl;
+			return -1;
+		}
+	}
 
-void set_uniforms() {
-	// Set uniforms here
-}
+	// Doesnt need a backend or any systems
+	if (check_clip_segments >= 0) {
+		return check_clip_segments_aabb_x4(check_clip_segments) ? 0 : 1;
+	}
 
-// Create a window for 2d rendering
-
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	// No depth buffer only stencil if you crash you are probably on iphone 4
-	glfwWindowHint(GLFW_STENCIL_BITS, 8);
-
-	GLFWwindow* window = glfwCreateWindow(window_width, window_height, WINDOW_TITLE, NULL, NULL);
-    if (window == NULL)
-    {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
-	glfwSwapInterval(0); // Disable vsync
-
-	glfwSetScrollCallback(window, scroll_callback);
-
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
-	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
+	unique_ptr<RenderBackend> backend;
+	try {
+		if (software) {
+			backend = make_unique<SoftwareRenderBackend>(dump_directory);
+		}
+		else if (headless) {
+			backend = make_unique<HeadlessRenderBackend>();
+		}
+		else {
+			backend = make_unique<GLRenderBackend>(compact_lines);
+		}
+	}
+	catch (const exception& e) {
+		cout << e.what() << endl;
 		return -1;
 	}
 
-	// Setup Dear ImGui context
-	IMGUI_CHECKVERSION();
-	ImGui::CreateContext();
-	ImGuiIO& io = ImGui::GetIO();
-	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
-
-	// Setup Platform/Renderer backends
-	ImGui_ImplGlfw_InitForOpenGL(window, true);          // Second param install_callback=true will install GLFW callbacks and chain to existing ones.
-	ImGui_ImplOpenGL3_Init();
-
-	glViewport(0, 0, window_width, window_height);
-
-	// Name            || Samples from   || Writes to    || Purpose
-	// 
-	// raster_shader   || ---			 || nativeFBO    || Render text to native size
-	// pass_shader     || nativeFBO      || fullFBO      || Upscale text to full screen size
-	// scanline_shader || fullFBO        || compositeFBO || Draw raster glow to composite FBO 
-	// stencil_shader  || ---            || compositeFBO || Draw stencil for lines
-	// line_shader     || ---		     || compositeFBO || Draw vector lines
-
-	// the scanline shader could be done in the pass shader, but both 
-
-	// Compile shaders
-	Shader raster_shader   = Shader("vertex.glsl", "fragment.glsl",				std::vector<std::string>(), 460);
-	Shader pass_shader     = Shader("vertex.glsl", "fragment_pass.glsl",		std::vector<std::string>(), 460);
-	Shader scanline_shader = Shader("vertex.glsl", "fragment_scanline.glsl",	std::vector<std::string>(), 460);
-	Shader stencil_shader  = Shader("vertex.glsl", "fragment_stencil.glsl",		std::vector<std::string>(), 460);
-	Shader line_shader     = Shader("vertex_lines.glsl", "fragment_lines.glsl",	std::vector<std::string>(), 460);
-	//Shader blur_shader     = Shader("vertex.glsl", "fragment_blur.glsl",        std::vector<std::string>(), 460);
-	//Shader crt_shader      = Shader("vertex.glsl", "fragment_crt.glsl",         std::vector<std::string>(), 460);
-
-#pragma region General loading
-
-	// Load font, this had to be done first and on the main thread
-	vector<uint32_t> font_data = load_font("gamedata\\fonts\\font.txt"); // Enter your font path here
-
-	// Bind the main shader and set uniform
-	raster_shader.use();
-
-	// Uniform array of uint32_t
-	uint32_t* font_data_array = new uint32_t[1024];
-
-	// Copy font data to the array
-	for (int i = 0; i < font_data.size(); i++) {
-		font_data_array[i] = font_data[i];
+	if (!replay_path.empty()) {
+		int result = replay_render_capture(*backend, replay_path, max_frames);
+		backend.reset();
+		return result;
 	}
 
-	// Set the uniform
-	glUniform4uiv(glGetUniformLocation(raster_shader.ID, "glyphs"), 256, font_data_array);
-
-	// Internal render targets
-	int NUM_CHARS = CHAR_COLS * CHAR_ROWS;
-	uint32_t* char_grid = new uint32_t[NUM_CHARS];
-
-	// How many lines do you think youll want to ever draw:
-	int MAX_LINES = 10000;
-	float* line_verts = new float[MAX_LINES * 4 * 2]; // 4 vertices per line, 2 floats per vertex
-	uint32_t* line_colors = new uint32_t[MAX_LINES]; // 1 color per line
-
-	systems_controller = make_unique<SystemsController>(
-		RenderTargets{
-			char_grid,
-			line_verts,
-			line_colors
-		},
-		"gamedata\\ui\\gameplay_ui.json"
-	);
-
-#pragma endregion
-#pragma region Vertex Buffers
-
-	// Vertex is simple we only render a screen quad
-
-	// Full-screen quad vertices and indices
-	float vertices[] = {
-		// Positions   // Texture Coords
-		-1.0f, -1.0f,  0.0f, 0.0f,
-		 1.0f, -1.0f,  1.0f, 0.0f,
-		 1.0f,  1.0f,  1.0f, 1.0f,
-		-1.0f,  1.0f,  0.0f, 1.0f
-	};
-
-	unsigned int indices[] = {
-		0, 1, 2,   // First triangle
-		0, 2, 3    // Second triangle
-	};
-
-	// Create and bind VAO and VBO
-	unsigned int VBO, VAO, EBO;
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	glBindVertexArray(VAO);
-
-	// Bind vertex buffer
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// Bind index buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-	// Set vertex attributes
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0); // Position
-
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-	glEnableVertexAttribArray(1); // Texture Coordinates
-
-	// Unbind VAO
-	glBindVertexArray(0);
-
-
-	// Line drawing vertex buffer and color buffer
-	// Vertex buffer is just draw elements, unindexed. Monolithic buffer, so lines can be any random
-	// object so no indeces, gldrawarrays(gl_lines)
-	// Color buffer is array of 32 bit uints.
-
-	// Quad drawing vertex buffer and color buffer
-	// Vertex buffer is just draw elements, unindexed. Monolithic buffer, so quads can be any random
-	// object so no indices, glDrawArrays(GL_TRIANGLES)
-	// Color buffer is array of 32 bit uints.
-	// Create quad vertex buffer
-	unsigned int quad_VBO, quad_VAO;
-
-	// Generate VAO
-	glGenVertexArrays(1, &quad_VAO);
-	glBindVertexArray(quad_VAO);
-
-	// Generate and bind VBO
-	glGenBuffers(1, &quad_VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, quad_VBO);
-	glBufferData(GL_ARRAY_BUFFER, MAX_LINES * 12 * sizeof(float), nullptr, GL_STREAM_DRAW); // Orphaned initially
-
-	// Vertex layout: vec2 per vertex (x, y), 6 vertices per quad = 12 floats
-	// Just treat it as a flat array of vec2s
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-
-	// Unbind VAO
-	glBindVertexArray(0);
-
-	float* quad_verts = new float[MAX_LINES * 12]; // 6 vertices * 2 components per quad
-	int quad_index = 0;
-
-#pragma endregion
-#pragma region Framebuffers
-
-	//  ==== Native framebuffer for raster text rendering 
-
-	// Create framebuffer
-	GLuint nativeFBO;
-	glGenFramebuffers(1, &nativeFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, nativeFBO);
-
-	// Create texture for framebuffer attachment
-	GLuint nativeTex;
-	glGenTextures(1, &nativeTex);
-	glBindTexture(GL_TEXTURE_2D, nativeTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, SMALL_WINDOW_WIDTH, SMALL_WINDOW_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	// Set texture border color to black
-	glm::vec4 border_color(0.0f, 0.0f, 0.0f, 1.0f);
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
-
-	// Attach texture to the framebuffer
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, nativeTex, 0);
-
-	// Check framebuffer completeness
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		std::cerr << "ERROR: Framebuffer is not complete!" << std::endl;
+	unique_ptr<RenderCaptureWriter> capture;
+	if (!capture_path.empty()) {
+		try {
+			capture = make_unique<RenderCaptureWriter>(capture_path);
+		}
+		catch (const exception& e) {
+			cout << e.what() << endl;
+			return -1;
+		}
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0); // Unbind framebuffer
-
-	//// ==== Fullscreen framebuffer for upscaling text
-
-	//GLuint fullFBO;
-	//glGenFramebuffers(1, &fullFBO);
-	//glBindFramebuffer(GL_FRAMEBUFFER, fullFBO);
-
-	//glGenTextures(1, &fullTex);
-	//glBindTexture(GL_TEXTURE_2D, fullTex);
-	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
 
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
-
-	//glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fullTex, 0);
-
-	//if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-	//	std::cerr << "ERROR: Fullscreen framebuffer is not complete!" << std::endl;
-	//}
-	//glBindFramebuffer(GL_FRAMEBUFFER, 0); // Unbind framebuffer
-
-	// ==== Composite for vector lines and raster text
-
-	GLuint compositeFBO;
-	glGenFramebuffers(1, &compositeFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, compositeFBO);
-
-	glGenTextures(1, &compositeTex);
-	glBindTexture(GL_TEXTURE_2D, compositeTex);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
-
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, compositeTex, 0);
-
-	// ----- Create Depth + Stencil Renderbuffer -----
-	glGenRenderbuffers(1, &depthStencilRBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, depthStencilRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
-
-	// Attach renderbuffer to framebuffer
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencilRBO);
-
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		std::cerr << "ERROR: Composite framebuffer is not complete!" << std::endl;
+	// With a window cap at the display and go idle in menus, without one
+	// run flat out unless told otherwise since those are throughput runs
+	bool windowed = !headless && !software;
+	if (fps < 0.0) {
+		fps_display = fps_display || windowed;
+		fps = 0.0;
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-
-	//// ==== Blur framebuffer for intermediate step
-	//GLuint blurFBO;
-	//glGenFramebuffers(1, &blurFBO);
-	//glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
-
-	//glGenTextures(1, &blurTex);
-	//glBindTexture(GL_TEXTURE_2D, blurTex);
-	//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	//glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &border_color[0]);
-
-	//glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTex, 0);
-
-	//if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-	//	std::cerr << "ERROR: Blur framebuffer is not complete!" << std::endl;
-	//}
-	//glBindFramebuffer(GL_FRAMEBUFFER, 0); // Unbind framebuffer
-
-#pragma endregion
-#pragma region SSBOs
-
-	// Character grid buffer
-	// Holds CHAR_COLS by CHAR_ROWS characters
-	// Stores uints for character and color
-	// First 8 bits are character, next 8 are color, next 8 are background color, and 8 unused
-
-	unsigned int char_grid_buffer;
-
-	glGenBuffers(1, &char_grid_buffer);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, char_grid_buffer);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, NUM_CHARS * sizeof(uint32_t), char_grid, GL_DYNAMIC_COPY);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, char_grid_buffer);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-	unsigned int quad_color_SSBO;
-
-	// Color buffer  SSBO
-	glGenBuffers(1, &quad_color_SSBO);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, quad_color_SSBO);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LINES * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, quad_color_SSBO); // bind to 1
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); // unbind
-
-#define MAX_STENCIL_REGIONS 16
-	// Stencil regions buffer
-	// Holds 4 * sizof(float) * MAX_STENCIL_REGIONS bytes
-	// Each region is two vec2s [x1, y1], [x2, y2] in native space
-	float* stencil_regions = new float[MAX_STENCIL_REGIONS * 4]; // 4 floats per region (2 vec2s)
-	int region_count = 0;
-
-	unsigned int stencil_regions_buffer;
-
-	glGenBuffers(1, &stencil_regions_buffer);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, stencil_regions_buffer);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_STENCIL_REGIONS * 4 * sizeof(float), stencil_regions, GL_DYNAMIC_COPY);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, stencil_regions_buffer); // bind to 2
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (idle_fps < 0.0) {
+		idle_fps = windowed ? FRAME_LIMITER_DEFAULT_IDLE_FPS : 0.0;
+	}
+	FrameLimiter frame_limiter(fps, idle_fps);
 
-	// Raw line data buffer
-	float* line_data = new float[MAX_LINES * 4 * 2]; // 4 vertices per line, 2 floats per vertex
+	systems_controller = make_unique<SystemsController>("gamedata\\ui\\gameplay_ui.json");
 
-	unsigned int line_data_buffer;
+	if (line_budget >= 0) {
+		systems_controller->get_line_budget().set_budget(line_budget);
+	}
 
-	glGenBuffers(1, &line_data_buffer);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, line_data_buffer);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LINES * 4 * 2 * sizeof(float), line_data, GL_DYNAMIC_COPY);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, line_data_buffer); // bind to 3
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	if (bench_update_objects >= 0) {
+		int result = run_object_update_benchmark(*systems_controller, bench_update_objects, max_frames);
+		systems_controller->clean_up_threads();
+		systems_controller.reset();
+		backend.reset();
+		return result;
+	}
 
+	if (!start_map.empty()) {
+		systems_controller->load_map(start_map);
+	}
 
-#pragma endregion
+	auto start_time = chrono::steady_clock::now();
+	double start_cpu_time = get_process_cpu_time();
+	long long frames = 0;
+	uint64_t total_lines = 0;
+	uint64_t total_instances = 0;
+	uint64_t total_shed[LINE_PRIORITY_COUNT] = {};
 
-	// Set this every frame how many lines were drawing this time
-	int num_lines = 0;
+	GlobalUpdateData last_update_data = {};
 
 	// Main loop
-	while (!glfwWindowShouldClose(window))
-	{
-		processInput(window);
+	while (backend->is_running() && (max_frames < 0 || frames < max_frames)) {
+		GlobalUpdateData global_update_data = backend->poll_input();
 
+		systems_controller->update(global_update_data);
 
-		GlobalUpdateData global_update_data;
-		global_update_data.mouse_pos_native = vec2(native_x, native_y);
-		global_update_data.mouse_pos_char = vec2(mouse_char_x, mouse_char_y);
-		global_update_data.scroll_delta = vec2(scroll_x, scroll_y);
-
-		systems_controller->update(window, global_update_data);
+		// Systems render straight into whatever the backend hands out
+		RenderTargets render_targets = backend->begin_frame();
+		systems_controller->set_render_targets(render_targets);
 		RenderData render_data = systems_controller->render();
-		num_lines = render_data.lines_counter;
-
-		// vec2s are just float x, y; so you can cast them directly
-		stencil_regions = reinterpret_cast<float*>(render_data.stencil_regions.data());
-		region_count = render_data.stencil_regions.size() / 2; // each region is two vec2s
-
-		// Rendering starts here
-		draw_imgui();
-		set_uniforms();
-
-#pragma region raster_shader
-		glBindFramebuffer(GL_FRAMEBUFFER, nativeFBO);
-		glViewport(0, 0, SMALL_WINDOW_WIDTH, SMALL_WINDOW_HEIGHT); // Match the framebuffer size
-		glClear(GL_COLOR_BUFFER_BIT); // Clear the framebuffer
-
-		raster_shader.use();
-
-		// The amount of data we send to the gpu is only 16.3 kb, if you want to optimize
-		// this then go right ahead if you want another 1 fps over the 1000 you already get
 
-		// Copy the screen to the gpu
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, char_grid_buffer);
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, NUM_CHARS * sizeof(uint32_t), char_grid);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-		glBindVertexArray(VAO);							// Fullscreen quad VAO
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);  // Correct 		// Draw the quad
-
-		// bind texture and generate mipmaps
-		glBindTexture(GL_TEXTURE_2D, nativeTex);		// Bind texture to unit 0
-		glGenerateMipmap(GL_TEXTURE_2D);				// Generate mipmaps for the texture
-		glBindTexture(GL_TEXTURE_2D, 0);				// Unbind texture
-
-
-#pragma endregion
-#pragma region pass_shader
-		// Finally unbind the small framebuffer
-		// ---- ALL IN SOFTWARE RASTER ELEMENTS MUST BE DRAWN ABOVE THIS LINE ----
-		glBindFramebuffer(GL_FRAMEBUFFER, compositeFBO);
-		glClear(GL_COLOR_BUFFER_BIT);
-
-		glViewport(0, 0, window_width, window_height);	// Fullscreen viewport
-
-		pass_shader.use();							// Use shader first
-		glActiveTexture(GL_TEXTURE0);					// Activate texture unit 0
-		glBindTexture(GL_TEXTURE_2D, nativeTex);		// Bind texture to unit 0
-		pass_shader.setInt("screenTexture", 0);		// Set uniform to use unit 0
-
-		// Set uniforms
-		pass_shader.setFloat("aspectRatio", aspect_ratio);
-		pass_shader.setFloat("aspectRatioSmall", aspect_ratio_small);
-
-		glBindVertexArray(VAO);							// Fullscreen quad VAO
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);  // Correct              // Draw the quad
-
-#pragma endregion
-#pragma region stencil_shader
-		glBindFramebuffer(GL_FRAMEBUFFER, compositeFBO);
-		glEnable(GL_STENCIL_TEST); // Enable stencil test
-
-		// Draw to stencil buffer for lines
-		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE); // Don't draw colors
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);                  // Always pass stencil test
-		glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);          // Replace stencil with ref=1 on pass
-		glStencilMask(0xFF);
-
-		stencil_shader.use();
-		stencil_shader.setFloat("aspectRatio", aspect_ratio);
-		stencil_shader.setFloat("aspectRatioSmall", aspect_ratio_small);
-		stencil_shader.setInt("zone_count", region_count); // whatever
-
-		// Upload stencil regions to the shader
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, stencil_regions_buffer);
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, MAX_STENCIL_REGIONS * 4 * sizeof(float), stencil_regions);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-		// Draw fullscreen quad only the fragement is different so we can use the same VAO
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-		// Step 2: Only allow drawing where stencil == 1
-		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE); // Enable color writes
-		glStencilMask(0x00);                             // Disable writing to stencil
-
-#pragma endregion
-#pragma region line_shader 
-		// Draw electron beam lines as quads (two triangles each)
-		// Generate quad vertices from line data on CPU
-
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-		glEnable(GL_BLEND);
-		glDisable(GL_CULL_FACE); // Important for quads
-
-		// Thickness parameter - adjust as needed
-		float thickness = dval1; // You can make this a uniform or parameter
-
-		line_shader.use(); // Renamed from line_shader
-
-		// Set uniforms 
-		line_shader.setFloat("aspectRatio", aspect_ratio);
-		line_shader.setFloat("aspectRatioSmall", aspect_ratio_small);
-		line_shader.setFloat("thickness_test", dval2);
-
-		// Generate quad vertices from line data
-
-		// Calculate thickness scaling for NDC space
-		float thickness_x = thickness * 0.01f; // Scale down for NDC space
-		float thickness_y = thickness * 0.01f;
-
-		// Apply aspect ratio correction to thickness
-		thickness_x /= (aspect_ratio_small * aspect_ratio);
-
-		quad_index = 0; // Reset quad index for each frame
-
-		for (int i = 0; i < num_lines; i++) {
-			// Get line endpoints (assuming line_verts stores x1,y1,x2,y2 for each line)
-			float x1 = line_verts[i * 4 + 0];
-			float y1 = line_verts[i * 4 + 1];
-			float x2 = line_verts[i * 4 + 2];
-			float y2 = line_verts[i * 4 + 3];
-
-			// Calculate line direction and perpendicular
-			float dx = x2 - x1;
-			float dy = y2 - y1;
-			float len = sqrt(dx * dx + dy * dy);
-
-			if (len > 0.0f) {
-				// Normalize direction vector
-				dx /= len;
-				dy /= len;
-
-				// Perpendicular vector (rotated 90 degrees) with proper NDC scaling
-				float perp_x = -dy * thickness_x * 0.5f;
-				float perp_y = dx * thickness_y * 0.5f;
-
-				// Extend the line in both directions for glow effect
-				float extend_x = dx * thickness_x * 0.5f;
-				float extend_y = dy * thickness_y * 0.5f;
-
-				// Calculate extended endpoints
-				float x1_ext = x1 - extend_x;
-				float y1_ext = y1 - extend_y;
-				float x2_ext = x2 + extend_x;
-				float y2_ext = y2 + extend_y;
-
-				// Generate quad vertices (2 triangles = 6 vertices)
-				// Using extended endpoints for glow effect
-				// Triangle 1: v1, v2, v3
-				// Triangle 2: v1, v3, v4
-
-				// v1 (bottom-left)
-				quad_verts[quad_index++] = x1_ext - perp_x;
-				quad_verts[quad_index++] = y1_ext - perp_y;
-				// v2 (top-left) 
-				quad_verts[quad_index++] = x1_ext + perp_x;
-				quad_verts[quad_index++] = y1_ext + perp_y;
-				// v3 (top-right)
-				quad_verts[quad_index++] = x2_ext + perp_x;
-				quad_verts[quad_index++] = y2_ext + perp_y;
-				// Second triangle
-				// v1 (bottom-left) - repeat
-				quad_verts[quad_index++] = x1_ext - perp_x;
-				quad_verts[quad_index++] = y1_ext - perp_y;
-				// v3 (top-right) - repeat
-				quad_verts[quad_index++] = x2_ext + perp_x;
-				quad_verts[quad_index++] = y2_ext + perp_y;
-				// v4 (bottom-right)
-				quad_verts[quad_index++] = x2_ext - perp_x;
-				quad_verts[quad_index++] = y2_ext - perp_y;
-			}
-			else {
-				// Degenerate line (zero length) - create zero-area triangles
-				for (int j = 0; j < 12; j++) {
-					quad_verts[quad_index++] = 0.0f;
-				}
-			}
+		if (capture) {
+			capture->write_frame(render_targets, render_data);
 		}
 
-		// Upload quad vertex data 
-		glBindBuffer(GL_ARRAY_BUFFER, quad_VBO); // Renamed from line_VBO
-		glBufferData(GL_ARRAY_BUFFER, MAX_LINES * 12 * sizeof(float), nullptr, GL_STREAM_DRAW); // 6 verts * 2 components
-		glBufferSubData(GL_ARRAY_BUFFER, 0, num_lines * 2 * 6 * sizeof(float), quad_verts);
+		backend->end_frame(render_data);
 
-		// Upload color data (same as before, but now each color applies to a quad)
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, quad_color_SSBO); // Renamed from line_color_SSBO
-		glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LINES * sizeof(uint32_t), nullptr, GL_DYNAMIC_DRAW);
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, num_lines * sizeof(uint32_t), line_colors);
+		bool idle = frame_is_idle(global_update_data, last_update_data, render_data, systems_controller->objects_were_active());
+		last_update_data = global_update_data;
 
-		// Raw upload raw line data
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, line_data_buffer);
-		glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_LINES * 4 * 2 * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
-		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, num_lines * 4 * 2 * sizeof(float), line_verts); // just upload this directly
-
-		// Bind the SSBO to binding point 1 
-		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, quad_color_SSBO);
-
-		// Setup VAO 
-		glBindVertexArray(quad_VAO); // Renamed from line_VAO
-
-		// Draw the first 25 quads that are reserved for the cursor without stencil
-		line_shader.setInt("prim_offset", 0);
-		glDrawArrays(GL_TRIANGLES, 0, 25 * 6); // 25 quads * 6 vertices each
-
-		// Turn on the stencil finally 
-		glStencilFunc(GL_EQUAL, render_data.stencil_state, 0xFF);
-
-		// Only bother drawing any other quads if we have more than 25 lines 
-		if (num_lines > 25) {
-			line_shader.setInt("prim_offset", 25);
-			glDrawArrays(GL_TRIANGLES, 25 * 6, (num_lines - 25) * 6); // Remaining quads
+		if (fps_display) {
+			frame_limiter.set_target_fps(backend->get_refresh_rate());
 		}
+		frame_limiter.wait(idle);
 
-		// Clear the stencil right away 
-		glStencilMask(0xFF);
-		glClear(GL_STENCIL_BUFFER_BIT);
-
-		// Unbind for cleanliness 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-
-		glDisable(GL_BLEND);
-		glDisable(GL_STENCIL_TEST);
-		glEnable(GL_CULL_FACE); // Re-enable if it was on before
-
-#pragma endregion
-#pragma region scanline_shader
-
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glClear(GL_COLOR_BUFFER_BIT);
+		frames++;
+		total_lines += render_data.lines_counter;
+		total_instances += render_data.instance_count;
 
-		scanline_shader.use();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, compositeTex); // Bind the composite texture
-		scanline_shader.setInt("buffer_texture", 0);
-
-		// bind native texture to unit 1
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, nativeTex);
-
-		// linear filtering for "blur"
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		scanline_shader.setInt("native_texture", 1);
-
-		scanline_shader.setFloat("resy", window_height);
-		scanline_shader.setFloat("resx", window_width);
-
-		//scanline_shader.setFloat("dval1", dval1);
-
-		pass_shader.setFloat("aspectRatio", aspect_ratio);
-		pass_shader.setFloat("aspectRatioSmall", aspect_ratio_small);
-
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-		// reset filtering mode
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-#pragma endregion
+		const LineBudget& budget = systems_controller->get_line_budget();
+		for (int i = 0; i < LINE_PRIORITY_COUNT; i++) {
+			total_shed[i] += budget.get_shed((LinePriority)i);
+		}
+	}
 
-		// Draw Dear ImGui
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	if (max_frames >= 0 && frames > 0) {
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+		double cpu_seconds = get_process_cpu_time() - start_cpu_time;
+		cout << frames << " frames in " << seconds << " s, "
+			<< seconds * 1000.0 / frames << " ms per frame, "
+			<< frames / seconds << " fps, "
+			<< total_lines / frames << " lines and "
+			<< total_instances / frames << " instances per frame, "
+			<< cpu_seconds * 100.0 / seconds << "% cpu (100% is one core)" << endl;
+
+		for (int i = 0; i < LINE_PRIORITY_COUNT; i++) {
+			if (total_shed[i] > 0) {
+				cout << "  " << LineBudget::get_priority_name((LinePriority)i) << ": "
+					<< total_shed[i] / frames << " lines shed per frame" << endl;
+			}
+		}
+	}
 
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	if (capture && frames > 0) {
+		cout << "Captured " << frames << " frames, "
+			<< capture->get_bytes_written() / frames << " bytes per frame" << endl;
 	}
 
 	systems_controller->clean_up_threads();
-	glfwTerminate();
-	return 0;
 
+	// Systems first, the backend takes the gl context down with it
+	systems_controller.reset();
+	backend.reset();
+
+	return 0;
 }
@@ -122,8 +122,16 @@ float project_point(float val, float depth, float scale) {
 	return val / (depth * scale);
 }
 
-int MapManager::render(float* lines_list, uint32_t* colors, int offset) {
+LinePriority MapManager::line_priority(int line) {
+	// Nothing fills in types yet so everything is a wall for now
+	if (line < (int)types.size() &&
+		(types[line] == LINE_TYPE_COSMETIC || types[line] == LINE_TYPE_COSMETIC_PARALLAX)) {
+		return LINE_PRIORITY_COSMETIC;
+	}
+	return LINE_PRIORITY_WALLS;
+}
 
+void MapManager::want_lines(LineBudget& budget) {
 	// To render things, the centre of camera is at 0,0, but that translates to 480, 268 on the actual screen.
 	// The raw camera position is fed to update(), and then update sends it through some function for things like
 	// camera follow inertia, and writes it to camera_x and camera_y. These are the absoulte camera position so dont need to be
@@ -135,13 +143,18 @@ int MapManager::render(float* lines_list, uint32_t* colors, int offset) {
 	float scrn_width = 960.0f;
 	float scrn_height = 536.0f;
 
-	int lines_counter = offset;
-
 	// Dont want to refactor all of this itll probably get scrapped anyway
 	float camera_x = camera_pos.x;
 	float camera_y = camera_pos.y;
 
-	uint32_t map_col = generate_line_color(LINE_COLOR_PRESET_WALL_GENERIC);
+	// Everything gets clipped to the screen first so lines that cant be seen
+	// dont use up the budget, and long walls dont turn into huge quads
+	visible_lines.clear();
+	visible_priorities.clear();
+	SegmentClipper clipper(
+		vec2(-1.0f - MAP_CLIP_MARGIN, -1.0f - MAP_CLIP_MARGIN),
+		vec2(1.0f + MAP_CLIP_MARGIN, 1.0f + MAP_CLIP_MARGIN),
+		visible_lines, visible_priorities);
 
 	for (int i = 0; i < num_lines; i++) {
 		// Get the line coordinates, these are in 32 bit ints
@@ -197,129 +210,93 @@ int MapManager::render(float* lines_list, uint32_t* colors, int offset) {
 		z_x2 = (z_x2 * 2.0f) - 1.0f;
 		z_y2 = (z_y2 * 2.0f) - 1.0f;
 
-		// Now draw the 4 lines to lines list:
-		// Bottom:
-		lines_list[lines_counter * 4 + 0] = f_x1; // x1
-		lines_list[lines_counter * 4 + 1] = f_y1; // y1
-		lines_list[lines_counter * 4 + 2] = f_x2; // x2
-		lines_list[lines_counter * 4 + 3] = f_y2; // y2
-		colors[lines_counter] = generate_line_color(LINE_COLOR_PRESET_WALL_GENERIC);
-		lines_counter++;
+		// Now the lines, the base of the wall and the raised copy. The
+		// other side is left out, every line would draw both ends.
+		clipper.add(vec2(f_x1, f_y1), vec2(f_x2, f_y2), line_priority(i));
 
 		// if we are drawing bvh dont tesselate
 		if (draw_bvh) {
-			colors[lines_counter - 1] = generate_line_color(LINE_COLOR_PRESET_WALL_SECONDARY);
 			continue; // Skip the rest of the lines
 		}
 
-		// Top:
-		lines_list[lines_counter * 4 + 0] = z_x1; // x1
-		lines_list[lines_counter * 4 + 1] = z_y1; // y1
-		lines_list[lines_counter * 4 + 2] = z_x2; // x2
-		lines_list[lines_counter * 4 + 3] = z_y2; // y2
-		colors[lines_counter] = generate_line_color(LINE_COLOR_PRESET_WALL_SECONDARY); // Color is always white for now
-		lines_counter++;
+		clipper.add(vec2(z_x1, z_y1), vec2(z_x2, z_y2), LINE_PRIORITY_PARALLAX); // Top
+		clipper.add(vec2(f_x1, f_y1), vec2(z_x1, z_y1), LINE_PRIORITY_PARALLAX); // Side
+	}
 
-		// Side 1:
-		lines_list[lines_counter * 4 + 0] = f_x1; // x1
-		lines_list[lines_counter * 4 + 1] = f_y1; // y1
-		lines_list[lines_counter * 4 + 2] = z_x1; // x2
-		lines_list[lines_counter * 4 + 3] = z_y1; // y2
-		colors[lines_counter] = generate_line_color(LINE_COLOR_PRESET_WALL_SECONDARY); // Color is always white for now
-		lines_counter++;
+	if (draw_bvh) {
+		// Render collision BVH
+		for (const auto& node : bvh_collision_nodes) {
+
+			// Draw the bounds of the node
+			vec2 from = node.from - camera_pos;
+			vec2 to = node.to - camera_pos;
+
+			// Move lines to centre of screen
+			from += vec2(scrn_width, scrn_height) / 2.0f;
+			to += vec2(scrn_width, scrn_height) / 2.0f;
 
-		//// Side 2:
-		//lines_list[lines_counter * 4 + 0] = f_x2; // x1
-		//lines_list[lines_counter * 4 + 1] = f_y2; // y1
-		//lines_list[lines_counter * 4 + 2] = z_x2; // x2
-		//lines_list[lines_counter * 4 + 3] = z_y2; // y2
-		//colors[lines_counter] = 127; // Color is always white for now
-		//lines_counter++;
+			// Normalize to ndc
+			from /= vec2(scrn_width, scrn_height);
+			to /= vec2(scrn_width, scrn_height);
 
-		// Need to deduplicate the side lines as every line draws both ends.
-		// for now just only draw one side ig.
+			from = (from * 2.0f) - 1.0f;
+			to = (to * 2.0f) - 1.0f;
+
+			// Box around the node
+			clipper.add(vec2(to.x, from.y), vec2(to.x, to.y), LINE_PRIORITY_COSMETIC);
+			clipper.add(vec2(to.x, from.y), vec2(from.x, from.y), LINE_PRIORITY_COSMETIC);
+			clipper.add(vec2(from.x, from.y), vec2(from.x, to.y), LINE_PRIORITY_COSMETIC);
+			clipper.add(vec2(from.x, to.y), vec2(to.x, to.y), LINE_PRIORITY_COSMETIC);
+		}
 	}
 
-	// Return how many lines weve rendered. Note that this isnt just num_lines
-	// because not the entire map may be rendered at once, but also because of
-	// parralax lines.
-	return lines_counter;
-}
+	clipper.flush();
 
-void MapManager::toggle_render_bvh() {
-	draw_bvh = !draw_bvh;
+	int counts[LINE_PRIORITY_COUNT] = {};
+	for (uint32_t priority : visible_priorities) {
+		counts[priority]++;
+	}
+	for (int i = 0; i < LINE_PRIORITY_COUNT; i++) {
+		if (counts[i] > 0) {
+			budget.want((LinePriority)i, counts[i]);
+		}
+	}
+
+	return;
 }
 
-int MapManager::render_bvh(float* lines_list, uint32_t* colors, int offset) {
-	if (!draw_bvh) {
-		return offset; // Nothing to render
-	}
+int MapManager::render(float* lines_list, LineMaterial* colors, int offset, const LineBudget& budget) {
 	int lines_counter = offset;
 
-	float scrn_width = 960.0f;
-	float scrn_height = 536.0f;
-
-	// Render collision BVH
-	for (const auto& node : bvh_collision_nodes) {
+	LineMaterial wall_col = preset_material(LINE_COLOR_PRESET_WALL_GENERIC);
+	LineMaterial secondary_col = preset_material(LINE_COLOR_PRESET_WALL_SECONDARY);
 
-		// Draw the bounds of the node
-		vec2 from = node.from - camera_pos;
-		vec2 to = node.to - camera_pos;
+	// Where each class is up to, for asking the budget what to keep
+	int priority_index[LINE_PRIORITY_COUNT] = {};
 
-		float x1 = from.x;
-		float y1 = from.y;
-		float x2 = to.x;
-		float y2 = to.y;
+	for (size_t i = 0; i < visible_priorities.size(); i++) {
+		LinePriority priority = (LinePriority)visible_priorities[i];
+		if (!budget.keep(priority, priority_index[priority]++)) {
+			continue;
+		}
 
-		// Move lines to centre of screen
-		from += vec2(scrn_width, scrn_height) / 2.0f;
-		to += vec2(scrn_width, scrn_height) / 2.0f;
+		lines_list[lines_counter * 4 + 0] = visible_lines[i * 4 + 0]; // x1
+		lines_list[lines_counter * 4 + 1] = visible_lines[i * 4 + 1]; // y1
+		lines_list[lines_counter * 4 + 2] = visible_lines[i * 4 + 2]; // x2
+		lines_list[lines_counter * 4 + 3] = visible_lines[i * 4 + 3]; // y2
 
-		// Normalize to ndc
-		from /= vec2(scrn_width, scrn_height);
-		to /= vec2(scrn_width, scrn_height);
-
-		from = (from * 2.0f) - 1.0f;
-		to = (to * 2.0f) - 1.0f;
-
-		int col = generate_line_color(LINE_COLOR_PRESET_WALL_SECONDARY);
-
-		// Right vertical
-		lines_list[lines_counter * 4 + 0] = to.x; // x1
-		lines_list[lines_counter * 4 + 1] = from.y; // y1
-		lines_list[lines_counter * 4 + 2] = to.x; // x2
-		lines_list[lines_counter * 4 + 3] = to.y; // y2
-		colors[lines_counter++] = col;
-
-		// Bottom horizontal
-		lines_list[lines_counter * 4 + 0] = to.x;
-		lines_list[lines_counter * 4 + 1] = from.y;
-		lines_list[lines_counter * 4 + 2] = from.x;
-		lines_list[lines_counter * 4 + 3] = from.y;
-		colors[lines_counter++] = col;
-
-		// Left vertical
-		lines_list[lines_counter * 4 + 0] = from.x;
-		lines_list[lines_counter * 4 + 1] = from.y;
-		lines_list[lines_counter * 4 + 2] = from.x;
-		lines_list[lines_counter * 4 + 3] = to.y;
-		colors[lines_counter++] = col;
-
-		// Top horizontal
-		lines_list[lines_counter * 4 + 0] = from.x;
-		lines_list[lines_counter * 4 + 1] = to.y;
-		lines_list[lines_counter * 4 + 2] = to.x;
-		lines_list[lines_counter * 4 + 3] = to.y;
-		colors[lines_counter++] = col;
+		// Everything is secondary when looking at the bvh
+		bool secondary = draw_bvh || priority == LINE_PRIORITY_PARALLAX;
+		colors[lines_counter] = secondary ? secondary_col : wall_col;
+		lines_counter++;
 	}
 
-	/*for (int i = 0; i < lines_counter / 2; i++) {
-		std::cout <<
-			lines_list[i * 4 + 0] << "," <<
-			lines_list[i * 4 + 1] << "," << "\n" <<
-			lines_list[i * 4 + 2] << "," <<
-			lines_list[i * 4 + 3] << "," << "\n";
-	}*/
+	// Return how many lines weve rendered. Note that this isnt just num_lines
+	// because not the entire map may be rendered at once, but also because of
+	// parralax lines.
+	return lines_counter;
+}
 
-	return lines_counter; // Return how many lines we rendered
-}
\ No newline at end of file
+void MapManager::toggle_render_bvh() {
+	draw_bvh = !draw_bvh;
+}
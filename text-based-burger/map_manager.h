@@ -6,6 +6,11 @@
 
 #include "object_utils.h"
 #include "map_utils.h"
+#include "line_budget.h"
+
+// How far past the edge of the screen lines get clipped, in ndc. Has to cover
+// the glow quad around a line or clipped ends would show.
+#define MAP_CLIP_MARGIN 0.1f
 
 // Lightweight struct to pass when someone wants access to the map geometry
 struct MapGeometry {
@@ -28,8 +33,12 @@ public:
 	MapManager(std::string filename);
 	// Update the map
 	void update(ObjectUpdateData data);
-	// Render the map
-	int render(float* lines_list, uint32_t* colors, int offset);
+	// Work out which lines are on screen (clipped to it) and tell the budget
+	// how many of each class there are. Also does the bvh if it is shown.
+	void want_lines(LineBudget& budget);
+
+	// Render the lines want_lines found, only the ones the budget kept
+	int render(float* lines_list, LineMaterial* colors, int offset, const LineBudget& budget);
 	// Get the error log
 	std::vector<std::string> get_error_log();
 
@@ -37,14 +46,20 @@ public:
 
 	void toggle_render_bvh();
 
-	int render_bvh(float* lines_list, uint32_t* colors, int offset);
-
 	bool has_collision_bvh = false; // If we have a collision BVH
 
 private:
 
 	bool draw_bvh = false;
 
+	// Which class a line's base goes in
+	LinePriority line_priority(int line);
+
+	// What want_lines found on screen, [x1, y1, x2, y2] in ndc and the class
+	// of each
+	std::vector<float> visible_lines;
+	std::vector<uint32_t> visible_priorities;
+
 	MapGeometry geometry;
 
 	// Master line counter
@@ -5,6 +5,14 @@
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <cmath>
+
+// SSE2 is always there on x64, and on x86 if the compiler is allowed to use it.
+// Anything else gets the scalar version of the batch clipper.
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAP_UTILS_SSE2
+#include <emmintrin.h>
+#endif
 
 using namespace std::chrono_literals;
 using namespace std;
@@ -207,6 +215,394 @@ bool CohenSutherlandLineClip(
 	return accept;
 }
 
+// Liang-Barsky does the same thing as Cohen-Sutherland but as 4 slab tests
+// against the parametric line p(t) = p0 + t * d, t in [0, 1]. Each edge either
+// raises the entry t or lowers the exit t, and the segment hits the box if
+// entry <= exit at the end. Because every lane runs all 4 edges no matter what
+// this maps nicely onto simd, there is no "keep clipping until done" loop.
+//
+// For edge k with p = -d or d and q = distance from p0 to the edge:
+//   p < 0: entering the box, t_enter = max(t_enter, q / p)
+//   p > 0: leaving the box,  t_exit  = min(t_exit,  q / p)
+//   p = 0: parallel to the edge, outside if q < 0
+//
+// Boundaries are inclusive, same as Cohen-Sutherland, so a segment lying
+// exactly on the box edge still counts as a hit.
+int clip_segments_aabb_x4(ClipBatch& batch, vec2 clip_from, vec2 clip_to) {
+#ifdef MAP_UTILS_SSE2
+	__m128 x0 = _mm_load_ps(batch.x0);
+	__m128 y0 = _mm_load_ps(batch.y0);
+	__m128 dx = _mm_sub_ps(_mm_load_ps(batch.x1), x0);
+	__m128 dy = _mm_sub_ps(_mm_load_ps(batch.y1), y0);
+
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	__m128 t_enter = zero;
+	__m128 t_exit = one;
+	__m128 reject = zero;
+
+	// The four edges: left, right, bottom, top
+	__m128 p[4] = {
+		_mm_sub_ps(zero, dx),
+		dx,
+		_mm_sub_ps(zero, dy),
+		dy
+	};
+	__m128 q[4] = {
+		_mm_sub_ps(x0, _mm_set1_ps(clip_from.x)),
+		_mm_sub_ps(_mm_set1_ps(clip_to.x), x0),
+		_mm_sub_ps(y0, _mm_set1_ps(clip_from.y)),
+		_mm_sub_ps(_mm_set1_ps(clip_to.y), y0)
+	};
+
+	for (int k = 0; k < 4; k++) {
+		__m128 entering = _mm_cmplt_ps(p[k], zero);
+		__m128 leaving = _mm_cmpgt_ps(p[k], zero);
+		__m128 parallel = _mm_cmpeq_ps(p[k], zero);
+
+		// Parallel lanes divide by zero here but they get masked out below
+		// so whatever comes out does not matter.
+		__m128 r = _mm_div_ps(q[k], p[k]);
+
+		// Masked out lanes become 0 for the entry (no change since t_enter
+		// starts at 0) and 1 for the exit (no change since t_exit starts at 1)
+		t_enter = _mm_max_ps(t_enter, _mm_and_ps(entering, r));
+		t_exit = _mm_min_ps(t_exit, _mm_or_ps(_mm_and_ps(leaving, r), _mm_andnot_ps(leaving, one)));
+
+		reject = _mm_or_ps(reject, _mm_and_ps(parallel, _mm_cmplt_ps(q[k], zero)));
+	}
+
+	__m128 hit = _mm_andnot_ps(reject, _mm_cmple_ps(t_enter, t_exit));
+
+	// Midpoint of the clipped segment is just the middle t
+	__m128 t_mid = _mm_mul_ps(_mm_add_ps(t_enter, t_exit), _mm_set1_ps(0.5f));
+	_mm_store_ps(batch.mid_x, _mm_add_ps(x0, _mm_mul_ps(t_mid, dx)));
+	_mm_store_ps(batch.mid_y, _mm_add_ps(y0, _mm_mul_ps(t_mid, dy)));
+
+	_mm_store_ps(batch.clip_x0, _mm_add_ps(x0, _mm_mul_ps(t_enter, dx)));
+	_mm_store_ps(batch.clip_y0, _mm_add_ps(y0, _mm_mul_ps(t_enter, dy)));
+	_mm_store_ps(batch.clip_x1, _mm_add_ps(x0, _mm_mul_ps(t_exit, dx)));
+	_mm_store_ps(batch.clip_y1, _mm_add_ps(y0, _mm_mul_ps(t_exit, dy)));
+
+	return _mm_movemask_ps(hit);
+#else
+	// Same thing one lane at a time for when we dont have sse. Still no data
+	// dependent loop, the compiler is free to unroll this.
+	int hits = 0;
+	for (int i = 0; i < CLIP_BATCH_WIDTH; i++) {
+		float x0 = batch.x0[i];
+		float y0 = batch.y0[i];
+		float dx = batch.x1[i] - x0;
+		float dy = batch.y1[i] - y0;
+
+		float p[4] = { -dx, dx, -dy, dy };
+		float q[4] = { x0 - clip_from.x, clip_to.x - x0, y0 - clip_from.y, clip_to.y - y0 };
+
+		float t_enter = 0.0f;
+		float t_exit = 1.0f;
+		bool reject = false;
+
+		for (int k = 0; k < 4; k++) {
+			if (p[k] == 0.0f) {
+				reject |= q[k] < 0.0f;
+				continue;
+			}
+			float r = q[k] / p[k];
+			if (p[k] < 0.0f) {
+				t_enter = std::max(t_enter, r);
+			}
+			else {
+				t_exit = std::min(t_exit, r);
+			}
+		}
+
+		float t_mid = (t_enter + t_exit) * 0.5f;
+		batch.mid_x[i] = x0 + t_mid * dx;
+		batch.mid_y[i] = y0 + t_mid * dy;
+
+		batch.clip_x0[i] = x0 + t_enter * dx;
+		batch.clip_y0[i] = y0 + t_enter * dy;
+		batch.clip_x1[i] = x0 + t_exit * dx;
+		batch.clip_y1[i] = y0 + t_exit * dy;
+
+		hits |= (!reject && t_enter <= t_exit) << i;
+	}
+	return hits;
+#endif
+}
+
+// Kinds of segment check_clip_segments_aabb_x4 makes
+enum ClipCheckKind {
+	CLIP_CHECK_RANDOM,
+	CLIP_CHECK_HORIZONTAL,
+	CLIP_CHECK_VERTICAL,
+	CLIP_CHECK_ON_EDGE,
+	CLIP_CHECK_TOUCHING,
+	CLIP_CHECK_POINT,
+	CLIP_CHECK_OUTSIDE_SIDE,
+	CLIP_CHECK_OUTSIDE_CORNER,
+	CLIP_CHECK_KIND_COUNT
+};
+
+// xorshift, 0 to 1
+static float clip_check_random(uint32_t& seed) {
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+static void make_clip_check_segment(ClipCheckKind kind, uint32_t& seed, vec2 clip_from, vec2 clip_to,
+	float& x0, float& y0, float& x1, float& y1) {
+
+	// Segments go up to a box size past every edge
+	vec2 size = clip_to - clip_from;
+	float area_x = clip_from.x - size.x;
+	float area_y = clip_from.y - size.y;
+	float area_w = size.x * 3.0f;
+	float area_h = size.y * 3.0f;
+
+	x0 = area_x + clip_check_random(seed) * area_w;
+	y0 = area_y + clip_check_random(seed) * area_h;
+	x1 = area_x + clip_check_random(seed) * area_w;
+	y1 = area_y + clip_check_random(seed) * area_h;
+
+	switch (kind) {
+	case CLIP_CHECK_HORIZONTAL:
+		y1 = y0;
+		break;
+	case CLIP_CHECK_VERTICAL:
+		x1 = x0;
+		break;
+	case CLIP_CHECK_ON_EDGE: {
+		// Exactly on one of the edges, the boundary counts as inside
+		int edge = (int)(clip_check_random(seed) * 4.0f);
+		if (edge == 0) { x0 = x1 = clip_from.x; }
+		else if (edge == 1) { x0 = x1 = clip_to.x; }
+		else if (edge == 2) { y0 = y1 = clip_from.y; }
+		else { y0 = y1 = clip_to.y; }
+		break;
+	}
+	case CLIP_CHECK_TOUCHING: {
+		// Comes in from outside and stops exactly on an edge, so it enters
+		// and leaves the box at the same t. Still a hit.
+		int edge = (int)(clip_check_random(seed) * 4.0f);
+		x0 = clip_from.x + clip_check_random(seed) * size.x;
+		y0 = clip_from.y + clip_check_random(seed) * size.y;
+		x1 = clip_from.x + clip_check_random(seed) * size.x;
+		y1 = clip_from.y + clip_check_random(seed) * size.y;
+		float past = 1.0f + clip_check_random(seed) * size.x;
+		if (edge == 0) { x0 = clip_from.x - past; x1 = clip_from.x; }
+		else if (edge == 1) { x0 = clip_to.x + past; x1 = clip_to.x; }
+		else if (edge == 2) { y0 = clip_from.y - past; y1 = clip_from.y; }
+		else { y0 = clip_to.y + past; y1 = clip_to.y; }
+
+		// Either way around
+		if (clip_check_random(seed) < 0.5f) {
+			swap(x0, x1);
+			swap(y0, y1);
+		}
+		break;
+	}
+	case CLIP_CHECK_POINT:
+		x1 = x0;
+		y1 = y0;
+		break;
+	case CLIP_CHECK_OUTSIDE_SIDE: {
+		// Both ends past the same edge, by at least 1
+		int edge = (int)(clip_check_random(seed) * 4.0f);
+		if (edge == 0) {
+			x0 = clip_from.x - 1.0f - clip_check_random(seed) * size.x;
+			x1 = clip_from.x - 1.0f - clip_check_random(seed) * size.x;
+		}
+		else if (edge == 1) {
+			x0 = clip_to.x + 1.0f + clip_check_random(seed) * size.x;
+			x1 = clip_to.x + 1.0f + clip_check_random(seed) * size.x;
+		}
+		else if (edge == 2) {
+			y0 = clip_from.y - 1.0f - clip_check_random(seed) * size.y;
+			y1 = clip_from.y - 1.0f - clip_check_random(seed) * size.y;
+		}
+		else {
+			y0 = clip_to.y + 1.0f + clip_check_random(seed) * size.y;
+			y1 = clip_to.y + 1.0f + clip_check_random(seed) * size.y;
+		}
+		break;
+	}
+	case CLIP_CHECK_OUTSIDE_CORNER: {
+		// Diagonal past a corner, the ends are outside different edges so
+		// the outcodes dont share a bit but the box still gets missed. Every
+		// point on it is at least gap out along the corner's diagonal.
+		float sx = clip_check_random(seed) < 0.5f ? -1.0f : 1.0f;
+		float sy = clip_check_random(seed) < 0.5f ? -1.0f : 1.0f;
+		float corner_x = sx < 0.0f ? clip_from.x : clip_to.x;
+		float corner_y = sy < 0.0f ? clip_from.y : clip_to.y;
+
+		float gap = 1.0f + clip_check_random(seed) * size.x;
+		float along0 = -1.0f - clip_check_random(seed) * size.x;
+		float along1 = 1.0f + clip_check_random(seed) * size.x;
+
+		x0 = corner_x + sx * gap + sy * along0;
+		y0 = corner_y + sy * gap - sx * along0;
+		x1 = corner_x + sx * gap + sy * along1;
+		y1 = corner_y + sy * gap - sx * along1;
+		break;
+	}
+	default:
+		break;
+	}
+
+	return;
+}
+
+bool check_clip_segments_aabb_x4(int segment_count) {
+	const char* kind_names[CLIP_CHECK_KIND_COUNT] = {
+		"random", "horizontal", "vertical", "on edge", "touching", "point", "outside one side", "outside past a corner"
+	};
+
+	// Not symmetric around the origin so a mixed up axis shows
+	vec2 clip_from = vec2(-100.0f, -50.0f);
+	vec2 clip_to = vec2(300.0f, 250.0f);
+
+	uint32_t seed = 0x2545F491;
+	int hits[CLIP_CHECK_KIND_COUNT] = {};
+	int counts[CLIP_CHECK_KIND_COUNT] = {};
+	int grazing = 0;
+	int mismatches = 0;
+	double worst_error = 0.0;
+
+	ClipBatch batch;
+	ClipCheckKind kinds[CLIP_BATCH_WIDTH];
+
+	for (int start = 0; start < segment_count; start += CLIP_BATCH_WIDTH) {
+		int lanes = min(CLIP_BATCH_WIDTH, segment_count - start);
+		for (int i = 0; i < CLIP_BATCH_WIDTH; i++) {
+			// Spare lanes get filled like SegmentClipper does
+			if (i >= lanes) {
+				batch.x0[i] = batch.x1[i] = clip_to.x + 1.0f;
+				batch.y0[i] = batch.y1[i] = clip_to.y + 1.0f;
+				continue;
+			}
+			kinds[i] = (ClipCheckKind)((start + i) % CLIP_CHECK_KIND_COUNT);
+			make_clip_check_segment(kinds[i], seed, clip_from, clip_to, batch.x0[i], batch.y0[i], batch.x1[i], batch.y1[i]);
+		}
+
+		int mask = clip_segments_aabb_x4(batch, clip_from, clip_to);
+
+		for (int i = 0; i < CLIP_BATCH_WIDTH; i++) {
+			bool hit = mask & (1 << i);
+			if (i >= lanes) {
+				if (hit) {
+					cout << "Clip check: spare lane " << i << " was not rejected" << endl;
+					mismatches++;
+				}
+				continue;
+			}
+
+			double x0 = batch.x0[i];
+			double y0 = batch.y0[i];
+			double x1 = batch.x1[i];
+			double y1 = batch.y1[i];
+			bool reference_hit = CohenSutherlandLineClip(x0, y0, x1, y1, clip_from, clip_to);
+
+			counts[kinds[i]]++;
+			hits[kinds[i]] += reference_hit;
+
+			if (hit != reference_hit) {
+				// Random segments can end up within float error of an edge.
+				// If growing the box a hair hits and shrinking it misses then
+				// either answer is fine.
+				vec2 tolerance = vec2((float)CLIP_CHECK_TOLERANCE, (float)CLIP_CHECK_TOLERANCE);
+				vec2 grown_from = clip_from - tolerance;
+				vec2 grown_to = clip_to + tolerance;
+				vec2 shrunk_from = clip_from + tolerance;
+				vec2 shrunk_to = clip_to - tolerance;
+
+				double gx0 = batch.x0[i], gy0 = batch.y0[i], gx1 = batch.x1[i], gy1 = batch.y1[i];
+				double sx0 = batch.x0[i], sy0 = batch.y0[i], sx1 = batch.x1[i], sy1 = batch.y1[i];
+				bool grazes = CohenSutherlandLineClip(gx0, gy0, gx1, gy1, grown_from, grown_to)
+					&& !CohenSutherlandLineClip(sx0, sy0, sx1, sy1, shrunk_from, shrunk_to);
+
+				bool exact_kind = kinds[i] == CLIP_CHECK_ON_EDGE || kinds[i] == CLIP_CHECK_TOUCHING || kinds[i] == CLIP_CHECK_POINT
+					|| kinds[i] == CLIP_CHECK_OUTSIDE_SIDE || kinds[i] == CLIP_CHECK_OUTSIDE_CORNER;
+
+				if (grazes && !exact_kind) {
+					grazing++;
+					continue;
+				}
+
+				cout << "Clip check: " << kind_names[kinds[i]] << " segment (" << batch.x0[i] << ", " << batch.y0[i]
+					<< ") to (" << batch.x1[i] << ", " << batch.y1[i] << ") was a " << (hit ? "hit" : "miss")
+					<< " but the reference says " << (reference_hit ? "hit" : "miss") << endl;
+				mismatches++;
+				continue;
+			}
+
+			if (!hit) {
+				continue;
+			}
+
+			double error = max(max(fabs(batch.clip_x0[i] - x0), fabs(batch.clip_y0[i] - y0)),
+				max(fabs(batch.clip_x1[i] - x1), fabs(batch.clip_y1[i] - y1)));
+			error = max(error, max(fabs(batch.mid_x[i] - (x0 + x1) * 0.5), fabs(batch.mid_y[i] - (y0 + y1) * 0.5)));
+			worst_error = max(worst_error, error);
+
+			if (error > CLIP_CHECK_TOLERANCE) {
+				cout << "Clip check: " << kind_names[kinds[i]] << " segment (" << batch.x0[i] << ", " << batch.y0[i]
+					<< ") to (" << batch.x1[i] << ", " << batch.y1[i] << ") clipped to (" << batch.clip_x0[i] << ", "
+					<< batch.clip_y0[i] << ") to (" << batch.clip_x1[i] << ", " << batch.clip_y1[i]
+					<< ") but the reference says (" << x0 << ", " << y0 << ") to (" << x1 << ", " << y1 << ")" << endl;
+				mismatches++;
+			}
+		}
+	}
+
+#ifdef MAP_UTILS_SSE2
+	cout << "Clip check (sse2): ";
+#else
+	cout << "Clip check (scalar): ";
+#endif
+	cout << segment_count << " segments, " << mismatches << " wrong, " << grazing
+		<< " grazing an edge, worst endpoint error " << worst_error << endl;
+	for (int kind = 0; kind < CLIP_CHECK_KIND_COUNT; kind++) {
+		cout << "  " << kind_names[kind] << ": " << hits[kind] << " of " << counts[kind] << " hit" << endl;
+	}
+
+	return mismatches == 0;
+}
+
+SegmentClipper::SegmentClipper(vec2 clip_from, vec2 clip_to, vector<float>& out_lines, vector<uint32_t>& out_tags)
+	: clip_from(clip_from), clip_to(clip_to), out_lines(out_lines), out_tags(out_tags) {
+}
+
+void SegmentClipper::flush() {
+	if (count == 0) {
+		return;
+	}
+
+	// Unused lanes get a point past the right edge, always rejected
+	for (int i = count; i < CLIP_BATCH_WIDTH; i++) {
+		batch.x0[i] = batch.x1[i] = clip_to.x + 1.0f;
+		batch.y0[i] = batch.y1[i] = clip_to.y + 1.0f;
+	}
+
+	int hits = clip_segments_aabb_x4(batch, clip_from, clip_to);
+	for (int i = 0; i < count; i++) {
+		if (!(hits & (1 << i))) {
+			continue;
+		}
+		out_lines.push_back(batch.clip_x0[i]);
+		out_lines.push_back(batch.clip_y0[i]);
+		out_lines.push_back(batch.clip_x1[i]);
+		out_lines.push_back(batch.clip_y1[i]);
+		out_tags.push_back(tags[i]);
+	}
+
+	count = 0;
+	return;
+}
+
 // Aspirationally collide aabb with map geometry. It will then return the normal
 // force telling you exactly why your dreams will not happen.
 vec2 collide_aabb_geometry(
@@ -248,21 +644,38 @@ vec2 collide_aabb_geometry(
 	vec2 aabb_scale = (to - from);
 	vec2 aabb_scale1 = 1.0f / aabb_scale;
 
-	// Check the lines for actual collision
-	while (!lines_to_check.empty()) {
-		int line_idx = lines_to_check.back();
-		lines_to_check.pop_back();
-		vec2 v1 = vec2((*lines)[line_idx * 4 + 0], (*lines)[line_idx * 4 + 1]);
-		vec2 v2 = vec2((*lines)[line_idx * 4 + 2], (*lines)[line_idx * 4 + 3]);
+	// Padding lanes get a point way off to the side of the box so they always
+	// get rejected.
+	float pad_x = from.x - 1.0f;
+	float pad_y = from.y - 1.0f;
+
+	ClipBatch batch;
+
+	// Check the lines for actual collision, CLIP_BATCH_WIDTH at a time
+	for (size_t base = 0; base < lines_to_check.size(); base += CLIP_BATCH_WIDTH) {
+		for (int lane = 0; lane < CLIP_BATCH_WIDTH; lane++) {
+			size_t i = base + lane;
+			if (i >= lines_to_check.size()) {
+				batch.x0[lane] = pad_x;
+				batch.y0[lane] = pad_y;
+				batch.x1[lane] = pad_x;
+				batch.y1[lane] = pad_y;
+				continue;
+			}
+			const float* line = lines->data() + lines_to_check[i] * 4;
+			batch.x0[lane] = line[0];
+			batch.y0[lane] = line[1];
+			batch.x1[lane] = line[2];
+			batch.y1[lane] = line[3];
+		}
 
-		double x0 = v1.x;
-		double y0 = v1.y;
-		double x1 = v2.x;
-		double y1 = v2.y;
+		int hits = clip_segments_aabb_x4(batch, from, to);
 
+		for (int lane = 0; lane < CLIP_BATCH_WIDTH; lane++) {
+			if (!(hits & (1 << lane))) {
+				continue;
+			}
 
-		// Check if the line intersects with the AABB
-		if (CohenSutherlandLineClip(x0, y0, x1, y1, from, to)) {
 			// Instead of checking each end point, only check the midpoint. This
 			// works just as well in all cases. In the simple case where one
 			// point juts into the aabb its not perfect and lets you clip a bit
@@ -277,9 +690,7 @@ vec2 collide_aabb_geometry(
 			//
 			// See: https://www.desmos.com/geometry/mlmur2j8lh
 
-			vec2 v0 = vec2(x0, y0);
-			vec2 v1 = vec2(x1, y1);
-			vec2 v_mid = midv(v0, v1);
+			vec2 v_mid = vec2(batch.mid_x[lane], batch.mid_y[lane]);
 
 			v_mid -= mid;
 
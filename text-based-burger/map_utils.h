@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <set>
+#include <cstdint>
 
 struct LongThreadState;
 
@@ -71,8 +72,89 @@ const int TOP = 0b1000;
 
 OutCode ComputeOutCode(double x, double y, vec2& clip_from, vec2& clip_to);
 
+// This is the slow one line at a time version. It is not used by the
+// narrowphase anymore but keep it around, it is the reference that the batch
+// clipper below has to agree with.
 bool CohenSutherlandLineClip(double& x0, double& y0, double& x1, double& y1, vec2& clip_from, vec2& clip_to);
 
+// How many segments the batch clipper eats at once. SSE is 4 floats wide so 4.
+#define CLIP_BATCH_WIDTH 4
+
+// Batch of segments to clip, stored as SoA so it can be loaded straight into
+// registers. Unused lanes should be filled with something degenerate that is
+// outside of the clip box, clip_segments_aabb_x4 does not know how many lanes
+// are actually valid.
+struct ClipBatch {
+	alignas(16) float x0[CLIP_BATCH_WIDTH];
+	alignas(16) float y0[CLIP_BATCH_WIDTH];
+	alignas(16) float x1[CLIP_BATCH_WIDTH];
+	alignas(16) float y1[CLIP_BATCH_WIDTH];
+
+	// Outputs, midpoint of the clipped part of each segment. Garbage if the
+	// lane was rejected.
+	alignas(16) float mid_x[CLIP_BATCH_WIDTH];
+	alignas(16) float mid_y[CLIP_BATCH_WIDTH];
+
+	// Outputs, the clipped part of each segment. Also garbage if rejected.
+	alignas(16) float clip_x0[CLIP_BATCH_WIDTH];
+	alignas(16) float clip_y0[CLIP_BATCH_WIDTH];
+	alignas(16) float clip_x1[CLIP_BATCH_WIDTH];
+	alignas(16) float clip_y1[CLIP_BATCH_WIDTH];
+};
+
+// Liang-Barsky clip 4 segments against the same aabb in one go. No loops that
+// depend on the data, every lane does the same work. Returns a bitmask of
+// which lanes hit the box (bit i set means lane i is at least partially
+// inside), and writes the clipped segments and their midpoints to the batch.
+int clip_segments_aabb_x4(ClipBatch& batch, vec2 clip_from, vec2 clip_to);
+
+// How far the batch clipper's endpoints can be from the reference's in
+// check_clip_segments_aabb_x4. The reference works in doubles and the batch
+// clipper in floats, so they never agree exactly.
+#define CLIP_CHECK_TOLERANCE 1e-3
+
+// Clip segment_count random segments with clip_segments_aabb_x4 and compare
+// every lane against CohenSutherlandLineClip. The mix includes axis parallel
+// segments, segments lying right on an edge or stopping on one from outside,
+// points, and segments fully outside, some of them passing a corner so
+// neither outcode test catches them. Random segments that only graze the box within the tolerance can go
+// either way, everything else has to hit or miss the same and clip to the
+// same points. Prints what it found, false if anything disagreed.
+bool check_clip_segments_aabb_x4(int segment_count);
+
+// Clip a stream of segments to one box, CLIP_BATCH_WIDTH at a time. Segments
+// completely outside are dropped, the rest get appended clipped to the box as
+// [x0, y0, x1, y1] along with whatever tag they were added with. Call flush
+// after the last one or up to CLIP_BATCH_WIDTH - 1 segments get lost.
+class SegmentClipper {
+public:
+	SegmentClipper(vec2 clip_from, vec2 clip_to, std::vector<float>& out_lines, std::vector<uint32_t>& out_tags);
+
+	void add(vec2 from, vec2 to, uint32_t tag) {
+		batch.x0[count] = from.x;
+		batch.y0[count] = from.y;
+		batch.x1[count] = to.x;
+		batch.y1[count] = to.y;
+		tags[count] = tag;
+		if (++count == CLIP_BATCH_WIDTH) {
+			flush();
+		}
+	}
+
+	void flush();
+
+private:
+	vec2 clip_from;
+	vec2 clip_to;
+
+	std::vector<float>& out_lines;
+	std::vector<uint32_t>& out_tags;
+
+	ClipBatch batch;
+	uint32_t tags[CLIP_BATCH_WIDTH];
+	int count = 0;
+};
+
 // Collide given aabb with map geometry. Returns the normal force expereinced if
 // there is a collision. 
 vec2 collide_aabb_geometry(
@@ -0,0 +1,413 @@
+#include "mesh_library.h"
+#include "mesh_utils.h"
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include "threading_utils.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <memory>
+
+using namespace std;
+
+// Shared between every library so versions never repeat between maps
+static uint32_t next_version = 1;
+
+MeshLibrary::MeshLibrary() {
+	// Empty mesh is always id 0 so things that dont render can just leave
+	// their mesh as the default.
+	load("", vector<float>());
+	return;
+}
+
+MeshId MeshLibrary::intern(const string& name) {
+	auto it = ids.find(name);
+	if (it != ids.end()) {
+		return it->second;
+	}
+
+	// Empty until loaded, zero lines render as nothing
+	MeshId id = (MeshId)table.size();
+	table.push_back(MeshEntry());
+	names.push_back(name);
+	loaded.push_back(false);
+	mesh_file.push_back(MESH_FILE_NONE);
+	lazy_source.push_back(LazySource());
+	requested.push_back(false);
+
+	ids[name] = id;
+	return id;
+}
+
+MeshId MeshLibrary::load(const string& name, const vector<float>& verts) {
+	return load_from(name, verts, MESH_FILE_NONE);
+}
+
+// Flat packed floats to lines, then through the optimiser. Does not touch the
+// library so the prefetch thread can use it too.
+static vector<MeshLine> prepare_lines(const vector<float>& verts, MeshOptimizeStats& stats) {
+	// 4 floats per line. Half a line at the end cant be drawn anyway so it
+	// gets dropped.
+	vector<MeshLine> lines(verts.size() / 4);
+	for (size_t i = 0; i < lines.size(); i++) {
+		lines[i].from = vec2(verts[i * 4], verts[i * 4 + 1]);
+		lines[i].to = vec2(verts[i * 4 + 2], verts[i * 4 + 3]);
+	}
+
+	// Get rid of everything that doesnt change what it looks like
+	stats = optimize_mesh_lines(lines);
+	return lines;
+}
+
+static void report_savings(const string& name, const MeshOptimizeStats& stats) {
+	if (stats.lines_after < stats.lines_before) {
+		cout << "Mesh " << name << ": " << stats.lines_before << " -> " << stats.lines_after << " lines" << endl;
+	}
+}
+
+MeshId MeshLibrary::load_from(const string& name, const vector<float>& verts, uint32_t file) {
+	MeshId id = intern(name);
+
+	vector<MeshLine> lines = prepare_lines(verts, last_load_stats);
+	report_savings(name, last_load_stats);
+
+	place(id, lines, file);
+	return id;
+}
+
+void MeshLibrary::place(MeshId id, const vector<MeshLine>& lines, uint32_t file) {
+	MeshEntry& entry = table[id];
+	uint32_t line_count = (uint32_t)lines.size();
+
+	// Meshes are normally only loaded once. If one gets loaded again and
+	// still fits it is overwritten in place, otherwise it goes on the end
+	// and the old lines are just dead space.
+	if (line_count > entry.line_count) {
+		entry.first_line = (uint32_t)arena.size();
+		arena.resize(arena.size() + line_count);
+	}
+	entry.line_count = line_count;
+
+	// Bounds for culling
+	vec2 from = vec2();
+	vec2 to = vec2();
+	if (line_count > 0) {
+		from = lines[0].from;
+		to = from;
+	}
+
+	for (uint32_t i = 0; i < line_count; i++) {
+		const MeshLine& line = lines[i];
+		arena[entry.first_line + i] = line;
+
+		from = minv(from, minv(line.from, line.to));
+		to = maxv(to, maxv(line.from, line.to));
+	}
+
+	entry.bounds_from = from;
+	entry.bounds_to = to;
+
+	loaded[id] = true;
+	mesh_file[id] = file;
+	version = next_version++;
+
+	return;
+}
+
+uint32_t MeshLibrary::file_index(const string& path) {
+	auto it = file_ids.find(path);
+	if (it != file_ids.end()) {
+		return it->second;
+	}
+
+	uint32_t file = (uint32_t)files.size();
+	files.push_back(MeshFile());
+	files.back().path = path;
+	file_ids[path] = file;
+	return file;
+}
+
+bool MeshLibrary::acquire_file(const string& path) {
+	auto it = file_ids.find(path);
+	if (it != file_ids.end() && files[it->second].resident) {
+		// Already have it from some earlier map, nothing to parse
+		files[it->second].refs++;
+		return true;
+	}
+
+	// Cooked and not changed since, just remember where everything is
+	auto manifest_it = manifest.find(path);
+	if (manifest_it != manifest.end()) {
+		error_code ec;
+		uint64_t size = filesystem::file_size(path, ec);
+
+		if (!ec && size == manifest_it->second.size) {
+			uint32_t file = file_index(path);
+			MeshFile& mesh_file_data = files[file];
+			mesh_file_data.meshes.clear();
+
+			for (const MeshManifestEntry& mesh : manifest_it->second.meshes) {
+				MeshId id = intern(mesh.name);
+				lazy_source[id] = LazySource{ file, mesh.offset, mesh.length };
+				mesh_file_data.meshes.push_back(id);
+			}
+
+			mesh_file_data.resident = true;
+			mesh_file_data.refs++;
+			return true;
+		}
+	}
+
+	ifstream f(path);
+	if (!f.is_open()) {
+		return false;
+	}
+
+	uint32_t file = file_index(path);
+
+	// Loop over every mesh (they should be flat packed). Meshes follow format
+	// "name": [1, 2, 3, 4] // where each two numbers are a vertex
+	json mesh_data = json::parse(f);
+
+	MeshFile& mesh_file_data = files[file];
+	mesh_file_data.meshes.clear();
+
+	uint32_t lines_before = 0;
+	uint32_t lines_after = 0;
+	for (auto& mesh : mesh_data.items()) {
+		mesh_file_data.meshes.push_back(load_from(mesh.key(), mesh.value().get<vector<float>>(), file));
+		lines_before += last_load_stats.lines_before;
+		lines_after += last_load_stats.lines_after;
+	}
+
+	if (lines_after < lines_before) {
+		cout << "Mesh file " << path << ": saved " << (lines_before - lines_after) << " of " << lines_before << " lines" << endl;
+	}
+
+	mesh_file_data.resident = true;
+	mesh_file_data.refs++;
+	return true;
+}
+
+void MeshLibrary::load_manifest(const string& path) {
+	manifest.clear();
+
+	ifstream f(path);
+	if (!f.is_open()) {
+		// Not cooked, everything just gets loaded up front
+		return;
+	}
+
+	// "path": { "size": bytes, "meshes": { "name": [offset, length] } }
+	json data = json::parse(f);
+	for (auto& file : data.items()) {
+		ManifestFile& manifest_file = manifest[file.key()];
+		manifest_file.size = file.value().at("size").get<uint64_t>();
+
+		for (auto& mesh : file.value().at("meshes").items()) {
+			manifest_file.meshes.push_back(MeshManifestEntry{
+				mesh.key(),
+				mesh.value()[0].get<uint64_t>(),
+				mesh.value()[1].get<uint32_t>()
+			});
+		}
+	}
+
+	return;
+}
+
+void MeshLibrary::request(MeshId id) {
+	if (loaded[id] || requested[id] || lazy_source[id].file == MESH_FILE_NONE) {
+		return;
+	}
+
+	requested[id] = true;
+	request_queue.push_back(id);
+	return;
+}
+
+// One background load. Everything the thread needs is copied in here so it
+// never touches the library.
+struct MeshPrefetchJob {
+	struct Item {
+		MeshId id;
+		uint32_t file;
+		string path;
+		uint64_t offset;
+		uint32_t length;
+
+		// Filled by the thread
+		vector<MeshLine> lines;
+		MeshOptimizeStats stats;
+		string error;
+	};
+
+	vector<Item> items;
+};
+
+void MeshLibrary::update_streaming(LongThreadController& threads) {
+	if (prefetch_running || request_queue.empty()) {
+		return;
+	}
+
+	auto job = make_shared<MeshPrefetchJob>();
+	for (MeshId id : request_queue) {
+		const LazySource& source = lazy_source[id];
+		if (loaded[id] || source.file == MESH_FILE_NONE) {
+			// Got loaded some other way or its file went away since
+			requested[id] = false;
+			continue;
+		}
+
+		MeshPrefetchJob::Item item;
+		item.id = id;
+		item.file = source.file;
+		item.path = files[source.file].path;
+		item.offset = source.offset;
+		item.length = source.length;
+		job->items.push_back(move(item));
+	}
+	request_queue.clear();
+
+	if (job->items.empty()) {
+		return;
+	}
+
+	// Read each file front to back
+	sort(job->items.begin(), job->items.end(), [](const MeshPrefetchJob::Item& a, const MeshPrefetchJob::Item& b) {
+		return a.file != b.file ? a.file < b.file : a.offset < b.offset;
+	});
+
+	prefetch_running = true;
+	threads.launch("mesh_prefetch", any(),
+		[job](LongThreadState& state) {
+			state.max = (int)job->items.size();
+
+			ifstream f;
+			string open_path;
+			string text;
+			for (auto& item : job->items) {
+				if (state.exit_now) {
+					return;
+				}
+
+				try {
+					if (item.path != open_path) {
+						f = ifstream(item.path, ios::binary);
+						open_path = item.path;
+					}
+					if (!f.is_open()) {
+						throw runtime_error("could not open " + item.path);
+					}
+
+					// Just the array for this mesh, not the whole file
+					text.resize(item.length);
+					f.seekg(item.offset);
+					f.read(text.data(), item.length);
+					if ((uint64_t)f.gcount() != item.length) {
+						throw runtime_error("file is shorter than the manifest says, recook it");
+					}
+
+					item.lines = prepare_lines(json::parse(text).get<vector<float>>(), item.stats);
+				}
+				catch (const exception& e) {
+					item.error = e.what();
+					f.clear();
+				}
+
+				state.progress++;
+			}
+		},
+		[this, job, &threads]() {
+			finish_prefetch(*job, threads);
+		}
+	);
+
+	return;
+}
+
+void MeshLibrary::finish_prefetch(MeshPrefetchJob& job, LongThreadController& threads) {
+	for (auto& item : job.items) {
+		if (!item.error.empty()) {
+			// Leave it requested, it would only fail the same way again
+			threads.report_error("ERROR: Could not load mesh " + names[item.id] + ": " + item.error);
+			continue;
+		}
+
+		requested[item.id] = false;
+
+		// The file could have been thrown out, or the mesh loaded some other
+		// way, while we were busy
+		if (loaded[item.id] || lazy_source[item.id].file != item.file || !files[item.file].resident) {
+			continue;
+		}
+
+		report_savings(names[item.id], item.stats);
+		place(item.id, item.lines, item.file);
+	}
+
+	prefetch_running = false;
+	return;
+}
+
+void MeshLibrary::release_file(const string& path) {
+	auto it = file_ids.find(path);
+	if (it == file_ids.end() || files[it->second].refs == 0) {
+		return;
+	}
+
+	files[it->second].refs--;
+	return;
+}
+
+void MeshLibrary::collect_unused() {
+	bool evicted = false;
+	for (uint32_t file = 0; file < files.size(); file++) {
+		MeshFile& mesh_file_data = files[file];
+		if (!mesh_file_data.resident || mesh_file_data.refs > 0) {
+			continue;
+		}
+
+		for (MeshId id : mesh_file_data.meshes) {
+			if (lazy_source[id].file == file) {
+				lazy_source[id] = LazySource();
+			}
+
+			// Some later file might have loaded over it, that one owns it now
+			if (mesh_file[id] != file) {
+				continue;
+			}
+
+			// Back to how it was when it was interned. The id stays valid,
+			// it just renders as nothing until something loads it again.
+			table[id] = MeshEntry();
+			loaded[id] = false;
+			mesh_file[id] = MESH_FILE_NONE;
+		}
+
+		mesh_file_data.meshes.clear();
+		mesh_file_data.resident = false;
+		evicted = true;
+	}
+
+	if (!evicted) {
+		return;
+	}
+
+	// Pack everything that is left back together, in id order
+	vector<MeshLine> packed;
+	for (MeshEntry& entry : table) {
+		uint32_t first_line = (uint32_t)packed.size();
+		packed.insert(packed.end(), arena.begin() + entry.first_line, arena.begin() + entry.first_line + entry.line_count);
+		entry.first_line = first_line;
+	}
+	arena = move(packed);
+
+	version = next_version++;
+	return;
+}
@@ -0,0 +1,283 @@
+#pragma once
+
+// Holds every mesh that objects can use. Meshes are looked up by name exactly
+// once, when an object is created, and from then on objects only hold a MeshId
+// which is just an index into here. Rendering never hashes a string.
+//
+// Every line of every mesh lives in one flat array (the arena) and each mesh is
+// just a run of it, described by a small entry in the mesh table. Walking a
+// lot of different meshes then streams through one buffer, and the arena is
+// exactly what the gpu wants for the instanced path so it gets uploaded as is.
+// Nothing in here changes during the object update, so workers can read it.
+//
+// There is only one library for the whole process, held by the systems
+// controller, and every map uses it. Meshes are global anyway so there is no
+// point throwing them away and reparsing the same files on every map change.
+// Maps take a reference on the mesh files they use, files nobody uses anymore
+// are only thrown out when collect_unused is called, after the next map has
+// taken its references. Ids stay the same for the whole run.
+//
+// If there is a cooked mesh manifest (see cook_mesh_manifest in mesh_utils.h)
+// files in it are not parsed when a map takes them. The manifest says where
+// every mesh is in the file, and meshes are read in the background on a long
+// thread the first time something asks for them. Until then they render as
+// nothing. Maps with huge prop libraries only pay for what they use.
+
+#include "math_utils.h"
+
+#include <unordered_dense.h>
+
+#include <vector>
+#include <string>
+#include <span>
+#include <cstdint>
+
+// Index into the mesh library. 0 is always the empty mesh.
+typedef uint32_t MeshId;
+
+#define MESH_ID_EMPTY 0
+
+// Mesh was loaded by hand, not from a file
+#define MESH_FILE_NONE 0xFFFFFFFF
+
+// Where mesh files live by default, and where the cooked manifest for them goes
+#define MESH_DIRECTORY "gamedata/meshes/"
+#define MESH_MANIFEST_PATH "gamedata/meshes/mesh_manifest.json"
+
+class LongThreadController;
+struct MeshPrefetchJob;
+
+// Where one mesh is inside a mesh file
+struct MeshManifestEntry {
+	std::string name;
+
+	// Bytes from the start of the file to the opening [ of the mesh, and how
+	// many bytes up to and including the closing ]
+	uint64_t offset;
+	uint32_t length;
+};
+
+// One line of a mesh in mesh space. Layout matches the MeshLines SSBO in
+// vertex_lines_instanced.glsl, dont add anything to it.
+struct MeshLine {
+	vec2 from;
+	vec2 to;
+};
+
+static_assert(sizeof(MeshLine) == 16, "MeshLine has to match the std430 layout in the shader");
+
+// How many lines the mesh optimiser took a mesh from and to, see mesh_utils.h
+struct MeshOptimizeStats {
+	uint32_t lines_before = 0;
+	uint32_t lines_after = 0;
+};
+
+// Where a mesh is in the arena
+struct MeshEntry {
+	uint32_t first_line = 0;
+	uint32_t line_count = 0;
+
+	// Bounding box of the mesh in mesh space, before scale and position.
+	// Worked out once when the mesh is loaded.
+	vec2 bounds_from;
+	vec2 bounds_to;
+};
+
+// The lines of one mesh, pointing into the arena. Only valid until the next
+// mesh is loaded.
+struct MeshSpan {
+	std::span<const MeshLine> lines;
+
+	vec2 bounds_from;
+	vec2 bounds_to;
+};
+
+// How many objects can be drawn through the instanced path in one frame
+#define MAX_LINE_INSTANCES 8192
+
+// One object drawn with the instanced line path. Instead of transforming every
+// vertex on the cpu, objects just say where their mesh goes and the line
+// shader does the rest. Layout matches the LineInstances SSBO in
+// vertex_lines_instanced.glsl (std430), dont reorder.
+struct LineInstance {
+	vec2 position; // NDC position of the mesh origin
+	vec2 scale; // render scale, still in native pixels
+	float rotation; // Radians
+	uint32_t material; // Line palette index, only the low 16 bits are used
+	uint32_t first_line; // Where the mesh starts in the packed mesh lines
+	uint32_t pad;
+};
+
+static_assert(sizeof(LineInstance) == 32, "LineInstance has to match the std430 layout in the shader");
+
+// Run of instances that all use the same mesh, drawn with one call
+struct LineInstanceBatch {
+	uint32_t line_count;
+	uint32_t first_instance;
+	uint32_t instance_count;
+};
+
+class MeshLibrary {
+public:
+	MeshLibrary();
+
+	// Not copyable, objects hold pointers to this through the io
+	MeshLibrary(const MeshLibrary&) = delete;
+	MeshLibrary& operator=(const MeshLibrary&) = delete;
+
+	// Get the id for a mesh name. If the name has not been seen yet it gets a
+	// new empty slot that is filled when the mesh is loaded, so objects can be
+	// created before the mesh files are read.
+	MeshId intern(const std::string& name);
+
+	// Set the vertex data for a mesh, interning the name if needed. verts is
+	// flat packed like the mesh files, each two floats are a vertex and each
+	// two vertices are a line.
+	MeshId load(const std::string& name, const std::vector<float>& verts);
+
+	// Take a reference on a mesh file, parsing it only if it is not already
+	// resident. Returns false if it is not resident and cant be opened, throws
+	// if it opens but is not valid. Files in the manifest are not parsed at
+	// all, their meshes are loaded when requested.
+	bool acquire_file(const std::string& path);
+
+	// Read the cooked manifest. Without one, or for files that changed since
+	// it was cooked, acquire_file parses the whole file up front.
+	void load_manifest(const std::string& path);
+
+	// Ask for a mesh to be loaded in the background. Does nothing if it is
+	// loaded, already asked for, or not in any resident file, so it is fine to
+	// call every frame. Main thread only.
+	void request(MeshId id);
+
+	// Start a background load for everything requested since the last one.
+	// Finished loads are put in by the long thread controller's update, call
+	// this before that. Main thread only, never during the object update.
+	void update_streaming(LongThreadController& threads);
+
+	// Give a reference back. The file stays resident until collect_unused.
+	void release_file(const std::string& path);
+
+	// Throw out every file nobody holds a reference to and pack the arena
+	// back together. Call once a map change is done.
+	void collect_unused();
+
+	// Resolve the lines of a mesh. Do this once per object per frame, not per
+	// vertex.
+	MeshSpan get(MeshId id) const {
+		const MeshEntry& entry = table[id];
+		return MeshSpan{
+			std::span<const MeshLine>(arena.data() + entry.first_line, entry.line_count),
+			entry.bounds_from, entry.bounds_to
+		};
+	}
+
+	const MeshEntry& entry(MeshId id) const {
+		return table[id];
+	}
+
+	const std::string& name(MeshId id) const {
+		return names[id];
+	}
+
+	// Was this mesh ever given data. Interned but never loaded meshes render
+	// as nothing.
+	bool is_loaded(MeshId id) const {
+		return loaded[id];
+	}
+
+	// Loaded, or in a resident file and can be loaded when asked for
+	bool is_available(MeshId id) const {
+		return loaded[id] || lazy_source[id].file != MESH_FILE_NONE;
+	}
+
+	size_t size() const {
+		return table.size();
+	}
+
+	// Every mesh back to back, this is what gets uploaded to the gpu for the
+	// instanced path.
+	const std::vector<MeshLine>& get_lines() const {
+		return arena;
+	}
+
+	// Changes every time the arena changes, unique across every library so a
+	// new map always gets reuploaded.
+	uint32_t get_version() const {
+		return version;
+	}
+
+	// First line of a mesh in the arena
+	uint32_t first_line(MeshId id) const {
+		return table[id].first_line;
+	}
+
+private:
+	// Hot, touched by rendering and culling
+	std::vector<MeshLine> arena;
+	std::vector<MeshEntry> table;
+
+	// Cold, only for loading and error messages
+	std::vector<std::string> names;
+	std::vector<bool> loaded;
+
+	// File each mesh was last loaded from, MESH_FILE_NONE if by hand
+	std::vector<uint32_t> mesh_file;
+
+	struct MeshFile {
+		std::string path;
+		uint32_t refs = 0;
+		bool resident = false;
+		std::vector<MeshId> meshes;
+	};
+
+	std::vector<MeshFile> files;
+	ankerl::unordered_dense::map<std::string, uint32_t> file_ids;
+
+	// Load a mesh and say which file it came from. Runs the mesh optimiser
+	// over it first.
+	MeshId load_from(const std::string& name, const std::vector<float>& verts, uint32_t file);
+
+	// What the optimiser did to the last mesh loaded
+	MeshOptimizeStats last_load_stats;
+
+	// Copy already optimised lines into the arena
+	void place(MeshId id, const std::vector<MeshLine>& lines, uint32_t file);
+
+	// Index of a file, adding it if we have never seen it
+	uint32_t file_index(const std::string& path);
+
+	// ---- Lazy loading ----
+
+	// Where a not yet loaded mesh can be read from
+	struct LazySource {
+		uint32_t file = MESH_FILE_NONE;
+		uint64_t offset = 0;
+		uint32_t length = 0;
+	};
+
+	std::vector<LazySource> lazy_source;
+
+	// Queued or loading. Meshes that failed to load stay requested so they
+	// dont get queued again every frame.
+	std::vector<bool> requested;
+	std::vector<MeshId> request_queue;
+
+	// Only one background load at a time, long threads need unique names
+	bool prefetch_running = false;
+
+	// Put in whatever the background load finished, failures get reported
+	// to the threads' error reporter
+	void finish_prefetch(MeshPrefetchJob& job, LongThreadController& threads);
+
+	struct ManifestFile {
+		uint64_t size = 0;
+		std::vector<MeshManifestEntry> meshes;
+	};
+
+	ankerl::unordered_dense::map<std::string, ManifestFile> manifest;
+
+	uint32_t version = 0;
+
+	ankerl::unordered_dense::map<std::string, MeshId> ids;
+};
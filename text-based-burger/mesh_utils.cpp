@@ -0,0 +1,318 @@
+#include "mesh_utils.h"
+
+#include <unordered_dense.h>
+
+#include "json.hpp"
+using json = nlohmann::json;
+
+#include <cmath>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std;
+
+// Welded line between two vertex indices
+struct MeshEdge {
+	uint32_t a;
+	uint32_t b;
+	bool alive;
+};
+
+static uint64_t edge_key(uint32_t a, uint32_t b) {
+	// Same key both ways round so a->b and b->a are duplicates
+	if (a > b) {
+		swap(a, b);
+	}
+	return ((uint64_t)a << 32) | b;
+}
+
+static uint64_t weld_cell_key(int cell_x, int cell_y) {
+	return ((uint64_t)(uint32_t)cell_x << 32) | (uint32_t)cell_y;
+}
+
+// Find or add a vertex. Vertices are bucketed in a grid of weld sized cells so
+// anything close enough has to be in one of the 9 cells around it.
+static uint32_t weld_vertex(vec2 position, vector<vec2>& vertices,
+	ankerl::unordered_dense::map<uint64_t, vector<uint32_t>>& cells) {
+
+	int cell_x = (int)floor(position.x / MESH_WELD_DISTANCE);
+	int cell_y = (int)floor(position.y / MESH_WELD_DISTANCE);
+
+	for (int dx = -1; dx <= 1; dx++) {
+		for (int dy = -1; dy <= 1; dy++) {
+			auto it = cells.find(weld_cell_key(cell_x + dx, cell_y + dy));
+			if (it == cells.end()) {
+				continue;
+			}
+
+			for (uint32_t vertex : it->second) {
+				vec2 diff = vertices[vertex] - position;
+				if (diff.x * diff.x + diff.y * diff.y <= MESH_WELD_DISTANCE * MESH_WELD_DISTANCE) {
+					return vertex;
+				}
+			}
+		}
+	}
+
+	uint32_t vertex = (uint32_t)vertices.size();
+	vertices.push_back(position);
+	cells[weld_cell_key(cell_x, cell_y)].push_back(vertex);
+	return vertex;
+}
+
+MeshOptimizeStats optimize_mesh_lines(vector<MeshLine>& lines) {
+	MeshOptimizeStats stats;
+	stats.lines_before = (uint32_t)lines.size();
+
+	// Weld, drop zero length and duplicate lines
+
+	vector<vec2> vertices;
+	ankerl::unordered_dense::map<uint64_t, vector<uint32_t>> cells;
+
+	vector<MeshEdge> edges;
+	ankerl::unordered_dense::set<uint64_t> edge_keys;
+
+	for (const MeshLine& line : lines) {
+		uint32_t a = weld_vertex(line.from, vertices, cells);
+		uint32_t b = weld_vertex(line.to, vertices, cells);
+
+		if (a == b) {
+			continue; // Zero length
+		}
+		if (!edge_keys.insert(edge_key(a, b)).second) {
+			continue; // Already have this one
+		}
+
+		edges.push_back(MeshEdge{ a, b, true });
+	}
+
+	// Which edges touch each vertex
+	vector<vector<uint32_t>> vertex_edges(vertices.size());
+	for (uint32_t edge = 0; edge < edges.size(); edge++) {
+		vertex_edges[edges[edge].a].push_back(edge);
+		vertex_edges[edges[edge].b].push_back(edge);
+	}
+
+	auto other_end = [&](uint32_t edge, uint32_t vertex) {
+		return edges[edge].a == vertex ? edges[edge].b : edges[edge].a;
+	};
+
+	auto remove_vertex_edge = [&](uint32_t vertex, uint32_t edge) {
+		vector<uint32_t>& list = vertex_edges[vertex];
+		for (size_t i = 0; i < list.size(); i++) {
+			if (list[i] == edge) {
+				list[i] = list.back();
+				list.pop_back();
+				return;
+			}
+		}
+	};
+
+	// Merge straight runs. A vertex can only go if exactly two lines meet at
+	// it and it sits between their other ends, anything else is a corner or
+	// a junction and has to stay.
+
+	for (uint32_t vertex = 0; vertex < vertices.size(); vertex++) {
+		if (vertex_edges[vertex].size() != 2) {
+			continue;
+		}
+
+		uint32_t keep = vertex_edges[vertex][0];
+		uint32_t drop = vertex_edges[vertex][1];
+		uint32_t a = other_end(keep, vertex);
+		uint32_t b = other_end(drop, vertex);
+		if (a == b) {
+			continue;
+		}
+
+		vec2 to_a = vertices[a] - vertices[vertex];
+		vec2 to_b = vertices[b] - vertices[vertex];
+		float len_a = to_a.mag();
+		float len_b = to_b.mag();
+
+		// Has to point opposite ways and be straight
+		if (to_a.dot(to_b) >= 0.0f || fabs(to_a.cross(to_b)) > MESH_COLLINEAR_TOLERANCE * len_a * len_b) {
+			continue;
+		}
+
+		edge_keys.erase(edge_key(vertex, a));
+		edge_keys.erase(edge_key(vertex, b));
+		vertex_edges[vertex].clear();
+
+		edges[drop].alive = false;
+		remove_vertex_edge(b, drop);
+
+		if (!edge_keys.insert(edge_key(a, b)).second) {
+			// a to b was already there on its own, the run was a duplicate
+			edges[keep].alive = false;
+			remove_vertex_edge(a, keep);
+			continue;
+		}
+
+		edges[keep].a = a;
+		edges[keep].b = b;
+		vertex_edges[b].push_back(keep);
+	}
+
+	// Reorder so connected lines are next to each other. Walk paths starting
+	// from ends and junctions first, then whatever is left is closed loops.
+
+	vector<bool> visited(edges.size(), false);
+	vector<MeshLine> ordered;
+	ordered.reserve(edges.size());
+
+	auto walk_from = [&](uint32_t vertex) {
+		while (true) {
+			uint32_t next_edge = UINT32_MAX;
+			for (uint32_t edge : vertex_edges[vertex]) {
+				if (edges[edge].alive && !visited[edge]) {
+					next_edge = edge;
+					break;
+				}
+			}
+			if (next_edge == UINT32_MAX) {
+				return;
+			}
+
+			visited[next_edge] = true;
+			uint32_t next_vertex = other_end(next_edge, vertex);
+			ordered.push_back(MeshLine{ vertices[vertex], vertices[next_vertex] });
+			vertex = next_vertex;
+		}
+	};
+
+	for (uint32_t vertex = 0; vertex < vertices.size(); vertex++) {
+		if (vertex_edges[vertex].size() != 2) {
+			// Junctions have more than one path leaving them
+			for (size_t i = 0; i < vertex_edges[vertex].size(); i++) {
+				walk_from(vertex);
+			}
+		}
+	}
+	for (uint32_t vertex = 0; vertex < vertices.size(); vertex++) {
+		walk_from(vertex);
+	}
+
+	lines = move(ordered);
+
+	stats.lines_after = (uint32_t)lines.size();
+	return stats;
+}
+
+vector<MeshManifestEntry> index_mesh_file(const string& text) {
+	vector<MeshManifestEntry> entries;
+	size_t pos = 0;
+
+	auto skip_space = [&]() {
+		while (pos < text.size() && isspace((unsigned char)text[pos])) {
+			pos++;
+		}
+	};
+
+	auto expect = [&](char c) {
+		skip_space();
+		if (pos >= text.size() || text[pos] != c) {
+			throw runtime_error(string("expected '") + c + "' at byte " + to_string(pos));
+		}
+		pos++;
+	};
+
+	expect('{');
+	skip_space();
+	if (pos < text.size() && text[pos] == '}') {
+		return entries; // Empty file
+	}
+
+	while (true) {
+		// Name, mesh names dont have anything fancy in them but dont choke on
+		// escapes anyway
+		expect('"');
+		string name;
+		while (pos < text.size() && text[pos] != '"') {
+			if (text[pos] == '\\' && pos + 1 < text.size()) {
+				pos++;
+			}
+			name += text[pos++];
+		}
+		expect('"');
+		expect(':');
+
+		// Array of numbers, no nesting
+		skip_space();
+		if (pos >= text.size() || text[pos] != '[') {
+			throw runtime_error("mesh " + name + " is not an array");
+		}
+		size_t start = pos;
+		size_t end = text.find(']', start);
+		if (end == string::npos) {
+			throw runtime_error("mesh " + name + " never ends");
+		}
+		pos = end + 1;
+
+		entries.push_back(MeshManifestEntry{ name, (uint64_t)start, (uint32_t)(end - start + 1) });
+
+		skip_space();
+		if (pos < text.size() && text[pos] == ',') {
+			pos++;
+			continue;
+		}
+		expect('}');
+		break;
+	}
+
+	return entries;
+}
+
+void cook_mesh_manifest(const string& directory, const string& manifest_path) {
+	json manifest = json::object();
+
+	for (const auto& dir_entry : filesystem::directory_iterator(directory)) {
+		if (!dir_entry.is_regular_file() || dir_entry.path().extension() != ".json") {
+			continue;
+		}
+
+		// Same path the objects handler builds, so the library can find it
+		string path = directory + dir_entry.path().filename().string();
+		if (path == manifest_path) {
+			continue;
+		}
+
+		// Binary so offsets are real byte offsets, no newline translation
+		ifstream f(path, ios::binary);
+		if (!f.is_open()) {
+			throw runtime_error("Could not open mesh file " + path);
+		}
+		stringstream buffer;
+		buffer << f.rdbuf();
+		string text = buffer.str();
+
+		vector<MeshManifestEntry> entries;
+		try {
+			entries = index_mesh_file(text);
+		}
+		catch (const exception& e) {
+			throw runtime_error("Could not index mesh file " + path + ": " + e.what());
+		}
+
+		json meshes = json::object();
+		for (const MeshManifestEntry& entry : entries) {
+			meshes[entry.name] = { entry.offset, entry.length };
+		}
+
+		manifest[path] = {
+			{"size", (uint64_t)text.size()},
+			{"meshes", meshes}
+		};
+	}
+
+	ofstream out(manifest_path);
+	if (!out.is_open()) {
+		throw runtime_error("Could not write mesh manifest " + manifest_path);
+	}
+	out << manifest.dump(4);
+
+	return;
+}
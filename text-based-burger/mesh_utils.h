@@ -0,0 +1,43 @@
+#pragma once
+
+// Mesh utils, cleaning up meshes so less lines have to be drawn.
+//
+// Mesh files are just line soups. Anything drawn by hand or saved from the
+// line canvas ends up with the same endpoint written slightly differently,
+// lines drawn twice, and long straight edges made of a bunch of short lines.
+// None of that looks any different on screen but every extra line still goes
+// through the renderer.
+
+#include "mesh_library.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Endpoints closer than this (mesh units, so native pixels at scale 1) are
+// the same vertex
+#define MESH_WELD_DISTANCE 0.01f
+
+// How far off straight two lines can be and still get merged, this is the sine
+// of the angle between them
+#define MESH_COLLINEAR_TOLERANCE 0.0005f
+
+// Clean up a mesh in place:
+// - weld endpoints within MESH_WELD_DISTANCE of each other
+// - remove zero length lines and lines that are drawn more than once
+// - merge straight runs through vertices that only join those two lines
+// - reorder so connected lines come one after another
+// Lines can come out pointing the other way, they are drawn the same either
+// way.
+MeshOptimizeStats optimize_mesh_lines(std::vector<MeshLine>& lines);
+
+// Find where every mesh is in the text of a mesh file without parsing any of
+// the numbers. Mesh files have to be one flat object of "name": [numbers],
+// throws if it is anything else.
+std::vector<MeshManifestEntry> index_mesh_file(const std::string& text);
+
+// Index every mesh file in a directory and write the manifest the mesh library
+// uses for lazy loading. This is the cook step, run it again whenever mesh
+// files change. Files that changed since are noticed by size and just get
+// loaded the slow way until then. Throws if anything cant be read or written.
+void cook_mesh_manifest(const std::string& directory, const std::string& manifest_path);
@@ -0,0 +1,141 @@
+#include "object_benchmark.h"
+#include "systems_controller.h"
+#include "game_object.h"
+#include "entity_store.h"
+#include "mesh_library.h"
+
+#include <iostream>
+#include <chrono>
+#include <array>
+#include <vector>
+
+using namespace std;
+
+static json bench_object_data(const string& targetname) {
+	return json::object({
+		{"targetname", targetname},
+		{"position", {0, 0}},
+		{"scale", {1, 1}},
+		{"mesh", ""},
+		{"color", 0},
+		{"update_script", "none"}
+	});
+}
+
+int run_object_update_benchmark(SystemsController& controller, long long object_count, long long frames) {
+	if (object_count <= 0) {
+		cout << "Need at least one object to benchmark" << endl;
+		return -1;
+	}
+	if (frames < 0) {
+		frames = BENCH_UPDATE_DEFAULT_FRAMES;
+	}
+
+	// Same setup the handler does, minus the map. Nothing in here wakes,
+	// spawns or destroys so the io never needs a handler. None of the objects
+	// have a mesh so they get their own library.
+	ObjectIO io(controller);
+	MeshLibrary meshes;
+	EntityStore entities;
+	io.entities = &entities;
+	io.meshes = &meshes;
+	io.handler = nullptr;
+
+	// Declared after the store so the objects go before it does
+	ObjectPools pools;
+	vector<PooledObject> objects;
+	entities.reserve(object_count);
+	objects.reserve(object_count);
+
+	// The view controls need something to follow
+	objects.push_back(object_type_selector("npc", bench_object_data("bench_npc"), io, pools));
+	io.register_object("bench_npc", objects.back().get());
+
+	json view_control_data = json::object({
+		{"controller_num", 0},
+		{"follow_target", "bench_npc"},
+		{"mode", 2}
+	});
+
+	// xorshift with a fixed seed so every run gets the same mix, and the
+	// order is random enough that the branch predictor cant learn it
+	uint32_t seed = 0x9E3779B9;
+	long long type_counts[3] = { 0, 1, 0 };
+	for (long long i = 1; i < object_count; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		int roll = seed % 100;
+		string targetname = "bench_" + to_string(i);
+		if (roll < 50) {
+			objects.push_back(object_type_selector("generic", bench_object_data(targetname), io, pools));
+			type_counts[0]++;
+		}
+		else if (roll < 85) {
+			objects.push_back(object_type_selector("npc", bench_object_data(targetname), io, pools));
+			type_counts[1]++;
+		}
+		else {
+			objects.push_back(object_type_selector("point_view_control", view_control_data, io, pools));
+			type_counts[2]++;
+		}
+	}
+
+	// Same buckets the handler keeps
+	array<vector<GameObject*>, ObjectTypes::count> buckets;
+	for (const PooledObject& object : objects) {
+		buckets[object->type_index].push_back(object.get());
+	}
+
+	ObjectUpdateData data = {};
+	data.frame_time = 1.0f / 60.0f;
+
+	// The three ways are interleaved every frame so they all see the same
+	// cache and clock conditions
+	double seconds_spawn_order = 0.0;
+	double seconds_by_type = 0.0;
+	double seconds_batched = 0.0;
+
+	for (long long frame = 0; frame < frames; frame++) {
+		data.time = frame * data.frame_time;
+
+		auto start = chrono::steady_clock::now();
+		for (const PooledObject& object : objects) {
+			object->update(data);
+		}
+		auto after_spawn_order = chrono::steady_clock::now();
+
+		for (const auto& bucket : buckets) {
+			for (GameObject* object : bucket) {
+				object->update(data);
+			}
+		}
+		auto after_by_type = chrono::steady_clock::now();
+
+		for (size_t type = 0; type < ObjectTypes::count; type++) {
+			ObjectTypes::batch_updates[type](buckets[type].data(), buckets[type].size(), data);
+		}
+		auto after_batched = chrono::steady_clock::now();
+
+		seconds_spawn_order += chrono::duration<double>(after_spawn_order - start).count();
+		seconds_by_type += chrono::duration<double>(after_by_type - after_spawn_order).count();
+		seconds_batched += chrono::duration<double>(after_batched - after_by_type).count();
+	}
+
+	double updates = (double)object_count * frames;
+	cout << object_count << " objects (" << type_counts[0] << " generic, " << type_counts[1] << " npc, "
+		<< type_counts[2] << " point_view_control), " << frames << " frames" << endl;
+	if (frames > 0) {
+		cout << "  virtual, spawn order: " << seconds_spawn_order * 1e9 / updates << " ns per object" << endl;
+		cout << "  virtual, by type:     " << seconds_by_type * 1e9 / updates << " ns per object" << endl;
+		cout << "  batched by type:      " << seconds_batched * 1e9 / updates << " ns per object" << endl;
+	}
+
+	// Anything the objects complained about means the numbers are off
+	for (const string& error : io.get_log()) {
+		cout << "  " << error << endl;
+	}
+
+	return 0;
+}
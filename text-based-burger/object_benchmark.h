@@ -0,0 +1,34 @@
+#pragma once
+
+// Per object update cost with a mix of object types, so changes to how the
+// handler updates objects can be measured instead of guessed at.
+//
+// --bench-update N makes N objects with the real constructors and pools, types
+// interleaved in spawn order like a map would have them:
+// - half generic
+// - 35% npc
+// - 15% point_view_control, following one of the npcs
+// Then every frame it updates all of them three ways and prints the average
+// cost per object of each:
+// - virtual, spawn order: a virtual call per object in the order they were
+//   made. This is what the handler did before the per type buckets.
+// - virtual, by type: still a virtual call each, but bucketed by type like
+//   the handler does now. Shows how much is just the branch predictor
+//   seeing the same type over and over.
+// - batched by type: ObjectTypes::batch_updates on every bucket, which is
+//   what the handler actually runs.
+// All on one thread with no command buffer, the worker pool is left out so
+// only the dispatch is measured. The objects dont do much in their updates
+// (they mostly go to sleep) so this is nearly all dispatch cost, real updates
+// add their own work on top of it.
+//
+// --frames sets how many frames, BENCH_UPDATE_DEFAULT_FRAMES if not given.
+
+// Frames to run if --frames is not given
+#define BENCH_UPDATE_DEFAULT_FRAMES 200
+
+class SystemsController;
+
+// Run the benchmark and print the results. frames below 0 uses the default.
+// Returns the exit code for main.
+int run_object_update_benchmark(SystemsController& controller, long long object_count, long long frames);
@@ -0,0 +1,108 @@
+#pragma once
+
+// Header only pool allocator for game objects. Every spawnable type gets its
+// own pool, objects are placement newed into fixed size blocks and destroyed
+// slots go on a free list to be reused. Spawning and destroying thousands of
+// short lived things (bullets, effects, corpses) then never touches the heap
+// once the pool has grown big enough, and objects of one type end up next to
+// each other in memory.
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+class GameObject;
+
+class ObjectPoolBase {
+public:
+	virtual ~ObjectPoolBase() = default;
+
+	// Destroy an object that came from this pool and free its slot
+	virtual void release(GameObject* object) = 0;
+};
+
+// unique_ptr deleter that gives the object back to the pool it came from
+struct PooledObjectDeleter {
+	ObjectPoolBase* pool = nullptr;
+
+	void operator()(GameObject* object) const {
+		pool->release(object);
+	}
+};
+
+typedef std::unique_ptr<GameObject, PooledObjectDeleter> PooledObject;
+
+template <typename T, size_t BLOCK_SIZE = 128>
+class ObjectPool : public ObjectPoolBase {
+public:
+	ObjectPool() = default;
+
+	// Objects point back at us through their deleter
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	// Every object has to be released before the pool goes away, the handler
+	// makes sure of that by declaring the pools before the objects.
+	~ObjectPool() override = default;
+
+	template <typename... Args>
+	PooledObject create(Args&&... args) {
+		Slot* slot = grab_slot();
+
+		T* object;
+		try {
+			object = new (slot->bytes) T(std::forward<Args>(args)...);
+		}
+		catch (...) {
+			// Constructor blew up, slot is still free
+			free_slots.push_back(slot);
+			throw;
+		}
+
+		live_count++;
+		return PooledObject(object, PooledObjectDeleter{ this });
+	}
+
+	void release(GameObject* object) override {
+		T* typed = static_cast<T*>(object);
+		typed->~T();
+
+		free_slots.push_back(reinterpret_cast<Slot*>(typed));
+		live_count--;
+	}
+
+	size_t get_live_count() const {
+		return live_count;
+	}
+
+	size_t get_capacity() const {
+		return blocks.size() * BLOCK_SIZE;
+	}
+
+private:
+	struct Slot {
+		alignas(T) unsigned char bytes[sizeof(T)];
+	};
+
+	Slot* grab_slot() {
+		if (free_slots.empty()) {
+			// Out of room, add a block and put all of it on the free list.
+			// Pushed backwards so slots get handed out front to back.
+			blocks.push_back(std::make_unique<Slot[]>(BLOCK_SIZE));
+			Slot* block = blocks.back().get();
+			for (size_t i = BLOCK_SIZE; i > 0; i--) {
+				free_slots.push_back(&block[i - 1]);
+			}
+		}
+
+		Slot* slot = free_slots.back();
+		free_slots.pop_back();
+		return slot;
+	}
+
+	std::vector<std::unique_ptr<Slot[]>> blocks;
+	std::vector<Slot*> free_slots;
+	size_t live_count = 0;
+};
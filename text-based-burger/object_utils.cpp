@@ -1,12 +1,16 @@
 #include "object_utils.h"
 #include "game_object.h"
 #include "systems_controller.h"
+#include "game_object_handler.h"
 
 using namespace std;
 
 // This is NOT double work with the ui equivalent, these two classes just happen to behave similrly
 // These two are distnct classes and should not be assumed to have interoperability
 
+// Buffer the current thread is recording into, if any
+static thread_local ObjectCommandBuffer* recording_commands = nullptr;
+
 ObjectIO::ObjectIO(SystemsController& new_controller) : controller(new_controller) {
 	// Reporters will always start with an empty log
 	error_log = vector<string>();
@@ -19,6 +23,11 @@ ObjectIO::~ObjectIO() {
 }
 
 void ObjectIO::report_error(string error) {
+	if (recording_commands) {
+		recording_commands->push_back(ObjectCommand{ OBJECT_COMMAND_ERROR, move(error) });
+		return;
+	}
+
 	// Check if the previous reported error is the same as the current one
 	if (!error_log.empty() && error_log.back() == error) {
 		// If it is, increment the repeat counter
@@ -40,27 +49,49 @@ vector<int> ObjectIO::get_repeats() {
 }
 
 void ObjectIO::register_object(string name, GameObject* object) {
-	// First check if the component is already registered
-	if (object_registry.find(name) != object_registry.end()) {
+	// Try to register, this only inserts if the name is not taken yet
+	auto [it, inserted] = object_registry.try_emplace(name, object->handle());
+	if (!inserted) {
 		// If it is, report an error
 		// this should never happen and will be a nightmare to debug
 		report_error("FATAL: Tried to register object " + name + " twice");
 		return;
 	}
 
-	object_registry[name] = object;
 	return;
 }
 
-GameObject* ObjectIO::get_object(string name) {
-	// Check if the target component is registered
-	if (object_registry.find(name) == object_registry.end()) {
-		// If it is not, report an error
+void ObjectIO::unregister_object(const string& name, EntityHandle handle) {
+	auto it = object_registry.find(name);
+	if (it != object_registry.end() && it->second == handle) {
+		object_registry.erase(it);
+	}
+	return;
+}
+
+EntityHandle ObjectIO::find_object(const string& name) {
+	auto it = object_registry.find(name);
+	if (it == object_registry.end()) {
+		return EntityHandle();
+	}
+	return it->second;
+}
+
+GameObject* ObjectIO::get_object(EntityHandle handle) {
+	return entities->resolve(handle);
+}
+
+GameObject* ObjectIO::get_object(const string& name) {
+	GameObject* object = get_object(find_object(name));
+	if (object == nullptr) {
+		// Either never registered or it has been destroyed since
 		report_error("FATAL: Tried to get unregistered object " + name);
 		return nullptr;
 	}
-	// Get the target component
-	return object_registry[name];
+
+	// A script is about to do something with it, so it should be awake
+	object->wake();
+	return object;
 }
 
 vector<string> split_file_path(string path) {
@@ -76,7 +107,82 @@ vector<string> split_file_path(string path) {
 }
 
 void ObjectIO::call_script(string script_name, json args) {
+	if (recording_commands) {
+		recording_commands->push_back(ObjectCommand{ OBJECT_COMMAND_SCRIPT, move(script_name), move(args) });
+		return;
+	}
+
 	// Call a script with the given name and arguments
 	controller.call_script(script_name, args);
 	return;
+}
+
+void ObjectIO::move_object(EntityHandle handle, vec2 velocity) {
+	if (recording_commands) {
+		ObjectCommand command{ OBJECT_COMMAND_MOVE };
+		command.target = handle;
+		command.velocity = velocity;
+		recording_commands->push_back(move(command));
+		return;
+	}
+
+	GameObject* object = get_object(handle);
+	if (object == nullptr) {
+		report_error("ERROR: Tried to move an object that does not exist anymore");
+		return;
+	}
+	object->move(velocity);
+	object->wake();
+	return;
+}
+
+EntityHandle ObjectIO::spawn(const string& type, const json& params) {
+	if (recording_commands) {
+		recording_commands->push_back(ObjectCommand{ OBJECT_COMMAND_SPAWN, type, params });
+		return EntityHandle();
+	}
+
+	return handler->spawn(type, params);
+}
+
+void ObjectIO::destroy(EntityHandle handle) {
+	if (recording_commands) {
+		ObjectCommand command{ OBJECT_COMMAND_DESTROY };
+		command.target = handle;
+		recording_commands->push_back(move(command));
+		return;
+	}
+
+	handler->destroy(handle);
+	return;
+}
+
+void ObjectIO::set_command_buffer(ObjectCommandBuffer* buffer) {
+	recording_commands = buffer;
+	return;
+}
+
+void ObjectIO::apply_commands(ObjectCommandBuffer& commands) {
+	for (auto& command : commands) {
+		switch (command.type) {
+		case OBJECT_COMMAND_SCRIPT:
+			call_script(command.text, move(command.args));
+			break;
+		case OBJECT_COMMAND_ERROR:
+			report_error(move(command.text));
+			break;
+		case OBJECT_COMMAND_MOVE:
+			move_object(command.target, command.velocity);
+			break;
+		case OBJECT_COMMAND_SPAWN:
+			spawn(command.text, command.args);
+			break;
+		case OBJECT_COMMAND_DESTROY:
+			destroy(command.target);
+			break;
+		}
+	}
+
+	commands.clear();
+	return;
 }
\ No newline at end of file
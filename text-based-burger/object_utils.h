@@ -1,13 +1,14 @@
 #pragma once
 
 // For keyboard and mouse input
-#include <GLFW/glfw3.h>
+#include "input.h"
 
 #include "json.hpp"
 using json = nlohmann::json;
 
 #include <unordered_dense.h>
 #include "math_utils.h"
+#include "entity_store.h"
 
 #include <vector>
 #include <string>
@@ -16,6 +17,8 @@ using json = nlohmann::json;
 // Forward declaration
 class GameObject;
 class SystemsController;
+class ObjectsHandler;
+class MeshLibrary;
 
 // Update data struct for the object system
 struct ObjectUpdateData {
@@ -25,8 +28,8 @@ struct ObjectUpdateData {
 	bool is_clicking;
 	vec2 scroll_delta;
 
-	// Pointer to actual window, do whatever you want with it
-	GLFWwindow* window;
+	// Keys held down this frame
+	InputState input;
 
 	vec2 camera_pos;
 };
@@ -35,8 +38,41 @@ struct ObjectUpdateData {
 // objects to be used by other systems.
 struct ObjectUpdateReturnData {
 	vec2 camera_pos; // Camera position after update
+
+	// Something recorded a command or got woken this frame. If not the
+	// objects did nothing the frame limiter needs to know about.
+	bool objects_active = false;
+};
+
+// Things objects want to do to the world outside of themselves while they are
+// being updated in parallel. These get recorded instead of done right away and
+// applied by the handler once every object is done, in object order, so the
+// result is the same no matter which thread updated what.
+enum ObjectCommandType {
+	OBJECT_COMMAND_SCRIPT, // call_script(text, args)
+	OBJECT_COMMAND_ERROR, // report_error(text)
+	OBJECT_COMMAND_MOVE, // target->move(velocity)
+	OBJECT_COMMAND_SPAWN, // spawn(text, args)
+	OBJECT_COMMAND_DESTROY // destroy(target)
+};
+
+struct ObjectCommand {
+	ObjectCommandType type;
+
+	// Script name, error message or type to spawn
+	std::string text;
+	json args;
+
+	EntityHandle target;
+	vec2 velocity;
+
+	ObjectCommand(ObjectCommandType type, std::string text = "", json args = json())
+		: type(type), text(std::move(text)), args(std::move(args)) {}
 };
 
+// One of these per chunk of objects in the parallel update
+typedef std::vector<ObjectCommand> ObjectCommandBuffer;
+
 // Objects all hold a pointer to an instance of this class and use it to call
 // scripts, report errors etc. Basically the same as the UIComponentIO class but
 // for game objects. Only reason it isnt reused is because of system specific
@@ -54,18 +90,62 @@ public:
 
 	void register_object(std::string name, GameObject* object);
 
-	// This should only be used by the script system
-	GameObject* get_object(std::string name);
+	// Remove a name, but only if it still points at this handle. Another
+	// object might have taken the name since.
+	void unregister_object(const std::string& name, EntityHandle handle);
+
+	// Look up the handle for a targetname. This is the only thing that goes
+	// through the name registry, do it once when you bind to something and
+	// keep the handle. Returns a null handle if there is no such object.
+	EntityHandle find_object(const std::string& name);
+
+	// Get the object a handle points to, nullptr if it is null or the object
+	// is gone. No lookups, fine to call every frame.
+	GameObject* get_object(EntityHandle handle);
+
+	// Find and get in one go, reports an error if it does not exist. This
+	// should only be used by the script system. Wakes the object up if it
+	// was sleeping.
+	GameObject* get_object(const std::string& name);
 
 	void call_script(std::string script_name, json args);
 
-	// Points to the meshes data. The actual one is held by the handler
-	ankerl::unordered_dense::map<std::string, std::vector<float>>* meshes;
+	// Move some other object. Use this instead of calling move on it directly
+	// so it is safe during the parallel update. Wakes it up.
+	void move_object(EntityHandle handle, vec2 velocity);
+
+	// Make a new object at runtime. params is the same as an entity in the
+	// map json, if it has a targetname it gets registered. The object exists
+	// right away but only starts updating next frame. Called from the
+	// parallel update this is deferred to the sync point and you get a null
+	// handle back.
+	EntityHandle spawn(const std::string& type, const json& params);
+
+	// Destroy an object at the end of the frame. Its handle keeps working
+	// until then.
+	void destroy(EntityHandle handle);
+
+	// While a thread has a command buffer set, call_script, report_error and
+	// move_object on that thread get recorded into it instead of happening.
+	// This is per thread, not per io. Set to nullptr to go back to normal.
+	static void set_command_buffer(ObjectCommandBuffer* buffer);
+
+	// Do everything in the buffer in order and clear it. Main thread only.
+	void apply_commands(ObjectCommandBuffer& commands);
+
+	// Points to the mesh library. The actual one is held by the handler
+	MeshLibrary* meshes;
+
+	// Points to the entity store. The actual one is held by the handler
+	EntityStore* entities;
+
+	// Handler that owns this io, spawning and destroying goes through it
+	ObjectsHandler* handler;
 
 private:
 	std::vector<std::string> error_log;
 	std::vector<int> repeats;
-	std::map<std::string, GameObject*> object_registry;
+	ankerl::unordered_dense::map<std::string, EntityHandle> object_registry;
 
 	SystemsController& controller;
 };
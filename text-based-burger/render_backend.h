@@ -0,0 +1,55 @@
+#pragma once
+
+// Everything between the systems and the screen. The main loop only talks to
+// one of these: it asks it for input, hands the systems controller the render
+// targets for the frame, and gives the backend back whatever got rendered.
+//
+// GLRenderBackend is the real one with a window. HeadlessRenderBackend has no
+// window or gpu at all and just throws the frame away, it is for running the
+// whole engine on a machine without a display (build servers, throughput
+// testing with --headless --frames N).
+
+#include "systems_controller.h"
+
+// How many lines do you think youll want to ever draw:
+#define MAX_LINES 10000
+
+static_assert(LINE_BUDGET_DEFAULT + LINE_BUDGET_OBJECT_HEADROOM <= MAX_LINES, "Line budget doesnt fit in the lines list");
+
+// Characters in the char grid, CHAR_COLS * CHAR_ROWS
+#define CHAR_GRID_SIZE (120 * 68)
+
+// How long one pass of a frame took, see get_pass_timings
+struct RenderPassTiming {
+	const char* name;
+	double ms;
+};
+
+class RenderBackend {
+public:
+	virtual ~RenderBackend() {}
+
+	// False once the window has been closed
+	virtual bool is_running() = 0;
+
+	// Input and time for this frame
+	virtual GlobalUpdateData poll_input() = 0;
+
+	// Where the systems should render this frame. Only valid until end_frame.
+	virtual RenderTargets begin_frame() = 0;
+
+	// Show whatever was rendered into this frame's targets
+	virtual void end_frame(const RenderData& render_data) = 0;
+
+	// Refresh rate of the display in hz, 0 if there isnt a display
+	virtual double get_refresh_rate() {
+		return 0.0;
+	}
+
+	// How long every pass of a recent frame took, for --replay. Empty if the
+	// backend doesnt time its passes. Gpu timings come back a few frames late
+	// so these arent always for the frame that was just drawn.
+	virtual std::vector<RenderPassTiming> get_pass_timings() {
+		return {};
+	}
+};
@@ -0,0 +1,344 @@
+#include "render_capture.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+
+// Same runs shorter than this get sent as changed, skipping them would cost
+// more than just sending them
+#define RENDER_CAPTURE_MIN_SKIP 4
+
+static void append(vector<uint8_t>& out, const void* data, size_t bytes) {
+	const uint8_t* p = (const uint8_t*)data;
+	out.insert(out.end(), p, p + bytes);
+	return;
+}
+
+static void append_u32(vector<uint8_t>& out, uint32_t value) {
+	append(out, &value, sizeof(value));
+	return;
+}
+
+// Delta coding. Words are compared to last frame's and written as runs: a
+// uint32 of how many words stayed the same, a uint32 of how many changed,
+// then the changed words, over and over until all count words are covered.
+// Anything past the end of last frame counts as 0. last gets updated to
+// current as it goes.
+template <typename T>
+static void write_delta(vector<uint8_t>& out, const T* current, vector<T>& last, size_t count) {
+	if (last.size() < count) {
+		last.resize(count, 0);
+	}
+
+	size_t i = 0;
+	while (i < count) {
+		size_t changed_from = i;
+		while (changed_from < count && current[changed_from] == last[changed_from]) {
+			changed_from++;
+		}
+
+		// Keep going through short same runs, stop at a long one
+		size_t changed_to = changed_from;
+		while (changed_to < count) {
+			if (current[changed_to] != last[changed_to]) {
+				changed_to++;
+				continue;
+			}
+
+			size_t same = 0;
+			while (changed_to + same < count && same < RENDER_CAPTURE_MIN_SKIP
+				&& current[changed_to + same] == last[changed_to + same]) {
+				same++;
+			}
+			if (same == RENDER_CAPTURE_MIN_SKIP || changed_to + same == count) {
+				break;
+			}
+			changed_to += same;
+		}
+
+		append_u32(out, (uint32_t)(changed_from - i));
+		append_u32(out, (uint32_t)(changed_to - changed_from));
+		append(out, current + changed_from, (changed_to - changed_from) * sizeof(T));
+		copy(current + changed_from, current + changed_to, last.begin() + changed_from);
+
+		i = changed_to;
+	}
+
+	return;
+}
+
+static bool read_bytes(const vector<uint8_t>& data, size_t& position, void* out, size_t bytes) {
+	if (data.size() - position < bytes) {
+		return false;
+	}
+	memcpy(out, data.data() + position, bytes);
+	position += bytes;
+	return true;
+}
+
+// Undo write_delta on top of state
+template <typename T>
+static bool read_delta(const vector<uint8_t>& data, size_t& position, vector<T>& state, size_t count) {
+	if (state.size() < count) {
+		state.resize(count, 0);
+	}
+
+	size_t i = 0;
+	while (i < count) {
+		uint32_t same, changed;
+		if (!read_bytes(data, position, &same, sizeof(same)) || !read_bytes(data, position, &changed, sizeof(changed))) {
+			return false;
+		}
+		if ((size_t)same + changed > count - i) {
+			return false; // Runs go past the end, not a capture or a broken one
+		}
+
+		i += same;
+		if (!read_bytes(data, position, state.data() + i, changed * sizeof(T))) {
+			return false;
+		}
+		i += changed;
+	}
+
+	return true;
+}
+
+RenderCaptureWriter::RenderCaptureWriter(string path) {
+	file.open(path, ios::binary | ios::trunc);
+	if (!file.is_open()) {
+		throw runtime_error("Could not open capture file " + path);
+	}
+
+	file.write(RENDER_CAPTURE_MAGIC, sizeof(RENDER_CAPTURE_MAGIC));
+	uint32_t version = RENDER_CAPTURE_VERSION;
+	file.write((const char*)&version, sizeof(version));
+	bytes_written = sizeof(RENDER_CAPTURE_MAGIC) + sizeof(version);
+}
+
+void RenderCaptureWriter::write_frame(const RenderTargets& targets, const RenderData& render_data) {
+	buffer.clear();
+
+	// Backends never read past these either
+	size_t num_lines = clamp(render_data.lines_counter, 0, MAX_LINES);
+	size_t num_instances = clamp(render_data.instance_count, 0, MAX_LINE_INSTANCES);
+
+	RenderCaptureFrame header;
+	header.lines_counter = render_data.lines_counter;
+	header.mouse_counter = render_data.mouse_counter;
+	header.stencil_state = render_data.stencil_state;
+	header.instance_count = render_data.instance_count;
+	header.char_rows_dirty_from = render_data.char_rows_dirty_from;
+	header.char_rows_dirty_to = render_data.char_rows_dirty_to;
+	header.stencil_region_count = render_data.stencil_regions.size();
+	header.batch_count = render_data.instance_batches.size();
+	header.flags = 0;
+
+	bool mesh_lines_changed = first_frame || render_data.mesh_lines_version != mesh_lines_version;
+	bool palette_changed = first_frame || render_data.palette_version != palette_version;
+	if (mesh_lines_changed) {
+		header.flags |= RENDER_CAPTURE_MESH_LINES;
+	}
+	if (palette_changed) {
+		header.flags |= RENDER_CAPTURE_PALETTE;
+	}
+	append(buffer, &header, sizeof(header));
+
+	append(buffer, render_data.stencil_regions.data(), render_data.stencil_regions.size() * sizeof(vec2));
+	append(buffer, render_data.instance_batches.data(), render_data.instance_batches.size() * sizeof(LineInstanceBatch));
+
+	if (mesh_lines_changed) {
+		uint32_t count = render_data.mesh_lines != nullptr ? render_data.mesh_lines->size() : 0;
+		append_u32(buffer, count);
+		if (count > 0) {
+			append(buffer, render_data.mesh_lines->data(), count * sizeof(MeshLine));
+		}
+		mesh_lines_version = render_data.mesh_lines_version;
+	}
+
+	if (palette_changed) {
+		uint32_t count = render_data.palette != nullptr ? render_data.palette->size() : 0;
+		append_u32(buffer, count);
+		if (count > 0) {
+			append(buffer, render_data.palette->data(), count * sizeof(uint32_t));
+		}
+		palette_version = render_data.palette_version;
+	}
+
+	write_delta(buffer, targets.char_grid, last_char_grid, CHAR_GRID_SIZE);
+	write_delta(buffer, reinterpret_cast<const uint32_t*>(targets.line_verts), last_line_verts, num_lines * 4);
+	write_delta(buffer, targets.line_materials, last_line_materials, num_lines);
+	write_delta(buffer, reinterpret_cast<const uint32_t*>(targets.line_instances), last_line_instances,
+		num_instances * sizeof(LineInstance) / sizeof(uint32_t));
+
+	file.write((const char*)buffer.data(), buffer.size());
+	bytes_written += buffer.size();
+	first_frame = false;
+	return;
+}
+
+RenderCaptureReader::RenderCaptureReader(string path) {
+	ifstream file(path, ios::binary | ios::ate);
+	if (!file.is_open()) {
+		throw runtime_error("Could not open capture file " + path);
+	}
+
+	data.resize((size_t)file.tellg());
+	file.seekg(0);
+	file.read((char*)data.data(), data.size());
+
+	char magic[sizeof(RENDER_CAPTURE_MAGIC)];
+	uint32_t version;
+	if (!read_bytes(data, position, magic, sizeof(magic)) || memcmp(magic, RENDER_CAPTURE_MAGIC, sizeof(magic)) != 0) {
+		throw runtime_error(path + " is not a render capture");
+	}
+	if (!read_bytes(data, position, &version, sizeof(version)) || version != RENDER_CAPTURE_VERSION) {
+		throw runtime_error(path + " is from a different version of the render capture format");
+	}
+
+	render_data.mesh_lines = &mesh_lines;
+	render_data.palette = &palette;
+}
+
+bool RenderCaptureReader::next_frame() {
+	if (position == data.size()) {
+		return false;
+	}
+
+	RenderCaptureFrame header;
+	bool ok = read_bytes(data, position, &header, sizeof(header));
+
+	if (ok) {
+		render_data.lines_counter = header.lines_counter;
+		render_data.mouse_counter = header.mouse_counter;
+		render_data.stencil_state = header.stencil_state;
+		render_data.instance_count = header.instance_count;
+		render_data.char_rows_dirty_from = header.char_rows_dirty_from;
+		render_data.char_rows_dirty_to = header.char_rows_dirty_to;
+
+		render_data.stencil_regions.resize(header.stencil_region_count);
+		render_data.instance_batches.resize(header.batch_count);
+		ok = read_bytes(data, position, render_data.stencil_regions.data(), header.stencil_region_count * sizeof(vec2))
+			&& read_bytes(data, position, render_data.instance_batches.data(), header.batch_count * sizeof(LineInstanceBatch));
+	}
+
+	if (ok && (header.flags & RENDER_CAPTURE_MESH_LINES)) {
+		uint32_t count;
+		ok = read_bytes(data, position, &count, sizeof(count));
+		if (ok) {
+			mesh_lines.resize(count);
+			ok = read_bytes(data, position, mesh_lines.data(), count * sizeof(MeshLine));
+			render_data.mesh_lines_version++;
+		}
+	}
+
+	if (ok && (header.flags & RENDER_CAPTURE_PALETTE)) {
+		uint32_t count;
+		ok = read_bytes(data, position, &count, sizeof(count));
+		if (ok) {
+			palette.resize(count);
+			ok = read_bytes(data, position, palette.data(), count * sizeof(uint32_t));
+			render_data.palette_version++;
+		}
+	}
+
+	if (ok) {
+		size_t num_lines = clamp(render_data.lines_counter, 0, MAX_LINES);
+		size_t num_instances = clamp(render_data.instance_count, 0, MAX_LINE_INSTANCES);
+		ok = read_delta(data, position, char_grid, CHAR_GRID_SIZE)
+			&& read_delta(data, position, line_verts, num_lines * 4)
+			&& read_delta(data, position, line_materials, num_lines)
+			&& read_delta(data, position, line_instances, num_instances * sizeof(LineInstance) / sizeof(uint32_t));
+	}
+
+	if (!ok) {
+		// Probably the game got closed mid frame, everything before is fine
+		cout << "Capture ends in the middle of a frame, stopping there" << endl;
+		position = data.size();
+		return false;
+	}
+
+	return true;
+}
+
+void RenderCaptureReader::fill_targets(const RenderTargets& targets) const {
+	size_t num_lines = clamp(render_data.lines_counter, 0, MAX_LINES);
+	size_t num_instances = clamp(render_data.instance_count, 0, MAX_LINE_INSTANCES);
+
+	memcpy(targets.char_grid, char_grid.data(), CHAR_GRID_SIZE * sizeof(uint32_t));
+	memcpy(targets.line_verts, line_verts.data(), num_lines * 4 * sizeof(float));
+	memcpy(targets.line_materials, line_materials.data(), num_lines * sizeof(LineMaterial));
+	memcpy((void*)targets.line_instances, line_instances.data(), num_instances * sizeof(LineInstance));
+	return;
+}
+
+int replay_render_capture(RenderBackend& backend, string path, long long max_frames) {
+	unique_ptr<RenderCaptureReader> reader;
+	try {
+		reader = make_unique<RenderCaptureReader>(path);
+	}
+	catch (const exception& e) {
+		cout << e.what() << endl;
+		return -1;
+	}
+
+	long long frames = 0;
+	double fill_seconds = 0.0;
+	double draw_seconds = 0.0;
+
+	// Summed per pass, over the frames that had timings
+	vector<RenderPassTiming> pass_totals;
+	long long timed_frames = 0;
+
+	auto start_time = chrono::steady_clock::now();
+	while (backend.is_running() && (max_frames < 0 || frames < max_frames) && reader->next_frame()) {
+		// Filling the targets stands in for the systems rendering into them
+		auto fill_start = chrono::steady_clock::now();
+		reader->fill_targets(backend.begin_frame());
+
+		auto draw_start = chrono::steady_clock::now();
+		backend.end_frame(reader->get_render_data());
+		auto draw_end = chrono::steady_clock::now();
+
+		fill_seconds += chrono::duration<double>(draw_start - fill_start).count();
+		draw_seconds += chrono::duration<double>(draw_end - draw_start).count();
+
+		vector<RenderPassTiming> timings = backend.get_pass_timings();
+		if (!timings.empty()) {
+			if (pass_totals.empty()) {
+				pass_totals = timings;
+				for (RenderPassTiming& pass : pass_totals) {
+					pass.ms = 0.0;
+				}
+			}
+			for (size_t i = 0; i < timings.size() && i < pass_totals.size(); i++) {
+				pass_totals[i].ms += timings[i].ms;
+			}
+			timed_frames++;
+		}
+
+		frames++;
+	}
+
+	if (frames == 0) {
+		cout << "Nothing to replay in " << path << endl;
+		return -1;
+	}
+
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+	cout << "Replayed " << frames << " frames in " << seconds << " s, "
+		<< seconds * 1000.0 / frames << " ms per frame, "
+		<< frames / seconds << " fps" << endl;
+	cout << "  filling render targets: " << fill_seconds * 1000.0 / frames << " ms per frame" << endl;
+	cout << "  end_frame: " << draw_seconds * 1000.0 / frames << " ms per frame" << endl;
+
+	for (const RenderPassTiming& pass : pass_totals) {
+		cout << "  " << pass.name << ": " << pass.ms / timed_frames << " ms per frame" << endl;
+	}
+
+	return 0;
+}
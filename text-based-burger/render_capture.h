@@ -0,0 +1,122 @@
+#pragma once
+
+// Render capture and replay. The systems render straight into the backend's
+// render targets and the backend draws them in the same frame, so there was
+// no way to time the renderer on its own without the simulation in the way.
+//
+// --capture file writes every frame's render inputs (the render targets and
+// the RenderData) to a file. --replay file feeds them back through a backend
+// as fast as it will go, with no systems at all, and prints how long every
+// pass took. Renderer changes can then be measured on the same real frames
+// over and over.
+//
+// Capturing reads the render targets back. From mapped gpu memory that is
+// slow, so capture with --headless (which also makes the run repeatable) and
+// replay with the backend you want to measure.
+//
+// File layout, little endian like everything this runs on:
+// - RENDER_CAPTURE_MAGIC, then a uint32 version
+// - one record per frame:
+//   - RenderCaptureFrame
+//   - stencil regions, 2 vec2s each
+//   - instance batches
+//   - the mesh lines if they changed, a uint32 count then the lines
+//   - the palette if it changed, a uint32 count then the colors
+//   - char grid, line verts, line materials and line instances, each delta
+//     coded against the last frame (see write_delta in render_capture.cpp)
+// Most of a frame is usually the same as the last one (text, walls with a
+// still camera), and those parts come out to a few bytes.
+
+#include "render_backend.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+#define RENDER_CAPTURE_MAGIC "TBBRCAP"
+#define RENDER_CAPTURE_VERSION 1
+
+// Flags for RenderCaptureFrame
+#define RENDER_CAPTURE_MESH_LINES 1 // mesh lines follow
+#define RENDER_CAPTURE_PALETTE 2 // palette follows
+
+// What goes before every frame
+struct RenderCaptureFrame {
+	int32_t lines_counter;
+	int32_t mouse_counter;
+	int32_t stencil_state;
+	int32_t instance_count;
+	int32_t char_rows_dirty_from;
+	int32_t char_rows_dirty_to;
+	uint32_t stencil_region_count; // vec2s, not regions
+	uint32_t batch_count;
+	uint32_t flags;
+};
+
+class RenderCaptureWriter {
+public:
+	// Throws if the file cant be opened
+	RenderCaptureWriter(std::string path);
+
+	// Call after the systems rendered and before the backend draws the frame
+	void write_frame(const RenderTargets& targets, const RenderData& render_data);
+
+	uint64_t get_bytes_written() const {
+		return bytes_written;
+	}
+
+private:
+	std::ofstream file;
+	uint64_t bytes_written = 0;
+
+	// Built up and then written in one go
+	std::vector<uint8_t> buffer;
+
+	// Last frame, what the deltas are against
+	std::vector<uint32_t> last_char_grid;
+	std::vector<uint32_t> last_line_verts;
+	std::vector<LineMaterial> last_line_materials;
+	std::vector<uint32_t> last_line_instances;
+
+	bool first_frame = true;
+	uint32_t mesh_lines_version = 0;
+	uint32_t palette_version = 0;
+};
+
+class RenderCaptureReader {
+public:
+	// Reads the whole file in up front so replaying never waits on the disk.
+	// Throws if it cant be read or isnt a capture.
+	RenderCaptureReader(std::string path);
+
+	// Decode the next frame. False at the end of the capture.
+	bool next_frame();
+
+	// Copy the current frame into a backend's render targets
+	void fill_targets(const RenderTargets& targets) const;
+
+	// The current frame's RenderData, points into this reader
+	const RenderData& get_render_data() const {
+		return render_data;
+	}
+
+private:
+	std::vector<uint8_t> data;
+	size_t position = 0;
+
+	// Current frame, deltas get applied on top of these
+	std::vector<uint32_t> char_grid;
+	std::vector<uint32_t> line_verts;
+	std::vector<LineMaterial> line_materials;
+	std::vector<uint32_t> line_instances;
+
+	std::vector<MeshLine> mesh_lines;
+	std::vector<uint32_t> palette;
+
+	RenderData render_data = {};
+};
+
+// Play a capture through a backend as fast as it goes and print the timings.
+// max_frames below 0 plays all of it. Returns the exit code for main.
+int replay_render_capture(RenderBackend& backend, std::string path, long long max_frames);
@@ -0,0 +1,73 @@
+#include "ring_buffer.h"
+
+#include <cstring>
+
+using namespace std;
+
+PersistentRingBuffer::PersistentRingBuffer(size_t slot_size) : slot_size(slot_size) {
+	GLint alignment = 1;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	slot_stride = (slot_size + alignment - 1) / alignment * alignment;
+
+	size_t total_size = slot_stride * RING_BUFFER_FRAMES;
+
+	// Coherent so writes show up to the gpu without having to flush anything,
+	// the fences take care of the ordering.
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glBufferStorage(GL_SHADER_STORAGE_BUFFER, total_size, nullptr, flags);
+	mapped = (uint8_t*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, total_size, flags);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	memset(mapped, 0, total_size);
+}
+
+PersistentRingBuffer::~PersistentRingBuffer() {
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+}
+
+void PersistentRingBuffer::bind(unsigned int binding, int frame) {
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, frame * slot_stride, slot_size);
+	return;
+}
+
+FrameFences::~FrameFences() {
+	for (GLsync& fence : fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+		}
+	}
+}
+
+int FrameFences::begin_frame() {
+	frame = (frame + 1) % RING_BUFFER_FRAMES;
+
+	GLsync& fence = fences[frame];
+	if (fence != nullptr) {
+		// Flush on the first wait so the fence actually gets submitted, then
+		// just keep waiting. Timeout is in nanoseconds.
+		GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (true) {
+			GLenum result = glClientWaitSync(fence, wait_flags, 1000000);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) {
+				break;
+			}
+			wait_flags = 0;
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	return frame;
+}
+
+void FrameFences::end_frame() {
+	fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	return;
+}
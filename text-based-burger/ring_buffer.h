@@ -0,0 +1,77 @@
+#pragma once
+
+// Persistently mapped buffers for everything that gets sent to the gpu every
+// frame. Instead of orphaning a buffer and copying a cpu array into it with
+// glBufferSubData, each buffer is mapped once at startup and stays mapped, and
+// the systems render straight into it.
+//
+// The catch is that the gpu might still be drawing last frame out of the same
+// memory, so every buffer is split into RING_BUFFER_FRAMES slots and each frame
+// writes to the next one. A fence is put down after each frame's draws and we
+// only wait on it when we come back around to that slot, which with 3 slots
+// is basically never.
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstddef>
+
+// Cpu writes one, gpu reads one, one spare so neither waits on the other
+#define RING_BUFFER_FRAMES 3
+
+class PersistentRingBuffer {
+public:
+	// slot_size bytes per frame. The buffer is zeroed so slots that are only
+	// partly written each frame still start out clean.
+	PersistentRingBuffer(size_t slot_size);
+	~PersistentRingBuffer();
+
+	// Owns a gl buffer and a mapping into it
+	PersistentRingBuffer(const PersistentRingBuffer&) = delete;
+	PersistentRingBuffer& operator=(const PersistentRingBuffer&) = delete;
+
+	// Write pointer for a frame's slot. Only write to it between
+	// FrameFences::begin_frame and end_frame for that frame.
+	void* slot(int frame) {
+		return mapped + frame * slot_stride;
+	}
+
+	// Bind a frame's slot as an SSBO, shaders see it as if it was the whole buffer
+	void bind(unsigned int binding, int frame);
+
+	size_t get_slot_size() const {
+		return slot_size;
+	}
+
+private:
+	unsigned int buffer = 0;
+	uint8_t* mapped = nullptr;
+
+	size_t slot_size;
+
+	// Slots have to start on the SSBO offset alignment, so there can be some
+	// padding between them
+	size_t slot_stride;
+};
+
+// Keeps track of which slot is being written and which ones the gpu is done
+// with. One of these is shared by every ring buffer.
+class FrameFences {
+public:
+	FrameFences() = default;
+	~FrameFences();
+
+	FrameFences(const FrameFences&) = delete;
+	FrameFences& operator=(const FrameFences&) = delete;
+
+	// Move on to the next slot and wait until the gpu has stopped reading it.
+	// Returns the slot to write this frame.
+	int begin_frame();
+
+	// Call after the last draw that reads this frame's slots
+	void end_frame();
+
+private:
+	GLsync fences[RING_BUFFER_FRAMES] = {};
+	int frame = RING_BUFFER_FRAMES - 1;
+};
@@ -11,6 +11,7 @@
 #include "systems_controller.h"
 
 #include "threading_utils.h"
+#include "mesh_utils.h"
 
 #include <iostream>
 #include "json.hpp"
@@ -36,6 +37,7 @@ Script get_script(std::string name) {
 		{"update_canvas_color_from_ui", update_canvas_color_from_ui},
 		{"save_mesh_file", save_mesh_file},
 		{"load_mesh_file", load_mesh_file},
+		{"cook_meshes", cook_meshes},
     };
 
     auto it = script_map.find(name);
@@ -120,7 +122,7 @@ void basic_mover(json data, ScriptHandles handles) {
 		return;
 	}
 	
-	obj->position = vec2(data);
+	obj->position() = vec2(data);
 	return;
 }
 
@@ -217,7 +219,16 @@ void toggle_show_bvh(json data, ScriptHandles handles) {
 void npc_move(json data, ScriptHandles handles) {
 	// This
 	std::string name = data["targetname"].get<std::string>();
-	NPC* npc = dynamic_cast<NPC*>(handles.obj_io->get_object(name));
+
+	// NPCs pass their own handle so we dont have to look the name up every
+	// time one of them moves
+	NPC* npc = nullptr;
+	if (data.contains("handle")) {
+		npc = dynamic_cast<NPC*>(handles.obj_io->get_object(EntityHandle::from_bits(data["handle"].get<uint64_t>())));
+	}
+	else {
+		npc = dynamic_cast<NPC*>(handles.obj_io->get_object(name));
+	}
 	if (npc == nullptr) {
 		handles.obj_io->report_error("ERROR: NPC move called on non existant npc " + name + " by " + data["caller"].get<std::string>());
 		return;
@@ -227,13 +238,13 @@ void npc_move(json data, ScriptHandles handles) {
 	// if bvh does not exist dont collide with anything
 	if (!handles.map_manager->has_collision_bvh) {
 		// No collision, just move
-		npc->position += move_vel;
+		npc->position() += move_vel;
 		return;
 	}
 
 	// NPCs should always be 16*16
-	vec2 npc_from = npc->position - 16;
-	vec2 npc_to = npc->position + 16;
+	vec2 npc_from = npc->position() - 16;
+	vec2 npc_to = npc->position() + 16;
 
 	// Aspirational position
 	npc_from += move_vel;
@@ -248,7 +259,7 @@ void npc_move(json data, ScriptHandles handles) {
 	move_vel += normal_force;
 
 	// Set new position
-	npc->position += move_vel;
+	npc->position() += move_vel;
 }
 
 void set_canvas_tool(json data, ScriptHandles handles) {
@@ -398,4 +409,24 @@ void load_mesh_file(json data, ScriptHandles handles) {
 	}
 	
 	return;
-}
\ No newline at end of file
+}
+
+void cook_meshes(json /*data*/, ScriptHandles handles) {
+	// Rebuild the mesh manifest so meshes can be loaded lazily. Only knows
+	// about the default mesh directory, extra_mesh_paths always load the
+	// slow way.
+	try {
+		cook_mesh_manifest(MESH_DIRECTORY, MESH_MANIFEST_PATH);
+	}
+	catch (const std::exception& e) {
+		handles.obj_io->report_error("ERROR: Could not cook meshes: " + std::string(e.what()));
+		return;
+	}
+
+	// Files that are already resident stay how they are, the next map to
+	// take them after they are thrown out uses the new manifest
+	handles.controller->get_mesh_library().load_manifest(MESH_MANIFEST_PATH);
+
+	std::cout << "Mesh manifest written to " << MESH_MANIFEST_PATH << std::endl;
+	return;
+}
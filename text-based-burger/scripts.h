@@ -97,4 +97,5 @@ void toggle_grid_snapping(json data, ScriptHandles handles);
 void update_canvas_color_from_ui(json data, ScriptHandles handles);
 void save_mesh_file(json data, ScriptHandles handles);
 void load_mesh_file(json data, ScriptHandles handles);
+void cook_meshes(json data, ScriptHandles handles);
 void init_canvas_ui(json data, ScriptHandles handles);
\ No newline at end of file
@@ -28,6 +28,13 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, std::vector<std
         vertexCode = vShaderStream.str();
         fragmentCode = fShaderStream.str();
 
+        // Errors in the shader itself show up as source 0, includes are
+        // numbered from 1 in the order given (glsl #line only takes numbers)
+        if (!includes.empty())
+        {
+            fragmentCode = "\n#line 1 0\n" + fragmentCode;
+        }
+
         // read includes
         for (int i = includes.size() - 1; i >= 0; i--)
         {
@@ -43,7 +50,7 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath, std::vector<std
 
                 // append include code to the start of the shader code
                 fragmentCode = includeStream.str() + fragmentCode;
-                fragmentCode = "\n\n#line 1 \"" + include + "\"\n" + fragmentCode;
+                fragmentCode = "\n\n#line 1 " + std::to_string(i + 1) + "\n" + fragmentCode;
             }
             catch (std::ifstream::failure& e)
             {
@@ -136,7 +143,7 @@ int Shader::checkCompileErrors(unsigned int shader, std::string type,
             std::cout << "INCLUDES:" << "\n";
 			for (int i = 0; i < includes.size(); i++)
 			{
-				std::cout << " + " << includes[i] << "\n";
+				std::cout << " + " << i + 1 << ": " << includes[i] << "\n";
 			}
 			std::cout << "\n";
             std::cout << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
@@ -0,0 +1,436 @@
+#include "software_render_backend.h"
+#include "font_loader.h"
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+// Same check as map_utils, sse2 where it is guaranteed, scalar otherwise
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_RENDER_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// The text texture is this tall and gets squashed into SOFTWARE_HEIGHT rows,
+// same as the pass shader does it
+#define SOFTWARE_TEXT_HEIGHT 544
+
+// Line space is -1 to 1 across the whole screen, y up
+static float pixel_to_line_x(float x) {
+	return (x + 0.5f) * (2.0f / SOFTWARE_WIDTH) - 1.0f;
+}
+
+static float pixel_to_line_y(float y) {
+	return 1.0f - (y + 0.5f) * (2.0f / SOFTWARE_HEIGHT);
+}
+
+SoftwareRenderBackend::SoftwareRenderBackend(string dump_directory) : dump_directory(dump_directory) {
+	font = load_font("gamedata\\fonts\\font.txt");
+	if (font.size() < 256 * 4) {
+		throw runtime_error("Font has less than 256 glyphs");
+	}
+
+	if (!dump_directory.empty()) {
+		filesystem::create_directories(dump_directory);
+	}
+
+	frame.resize(SOFTWARE_WIDTH * SOFTWARE_HEIGHT * 3, 0);
+
+	tiles_x = (SOFTWARE_WIDTH + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+	tiles_y = (SOFTWARE_HEIGHT + SOFTWARE_TILE_SIZE - 1) / SOFTWARE_TILE_SIZE;
+	tile_bins.resize(tiles_x * tiles_y);
+}
+
+void SoftwareRenderBackend::end_frame(const RenderData& render_data) {
+	auto lines_start = chrono::steady_clock::now();
+	set_up_lines(render_data);
+
+	auto tiles_start = chrono::steady_clock::now();
+	pool.run(tiles_x * tiles_y, [&](int tile) {
+		draw_tile(tile, render_data);
+	});
+
+	auto write_start = chrono::steady_clock::now();
+	if (!dump_directory.empty()) {
+		write_frame();
+	}
+	auto write_end = chrono::steady_clock::now();
+
+	pass_timings = {
+		{ "lines", chrono::duration<double, milli>(tiles_start - lines_start).count() },
+		{ "tiles", chrono::duration<double, milli>(write_start - tiles_start).count() },
+		{ "write", chrono::duration<double, milli>(write_end - write_start).count() }
+	};
+
+	// Moves the clock on
+	HeadlessRenderBackend::end_frame(render_data);
+	return;
+}
+
+void SoftwareRenderBackend::set_up_lines(const RenderData& render_data) {
+	lines.clear();
+	for (vector<uint32_t>& bin : tile_bins) {
+		bin.clear();
+	}
+
+	// Materials are palette indices, the palette has the actual colors
+	const vector<uint32_t>& palette = *render_data.palette;
+
+	// Normal lines, the cursor ones first and never stenciled
+	int num_lines = min(render_data.lines_counter, MAX_LINES);
+	for (int i = 0; i < num_lines; i++) {
+		add_line(line_verts[i * 4 + 0], line_verts[i * 4 + 1],
+			line_verts[i * 4 + 2], line_verts[i * 4 + 3],
+			palette[line_materials[i]], i >= LINE_BUDGET_CURSOR_LINES);
+	}
+
+	// Instanced meshes, placed the same way vertex_lines_instanced.glsl does
+	if (render_data.instance_count > 0 && render_data.mesh_lines != nullptr) {
+		const vector<MeshLine>& mesh_lines = *render_data.mesh_lines;
+		float ndc_scale_x = 2.0f / SOFTWARE_WIDTH;
+		float ndc_scale_y = 2.0f / SOFTWARE_HEIGHT;
+
+		for (const LineInstanceBatch& batch : render_data.instance_batches) {
+			for (uint32_t i = batch.first_instance; i < batch.first_instance + batch.instance_count; i++) {
+				const LineInstance& inst = line_instances[i];
+				float c = cos(inst.rotation);
+				float s = sin(inst.rotation);
+
+				for (uint32_t line = 0; line < batch.line_count; line++) {
+					const MeshLine& mesh_line = mesh_lines[inst.first_line + line];
+
+					float ax = mesh_line.from.x * inst.scale.x;
+					float ay = mesh_line.from.y * inst.scale.y;
+					float bx = mesh_line.to.x * inst.scale.x;
+					float by = mesh_line.to.y * inst.scale.y;
+
+					add_line(
+						inst.position.x + (c * ax - s * ay) * ndc_scale_x,
+						inst.position.y + (s * ax + c * ay) * ndc_scale_y,
+						inst.position.x + (c * bx - s * by) * ndc_scale_x,
+						inst.position.y + (s * bx + c * by) * ndc_scale_y,
+						palette[inst.material], true);
+				}
+			}
+		}
+	}
+
+	return;
+}
+
+void SoftwareRenderBackend::add_line(float ax, float ay, float bx, float by, uint32_t color, bool stenciled) {
+	float dir_x = bx - ax;
+	float dir_y = by - ay;
+	float len = sqrt(dir_x * dir_x + dir_y * dir_y);
+	if (len <= 0.0f) {
+		return; // Zero length lines collapse to nothing in the shader too
+	}
+	dir_x /= len;
+	dir_y /= len;
+
+	// Quad, same as the vertex shader. x is squashed by the aspect ratio of the
+	// text texture vs the screen.
+	float thickness_x = SOFTWARE_LINE_THICKNESS * 0.01f * SOFTWARE_HEIGHT / SOFTWARE_TEXT_HEIGHT;
+	float thickness_y = SOFTWARE_LINE_THICKNESS * 0.01f;
+
+	float perp_x = -dir_y * thickness_x * 0.5f;
+	float perp_y = dir_x * thickness_y * 0.5f;
+	float extend_x = dir_x * thickness_x * 0.5f;
+	float extend_y = dir_y * thickness_y * 0.5f;
+
+	SoftwareLine line;
+
+	// Quad is origin + u * along + v * across for u, v in [0, 1]
+	line.origin_x = ax - extend_x - perp_x;
+	line.origin_y = ay - extend_y - perp_y;
+	float along_x = bx - ax + extend_x * 2.0f;
+	float along_y = by - ay + extend_y * 2.0f;
+	float across_x = perp_x * 2.0f;
+	float across_y = perp_y * 2.0f;
+
+	float det = along_x * across_y - across_x * along_y;
+	if (fabs(det) < 1e-12f) {
+		return;
+	}
+	line.inv_00 = across_y / det;
+	line.inv_01 = -across_x / det;
+	line.inv_10 = -along_y / det;
+	line.inv_11 = along_x / det;
+
+	line.ax = ax;
+	line.ay = ay;
+	line.bax = bx - ax;
+	line.bay = by - ay;
+	line.inv_ba_len2 = 1.0f / (len * len);
+
+	// Unpack the color, see beam_color in line_beam.glsl
+	uint32_t hue_u = color & 0xFF;
+	uint32_t intensity_u = (color >> 8) & 0xFF;
+	uint32_t alpha_u = (color >> 16) & 0xFF;
+	uint32_t thickness_u = (color >> 24) & 0xFF;
+
+	float is_negative = (float)(thickness_u >> 7);
+	float signed_val = (float)thickness_u - is_negative * 127.0f;
+	line.width = (0.5f * (1.0f - is_negative) * signed_val) + (-0.025f * is_negative * signed_val);
+
+	line.saturation = 0.9f * (1.1f - intensity_u / 255.0f);
+	line.alpha = alpha_u / 255.0f;
+
+	// hsv2rgb splits into a part that only depends on the hue and a mix with
+	// the saturation, only the mix has to be done per pixel
+	float hue = (55.0f * (hue_u / 255.0f)) / 360.0f;
+	const float hue_offsets[3] = { 1.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	for (int k = 0; k < 3; k++) {
+		float h = hue + hue_offsets[k];
+		h -= floor(h);
+		float p = fabs(h * 6.0f - 3.0f) - 1.0f;
+		line.hue_rgb[k] = clamp(p, 0.0f, 1.0f) - 1.0f;
+	}
+
+	line.stenciled = stenciled;
+
+	// Pixel bounds of the quad
+	float corners_x[4] = { line.origin_x, line.origin_x + along_x, line.origin_x + across_x, line.origin_x + along_x + across_x };
+	float corners_y[4] = { line.origin_y, line.origin_y + along_y, line.origin_y + across_y, line.origin_y + along_y + across_y };
+	float min_x = *min_element(corners_x, corners_x + 4);
+	float max_x = *max_element(corners_x, corners_x + 4);
+	float min_y = *min_element(corners_y, corners_y + 4);
+	float max_y = *max_element(corners_y, corners_y + 4);
+
+	line.min_x = max(0, (int)floor((min_x + 1.0f) * (SOFTWARE_WIDTH / 2.0f) - 0.5f));
+	line.max_x = min(SOFTWARE_WIDTH - 1, (int)ceil((max_x + 1.0f) * (SOFTWARE_WIDTH / 2.0f) - 0.5f));
+	line.min_y = max(0, (int)floor((1.0f - max_y) * (SOFTWARE_HEIGHT / 2.0f) - 0.5f));
+	line.max_y = min(SOFTWARE_HEIGHT - 1, (int)ceil((1.0f - min_y) * (SOFTWARE_HEIGHT / 2.0f) - 0.5f));
+	if (line.min_x > line.max_x || line.min_y > line.max_y) {
+		return; // Off screen
+	}
+
+	uint32_t index = (uint32_t)lines.size();
+	lines.push_back(line);
+
+	// Bin by bounds, a long diagonal line ends up in some tiles it doesnt
+	// touch but the quad test throws those pixels out anyway
+	for (int ty = line.min_y / SOFTWARE_TILE_SIZE; ty <= line.max_y / SOFTWARE_TILE_SIZE; ty++) {
+		for (int tx = line.min_x / SOFTWARE_TILE_SIZE; tx <= line.max_x / SOFTWARE_TILE_SIZE; tx++) {
+			tile_bins[ty * tiles_x + tx].push_back(index);
+		}
+	}
+
+	return;
+}
+
+// Beam glow of one line added onto 4 pixels in a row. x_line is the line space
+// x of the first one.
+static void beam_x4(const SoftwareLine& line, float x_line, float y_line, const float* stencil,
+	float* r, float* g, float* b) {
+
+	const float step = 2.0f / SOFTWARE_WIDTH;
+
+#ifdef SOFTWARE_RENDER_SSE2
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	__m128 px = _mm_add_ps(_mm_set1_ps(x_line), _mm_mul_ps(_mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), _mm_set1_ps(step)));
+	__m128 py = _mm_set1_ps(y_line);
+
+	// Inside the quad
+	__m128 ox = _mm_sub_ps(px, _mm_set1_ps(line.origin_x));
+	__m128 oy = _mm_sub_ps(py, _mm_set1_ps(line.origin_y));
+	__m128 u = _mm_add_ps(_mm_mul_ps(ox, _mm_set1_ps(line.inv_00)), _mm_mul_ps(oy, _mm_set1_ps(line.inv_01)));
+	__m128 v = _mm_add_ps(_mm_mul_ps(ox, _mm_set1_ps(line.inv_10)), _mm_mul_ps(oy, _mm_set1_ps(line.inv_11)));
+	__m128 inside = _mm_and_ps(
+		_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)),
+		_mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(v, one)));
+	if (_mm_movemask_ps(inside) == 0) {
+		return;
+	}
+
+	// udSegment
+	__m128 bax = _mm_set1_ps(line.bax);
+	__m128 bay = _mm_set1_ps(line.bay);
+	__m128 pax = _mm_sub_ps(px, _mm_set1_ps(line.ax));
+	__m128 pay = _mm_sub_ps(py, _mm_set1_ps(line.ay));
+	__m128 h = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(pax, bax), _mm_mul_ps(pay, bay)), _mm_set1_ps(line.inv_ba_len2));
+	h = _mm_min_ps(_mm_max_ps(h, zero), one);
+	__m128 dx = _mm_sub_ps(pax, _mm_mul_ps(h, bax));
+	__m128 dy = _mm_sub_ps(pay, _mm_mul_ps(h, bay));
+	__m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+
+	dist = _mm_sub_ps(_mm_mul_ps(dist, _mm_set1_ps(1000.0f)), _mm_set1_ps(line.width));
+	dist = _mm_max_ps(dist, _mm_set1_ps(0.001f));
+
+	// pow(dist, 1.75) is dist * dist^0.5 * dist^0.25
+	__m128 root = _mm_sqrt_ps(dist);
+	__m128 falloff = _mm_mul_ps(_mm_mul_ps(dist, root), _mm_sqrt_ps(root));
+	__m128 sdf_r = _mm_min_ps(_mm_div_ps(one, falloff), one);
+
+	__m128 glow = _mm_max_ps(_mm_sub_ps(dist, _mm_set1_ps(3.0f)), _mm_set1_ps(0.001f));
+	__m128 saturation = _mm_add_ps(_mm_set1_ps(line.saturation), _mm_sub_ps(one, _mm_min_ps(one, _mm_div_ps(one, glow))));
+	saturation = _mm_min_ps(saturation, one);
+
+	__m128 scale = _mm_and_ps(inside, _mm_mul_ps(sdf_r, _mm_set1_ps(line.alpha)));
+	if (line.stenciled) {
+		scale = _mm_mul_ps(scale, _mm_load_ps(stencil));
+	}
+
+	float* channels[3] = { r, g, b };
+	for (int k = 0; k < 3; k++) {
+		__m128 mix = _mm_add_ps(one, _mm_mul_ps(saturation, _mm_set1_ps(line.hue_rgb[k])));
+		_mm_store_ps(channels[k], _mm_add_ps(_mm_load_ps(channels[k]), _mm_mul_ps(scale, mix)));
+	}
+#else
+	for (int i = 0; i < 4; i++) {
+		float px = x_line + i * step;
+
+		float ox = px - line.origin_x;
+		float oy = y_line - line.origin_y;
+		float u = ox * line.inv_00 + oy * line.inv_01;
+		float v = ox * line.inv_10 + oy * line.inv_11;
+		if (u < 0.0f || u > 1.0f || v < 0.0f || v > 1.0f) {
+			continue;
+		}
+
+		float pax = px - line.ax;
+		float pay = y_line - line.ay;
+		float h = clamp((pax * line.bax + pay * line.bay) * line.inv_ba_len2, 0.0f, 1.0f);
+		float dx = pax - h * line.bax;
+		float dy = pay - h * line.bay;
+
+		float dist = sqrt(dx * dx + dy * dy) * 1000.0f - line.width;
+		dist = max(dist, 0.001f);
+
+		float sdf_r = min(1.0f / pow(dist, 1.75f), 1.0f);
+		float saturation = line.saturation + 1.0f - min(1.0f, 1.0f / max(dist - 3.0f, 0.001f));
+		saturation = min(saturation, 1.0f);
+
+		float scale = sdf_r * line.alpha;
+		if (line.stenciled) {
+			scale *= stencil[i];
+		}
+
+		r[i] += scale * (1.0f + saturation * line.hue_rgb[0]);
+		g[i] += scale * (1.0f + saturation * line.hue_rgb[1]);
+		b[i] += scale * (1.0f + saturation * line.hue_rgb[2]);
+	}
+#endif
+	return;
+}
+
+void SoftwareRenderBackend::draw_tile(int tile, const RenderData& render_data) {
+	int x0 = (tile % tiles_x) * SOFTWARE_TILE_SIZE;
+	int y0 = (tile / tiles_x) * SOFTWARE_TILE_SIZE;
+	int width = min(SOFTWARE_TILE_SIZE, SOFTWARE_WIDTH - x0);
+	int height = min(SOFTWARE_TILE_SIZE, SOFTWARE_HEIGHT - y0);
+
+	alignas(16) float r[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+	alignas(16) float g[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+	alignas(16) float b[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+
+	// 1 where stenciled lines get drawn, 0 where they dont
+	alignas(16) float stencil[SOFTWARE_TILE_SIZE * SOFTWARE_TILE_SIZE];
+
+	size_t region_count = render_data.stencil_regions.size() / 2;
+
+	for (int y = 0; y < height; y++) {
+		int py = y0 + y;
+
+		// Which row of the text texture lands on this pixel, then the same
+		// lookup as fragment.glsl. Text texture rows count up from the bottom.
+		int text_row = (int)((1.0f - (py + 0.5f) / SOFTWARE_HEIGHT) * SOFTWARE_TEXT_HEIGHT);
+		int frag_y = (SOFTWARE_TEXT_HEIGHT - 1) - text_row;
+		int char_row = frag_y / 16;
+		int texel_y = frag_y % 16;
+		int sector = texel_y / 4;
+
+		for (int x = 0; x < width; x++) {
+			int px = x0 + x;
+
+			uint32_t char_word = char_grid[char_row * 120 + px / 8];
+			uint32_t charnum = char_word & 0xFF;
+			uint32_t fg = (char_word >> 8) & 0xFF;
+			uint32_t bg = (char_word >> 16) & 0xFF;
+
+			uint32_t block_position = (texel_y % 4) * 8 + px % 8;
+			uint32_t bit = (font[charnum * 4 + sector] >> block_position) & 1;
+
+			float col = (bit ? fg : bg) / 255.0f;
+			int idx = y * SOFTWARE_TILE_SIZE + x;
+			r[idx] = col;
+			g[idx] = col;
+			b[idx] = col;
+
+			// Stencil is 1 outside every zone, see fragment_stencil.glsl
+			float native_x = px + 0.5f;
+			float native_y = SOFTWARE_HEIGHT - (py + 0.5f);
+			int stencil_value = 1;
+			for (size_t i = 0; i < region_count; i++) {
+				const vec2& z_start = render_data.stencil_regions[i * 2];
+				const vec2& z_end = render_data.stencil_regions[i * 2 + 1];
+				if (native_x > z_start.x && native_x < z_end.x &&
+					native_y > z_start.y && native_y < z_end.y) {
+					stencil_value = 0;
+					break;
+				}
+			}
+			stencil[idx] = stencil_value == render_data.stencil_state ? 1.0f : 0.0f;
+		}
+	}
+
+	// Lines, additive so the order doesnt matter
+	for (uint32_t index : tile_bins[tile]) {
+		const SoftwareLine& line = lines[index];
+
+		int from_y = max(line.min_y, y0) - y0;
+		int to_y = min(line.max_y, y0 + height - 1) - y0;
+
+		// Groups of 4 have to stay lined up with the tile for the aligned loads
+		int from_x = ((max(line.min_x, x0) - x0) / 4) * 4;
+		int to_x = min(line.max_x, x0 + width - 1) - x0;
+
+		for (int y = from_y; y <= to_y; y++) {
+			float y_line = pixel_to_line_y((float)(y0 + y));
+			for (int x = from_x; x <= to_x; x += 4) {
+				int idx = y * SOFTWARE_TILE_SIZE + x;
+				beam_x4(line, pixel_to_line_x((float)(x0 + x)), y_line, stencil + idx, r + idx, g + idx, b + idx);
+			}
+		}
+	}
+
+	// Blending clamps at 1 and everything added is positive, so clamping once
+	// at the end is the same
+	for (int y = 0; y < height; y++) {
+		uint8_t* out = &frame[((y0 + y) * SOFTWARE_WIDTH + x0) * 3];
+		for (int x = 0; x < width; x++) {
+			int idx = y * SOFTWARE_TILE_SIZE + x;
+			out[x * 3 + 0] = (uint8_t)(min(r[idx], 1.0f) * 255.0f + 0.5f);
+			out[x * 3 + 1] = (uint8_t)(min(g[idx], 1.0f) * 255.0f + 0.5f);
+			out[x * 3 + 2] = (uint8_t)(min(b[idx], 1.0f) * 255.0f + 0.5f);
+		}
+	}
+
+	return;
+}
+
+void SoftwareRenderBackend::write_frame() {
+	char name[32];
+	snprintf(name, sizeof(name), "frame_%05llu.ppm", (unsigned long long)frames);
+
+	filesystem::path path = filesystem::path(dump_directory) / name;
+	ofstream out(path, ios::binary);
+	if (!out.is_open()) {
+		throw runtime_error("Could not write frame " + path.string());
+	}
+
+	// Binary ppm, about the simplest image format there is and everything
+	// can open it
+	out << "P6\n" << SOFTWARE_WIDTH << " " << SOFTWARE_HEIGHT << "\n255\n";
+	out.write((const char*)frame.data(), frame.size());
+
+	return;
+}
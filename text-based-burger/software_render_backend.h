@@ -0,0 +1,104 @@
+#pragma once
+
+// Render backend that draws on the cpu. Runs exactly like the headless backend
+// (fixed time step, no input, no window) but every frame actually gets drawn
+// into an rgb image at native resolution, so frames can be looked at and
+// compared on machines without a gpu or without gl 4.6.
+//
+// What it draws is what the gl backend draws before the crt pass:
+// - the text, same glyph lookup as fragment.glsl
+// - the lines, same beam glow as line_beam.glsl, additive, with the cursor
+//   lines unstenciled and everything else stenciled the same way
+// The crt / scanline / blur passes at the end are not done, they are just a
+// look and would only get in the way of comparing frames.
+//
+// The screen is split into tiles and every line is binned into the tiles its
+// quad touches, then tiles are drawn in parallel on a worker pool. The beam
+// math runs on 4 pixels at a time with sse2 where there is sse2.
+
+#include "headless_render_backend.h"
+#include "threading_utils.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Native resolution, same as the area the lines and text cover in the gl backend
+#define SOFTWARE_WIDTH 960
+#define SOFTWARE_HEIGHT 536
+
+// Tiles are square, lines get binned per tile. Has to be a multiple of 4.
+#define SOFTWARE_TILE_SIZE 32
+
+// Same as the default line thickness in the gl backend
+#define SOFTWARE_LINE_THICKNESS 10.0f
+
+// One line ready to draw, everything that is the same for every pixel is
+// worked out up front
+struct SoftwareLine {
+	// Segment in line space, b is relative to a
+	float ax, ay;
+	float bax, bay;
+	float inv_ba_len2;
+
+	// Quad the gl backend would draw. A point is inside if going from the
+	// origin along the inverse basis lands in [0, 1] on both axes.
+	float origin_x, origin_y;
+	float inv_00, inv_01, inv_10, inv_11;
+
+	// Unpacked color
+	float width;
+	float saturation;
+	float alpha;
+	float hue_rgb[3]; // hsv2rgb of just the hue, minus 1
+
+	// Pixel bounds, inclusive
+	int min_x, min_y, max_x, max_y;
+
+	bool stenciled;
+};
+
+class SoftwareRenderBackend : public HeadlessRenderBackend {
+public:
+	// Frames get written as ppm files into dump_directory, leave it empty to
+	// only draw them
+	SoftwareRenderBackend(std::string dump_directory);
+
+	void end_frame(const RenderData& render_data) override;
+
+	// Binning the lines, drawing the tiles and writing the frame, on the cpu
+	std::vector<RenderPassTiming> get_pass_timings() override {
+		return pass_timings;
+	}
+
+	// The last frame drawn, SOFTWARE_WIDTH * SOFTWARE_HEIGHT rgb pixels top
+	// row first
+	const std::vector<uint8_t>& get_frame() const {
+		return frame;
+	}
+
+private:
+	// Turn lines from the render targets into SoftwareLines and bin them
+	void set_up_lines(const RenderData& render_data);
+	void add_line(float ax, float ay, float bx, float by, uint32_t color, bool stenciled);
+
+	// Draw one tile of the frame
+	void draw_tile(int tile, const RenderData& render_data);
+
+	void write_frame();
+
+	std::string dump_directory;
+
+	// 4 words per glyph, same as what gets uploaded to fragment.glsl
+	std::vector<uint32_t> font;
+
+	std::vector<uint8_t> frame;
+
+	std::vector<SoftwareLine> lines;
+	std::vector<std::vector<uint32_t>> tile_bins;
+	int tiles_x, tiles_y;
+
+	WorkerPool pool;
+
+	std::vector<RenderPassTiming> pass_timings;
+};
@@ -1,8 +1,10 @@
 #include "systems_controller.h"
 
+#include <algorithm>
+
 using namespace std;
 
-SystemsController::SystemsController(RenderTargets render_targets, string ui_entry) {
+SystemsController::SystemsController(string ui_entry) {
 	// You get an error reporter and you get an error reporter, everybody gets an error reporter!
 	controller_error_reporter = ErrorReporter();
 	script_error_reporter = ErrorReporter();
@@ -11,6 +13,7 @@ SystemsController::SystemsController(RenderTargets render_targets, string ui_ent
 	// Init threading stuff, this should probably be in the initializer list
 	// instead of unique ptrs but whatever
 	long_thread_controller = make_unique<LongThreadController>(threading_error_reporter);
+	worker_pool = make_unique<WorkerPool>();
 
 	// reserve at least 2 spots in the ui handlers for the standard handler slots
 	ui_handlers.resize(2);
@@ -20,52 +23,29 @@ SystemsController::SystemsController(RenderTargets render_targets, string ui_ent
 	ui_handlers[UI_HANDLER_ENTRY] = make_unique<UIHandler>("gamedata\\ui\\map_selector.json", 120, 34, *this);
 	ui_io[UI_HANDLER_ENTRY] = ui_handlers[0]->get_io();
 
+	// Meshes load lazily if the mesh files have been cooked
+	mesh_library.load_manifest(MESH_MANIFEST_PATH);
+
 	// Load the none map by default
 	objects_handler = make_unique<ObjectsHandler>("gamedata\\maps\\none_map.json", *this);
 	objects_io = objects_handler->get_io();
 	map_manager = make_unique<MapManager>("gamedata\\maps\\none_map_geo.json");
 
-	// set render targets
-	char_grid = render_targets.char_grid;
-	line_verts = render_targets.line_verts;
-	line_colors = render_targets.line_colors;
-
 	// TEMP: for testing
 	//load_metamap("mesh_editor");
 }
 
-void SystemsController::handle_misc_inputs(GLFWwindow* window) {
-
-	// f11 to toggle fullscreen
-	if (glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS) {
-		// Is the key already pressed?
-		if (key_presses.count(GLFW_KEY_F11) > 0) {
-			return; // Key already pressed, do nothing
-		}
-		// Key pressed, add to set
-		key_presses.insert(GLFW_KEY_F11);
+void SystemsController::handle_misc_inputs(const InputState& input) {
 
-		GLFWmonitor* monitor = glfwGetPrimaryMonitor();
-		const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-		if (glfwGetWindowMonitor(window) == NULL) {
-			glfwSetWindowMonitor(window, monitor, 0, 0, mode->width, mode->height, mode->refreshRate);
-		}
-		else {
-			glfwSetWindowMonitor(window, NULL, 100, 100, 1300, 720, 0);
-		}
-	}
-	else if (glfwGetKey(window, GLFW_KEY_F11) == GLFW_RELEASE) {
-		// Key released, remove from set
-		key_presses.erase(GLFW_KEY_F11);
-	}
+	// f11 to toggle fullscreen is done by the render backend, it owns the window
 
-	if(glfwGetKey(window, GLFW_KEY_F6) == GLFW_PRESS) {
+	if (input.is_down(INPUT_KEY_F6)) {
 		// Is the key already pressed?
-		if (key_presses.count(GLFW_KEY_F6) > 0) {
+		if (key_presses.count(INPUT_KEY_F6) > 0) {
 			return; // Key already pressed, do nothing
 		}
 		// Key pressed, add to set
-		key_presses.insert(GLFW_KEY_F6);
+		key_presses.insert(INPUT_KEY_F6);
 
 		if (error_log_type == ERROR_LOG_TYPE_NONE) {
 			// If no error log is shown, show the UI error log
@@ -76,25 +56,25 @@ void SystemsController::handle_misc_inputs(GLFWwindow* window) {
 			error_log_type = ERROR_LOG_TYPE_NONE;
 		}
 	}
-	else if (glfwGetKey(window, GLFW_KEY_F11) == GLFW_RELEASE) {
+	else {
 		// Key released, remove from set
-		key_presses.erase(GLFW_KEY_F6);
+		key_presses.erase(INPUT_KEY_F6);
 	}
 }
 
-void SystemsController::update(GLFWwindow* window, GlobalUpdateData global_update_data) {
+void SystemsController::update(GlobalUpdateData global_update_data) {
 
 	// Set time
-	frame_time = glfwGetTime() - last_time;
-	last_time = glfwGetTime();
+	frame_time = global_update_data.time - last_time;
+	last_time = global_update_data.time;
 
-	handle_misc_inputs(window); // do this first, this shouldnt have any side effects.
+	handle_misc_inputs(global_update_data.input); // do this first, this shouldnt have any side effects.
 
 	UIUpdateData frame_data;
 	frame_data.mouse_char_x = global_update_data.mouse_pos_char.x;
 	frame_data.mouse_char_y = global_update_data.mouse_pos_char.y;
-	frame_data.time = (int)glfwGetTime();
-	frame_data.is_clicking = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+	frame_data.time = (int)global_update_data.time;
+	frame_data.is_clicking = global_update_data.input.mouse_left;
 
 	// For now just update all the ui and plop the whole screen on the gpu, 
 	// this will eventually happen on a sperate thread (probably)
@@ -102,14 +82,13 @@ void SystemsController::update(GLFWwindow* window, GlobalUpdateData global_updat
 
 	// --- update objects ---
 	ObjectUpdateData update_data;
-	update_data.time = glfwGetTime();
+	update_data.time = global_update_data.time;
 	update_data.frame_time = frame_time;
 	update_data.mouse_pos = global_update_data.mouse_pos_native;
-	update_data.is_clicking = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+	update_data.is_clicking = global_update_data.input.mouse_left;
 	update_data.scroll_delta = global_update_data.scroll_delta;
 
-	// Should probably not reset this every frame, but its a pointer so whatever
-	update_data.window = window;
+	update_data.input = global_update_data.input;
 
 	ObjectUpdateReturnData return_data;
 
@@ -118,20 +97,38 @@ void SystemsController::update(GLFWwindow* window, GlobalUpdateData global_updat
 
 	// Update camera position from ovjects handler
 	update_data.camera_pos = return_data.camera_pos;
+	objects_active = return_data.objects_active;
 
 	map_manager->update(update_data);
 
+	// Has to be after the objects are done, finished loads change the arena
+	mesh_library.update_streaming(*long_thread_controller);
+
 	long_thread_controller->update();
 }
 
+void SystemsController::set_render_targets(RenderTargets render_targets) {
+	char_grid = render_targets.char_grid;
+	line_verts = render_targets.line_verts;
+	line_materials = render_targets.line_materials;
+	line_instances = render_targets.line_instances;
+	return;
+}
+
 RenderData SystemsController::render() {
 
-	// Render objects
-	num_lines = objects_handler->render(line_verts, line_colors);
-	num_lines = map_manager->render(line_verts, line_colors, num_lines);
-	
-	// Render the bvh if needed
-	num_lines = map_manager->render_bvh(line_verts, line_colors, num_lines);
+	RenderData return_data;
+
+	line_budget.begin_frame();
+
+	// Render objects, these take what they need out of the budget first
+	num_lines = objects_handler->render(line_verts, line_materials, line_instances, return_data.instance_batches, line_budget);
+
+	// Whatever is left goes to the map, walls before parallax. The bvh gets
+	// drawn along with it if it is turned on.
+	map_manager->want_lines(line_budget);
+	line_budget.allocate();
+	num_lines = map_manager->render(line_verts, line_materials, num_lines, line_budget);
 
 	//float renderscale = 1.0f;
 
@@ -140,10 +137,19 @@ RenderData SystemsController::render() {
 	//	line_verts[i] *= renderscale;
 	//}
 
-	RenderData return_data;
-
 	return_data.lines_counter = num_lines;
 
+	return_data.instance_count = 0;
+	for (auto& batch : return_data.instance_batches) {
+		return_data.instance_count += batch.instance_count;
+	}
+
+	return_data.mesh_lines = &mesh_library.get_lines();
+	return_data.mesh_lines_version = mesh_library.get_version();
+
+	return_data.palette = &get_line_palette().get_colors();
+	return_data.palette_version = get_line_palette().get_version();
+
 	// Stencil regions should really only ever be uints as they are pixel coordinates
 	return_data.stencil_regions = ui_handlers[active_ui_handler]->get_stencil_regions();
 	return_data.stencil_state = ui_handlers[active_ui_handler]->get_stencil_state();
@@ -151,19 +157,14 @@ RenderData SystemsController::render() {
 	ui_handlers[active_ui_handler]->rerender_all();
 
 	if (error_log_type != ERROR_LOG_TYPE_NONE) {
-		render_log();
+		render_log(return_data);
 		// stencil away the entire screen so we dont draw the map
 		return_data.stencil_regions = { };
 		return_data.stencil_state = 0; // stencil in
 
 	}
 	else {
-		vector<vector<uint32_t>> screen = ui_handlers[active_ui_handler]->get_screen();
-		for (int i = 0; i < CHAR_ROWS / 2; i++) {
-			for (int j = 0; j < CHAR_COLS; j++) {
-				char_grid[i * CHAR_COLS + j] = screen[i][j];
-			}
-		}
+		present_screen(ui_handlers[active_ui_handler]->get_screen(), return_data);
 	}
 
 	return return_data;
@@ -183,7 +184,36 @@ string get_error_type_name(ErrorLogType type) {
 	}
 }
 
-void SystemsController::render_log() {
+void SystemsController::present_screen(const vector<vector<uint32_t>>& screen, RenderData& render_data) {
+	// Keep a copy of what is on screen and find which rows changed. Reading
+	// char_grid back for this is no good, it is mapped gpu memory.
+	if (shown_char_grid.empty()) {
+		shown_char_grid.assign((CHAR_ROWS / 2) * CHAR_COLS, 0);
+	}
+
+	render_data.char_rows_dirty_from = 0;
+	render_data.char_rows_dirty_to = 0;
+
+	for (int i = 0; i < CHAR_ROWS / 2; i++) {
+		uint32_t* shown_row = &shown_char_grid[i * CHAR_COLS];
+
+		if (!equal(screen[i].begin(), screen[i].begin() + CHAR_COLS, shown_row)) {
+			copy(screen[i].begin(), screen[i].begin() + CHAR_COLS, shown_row);
+
+			if (render_data.char_rows_dirty_from == render_data.char_rows_dirty_to) {
+				render_data.char_rows_dirty_from = i;
+			}
+			render_data.char_rows_dirty_to = i + 1;
+		}
+	}
+
+	// The whole grid still has to go out every frame, the target is a ring
+	// slot that was last written a few frames ago
+	copy(shown_char_grid.begin(), shown_char_grid.end(), char_grid);
+	return;
+}
+
+void SystemsController::render_log(RenderData& render_data) {
 	vector<int> all_repeats;
 	vector<string> all_errors;
 
@@ -296,11 +326,7 @@ void SystemsController::render_log() {
 	}
 
 	// Render out to the char grid
-	for (int i = 0; i < CHAR_ROWS / 2; i++) {
-		for (int j = 0; j < CHAR_COLS; j++) {
-			char_grid[i * CHAR_COLS + j] = screen[i][j];
-		}
-	}
+	present_screen(screen, render_data);
 }
 
 void SystemsController::call_script(string script_name, json args) {
@@ -322,7 +348,19 @@ void SystemsController::call_script(string script_name, json args) {
 }
 
 void SystemsController::unload_map() {
-	// Not actually unloads the map, just loads the none map
+	swap_to_none_map();
+
+	// Nothing is coming after this so throw out whatever the old map had
+	mesh_library.collect_unused();
+}
+
+void SystemsController::swap_to_none_map() {
+	// Not actually unloads the map, just loads the none map. The old objects
+	// go first, after that nothing holds a palette material and the palette
+	// can start over instead of growing with every map.
+	objects_handler.reset();
+	get_line_palette().reset();
+
 	objects_handler = make_unique<ObjectsHandler>("gamedata\\maps\\none_map.json", *this);
 	objects_io = objects_handler->get_io();
 
@@ -332,8 +370,9 @@ void SystemsController::unload_map() {
 }
 
 void SystemsController::load_map(string map_name) {
-	// Unload current map
-	unload_map();
+	// Unload current map. Meshes the old map used stay around until the new
+	// one has taken what it needs.
+	swap_to_none_map();
 	// Load new map
 	objects_handler = make_unique<ObjectsHandler>("gamedata\\maps\\" + map_name + ".json", *this);
 	objects_io = objects_handler->get_io();
@@ -344,11 +383,14 @@ void SystemsController::load_map(string map_name) {
 	ui_io[UI_HANDLER_GAMEPLAY] = (ui_handlers[UI_HANDLER_GAMEPLAY]->get_io());
 
 	active_ui_handler = UI_HANDLER_GAMEPLAY;
+
+	mesh_library.collect_unused();
 }
 
 void SystemsController::load_metamap(string map_name) {
-	// Unload current map
-	unload_map();
+	// Unload current map. Meshes the old map used stay around until the new
+	// one has taken what it needs.
+	swap_to_none_map();
 	// Load new map
 	objects_handler = make_unique<ObjectsHandler>("gamedata\\maps\\" + map_name + ".json", *this);
 	objects_io = objects_handler->get_io();
@@ -360,6 +402,8 @@ void SystemsController::load_metamap(string map_name) {
 	ui_handlers[UI_HANDLER_GAMEPLAY] = (make_unique<UIHandler>("gamedata\\ui\\" + map_name + "_ui.json", 120, 34, *this));
 	ui_io[UI_HANDLER_GAMEPLAY] = (ui_handlers[UI_HANDLER_GAMEPLAY]->get_io());
 	active_ui_handler = UI_HANDLER_GAMEPLAY;
+
+	mesh_library.collect_unused();
 }
 
 void SystemsController::clean_up_threads() {
@@ -30,10 +30,12 @@
 #include "object_utils.h"
 #include "map_manager.h"
 #include "threading_utils.h"
+#include "line_budget.h"
+#include "line_palette.h"
 
 #include "scripts.h"
+#include "input.h"
 
-#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
 #include <vector>
@@ -56,11 +58,16 @@ enum ErrorLogType {
 	ERROR_LOG_TYPE_THREAD
 };
 
-// Pass this to the systems controller to set up where you want it to render stuff to
+// Pass this to the systems controller to set up where you want it to render stuff to.
+// These can be mapped gpu memory, only ever write to them.
 struct RenderTargets {
 	uint32_t* char_grid;
 	float* line_verts;
-	uint32_t* line_colors;
+	// One line palette material per line
+	LineMaterial* line_materials;
+
+	// MAX_LINE_INSTANCES of these
+	LineInstance* line_instances;
 };
 
 // Misc data various systems emit for rendering
@@ -79,6 +86,26 @@ struct RenderData {
 	// By default 0, meaning we only render things within a perscribed render region.
 	// Set it to 1 if you only want to render things outside the stencil regions.
 	int stencil_state;
+
+	// Instanced meshes, drawn stenciled after the normal lines. One draw per
+	// batch, batches index into the line_instances render target.
+	std::vector<LineInstanceBatch> instance_batches;
+	int instance_count;
+
+	// Rows of the char grid that changed this frame, [from, to). Empty if
+	// nothing did, the text doesnt need to be rastered again then.
+	int char_rows_dirty_from;
+	int char_rows_dirty_to;
+
+	// All meshes packed together for the instanced path. Only needs to be
+	// uploaded again when the version changes (new map etc).
+	const std::vector<MeshLine>* mesh_lines;
+	uint32_t mesh_lines_version;
+
+	// Line palette, every material's packed color. Same deal as the mesh
+	// lines, only goes up again when the version changes.
+	const std::vector<uint32_t>* palette;
+	uint32_t palette_version;
 };
 
 // Miscellaneous game data that various systems might need but dont have a place within
@@ -93,19 +120,28 @@ struct GlobalUpdateData {
 	vec2 mouse_pos_native; // position in native
 	vec2 mouse_pos_char;
 	vec2 scroll_delta;
+
+	// Seconds since start
+	double time;
+
+	InputState input;
 };
 
 class SystemsController {
 public:
 	// Constructor
-	SystemsController(RenderTargets render_targets, std::string ui_entry);
+	SystemsController(std::string ui_entry);
 
 	// Tell the systems controller to make things update
-	void update(GLFWwindow* window, GlobalUpdateData global_update_data);
+	void update(GlobalUpdateData global_update_data);
 
 	// Tell systems to render to internal screens
 	RenderData render();
 
+	// Point the internal render targets somewhere else. Has to be called
+	// before every render, the render backend hands out new ones each frame.
+	void set_render_targets(RenderTargets render_targets);
+
 	// Render a specific error log instead of what you would normally render.
 	void show_error_log(ErrorLogType type);
 	
@@ -126,6 +162,27 @@ public:
 	// End all threads on window close
 	void clean_up_threads();
 
+	// Every mesh, lives for the whole run so map changes only load what is new
+	MeshLibrary& get_mesh_library() {
+		return mesh_library;
+	}
+
+	// How many lines a frame can have and what got shed last frame
+	LineBudget& get_line_budget() {
+		return line_budget;
+	}
+
+	// Whether the objects did anything in the last update, see
+	// ObjectUpdateReturnData::objects_active
+	bool objects_were_active() {
+		return objects_active;
+	}
+
+	// Shared pool for short parallel jobs (object updates etc)
+	WorkerPool* get_worker_pool() {
+		return worker_pool.get();
+	}
+
 private:
 
 	// Controller error reporter, similar to how the handlers have io classes to
@@ -135,19 +192,33 @@ private:
 	// Handles inputs that are not related to anything, global shortcuts.
 	// This probably will not make it into production only really useful for 
 	// debugging.
-	void handle_misc_inputs(GLFWwindow* window);
+	void handle_misc_inputs(const InputState& input);
 	std::set<int> key_presses;
 	float scroll_x = 0.0f, scroll_y = 0.0f;
 
 	// Function that actually renders the error log
-	void render_log();
+	void render_log(RenderData& render_data);
+
+	// Copy a finished screen into the char grid and work out which rows
+	// changed since last frame
+	void present_screen(const std::vector<std::vector<uint32_t>>& screen, RenderData& render_data);
+
+	// What the char grid had in it last frame, rows are compared against this
+	std::vector<uint32_t> shown_char_grid;
 	ErrorLogType error_log_type = ERROR_LOG_TYPE_NONE;
 
+	// unload_map without throwing out unused meshes, for when a new map is
+	// about to be loaded straight after
+	void swap_to_none_map();
+
 	// The ui handler
 	std::vector<std::unique_ptr<UIHandler>> ui_handlers;
 	std::vector<UIComponentIO*> ui_io;
 	int active_ui_handler = UI_HANDLER_ENTRY;
 
+	// Shared by every objects handler, declared first so it outlives them
+	MeshLibrary mesh_library;
+
 	// The objects handler
 	std::unique_ptr<ObjectsHandler> objects_handler;
 	ObjectIO* objects_io;
@@ -158,19 +229,25 @@ private:
 	// Random stuff we need to keep track of
 	vec2 mouse_native_pos, mouse_char_pos = vec2();
 	double last_time, frame_time = 0.0f;
+	bool objects_active = false;
 	int CHAR_COLS = 120;
 	int CHAR_ROWS = 68;
 
-	// Internal render targets, these are actually held in main.cpp
-	uint32_t* char_grid;
-	float* line_verts;
-	uint32_t* line_colors;
+	// Internal render targets, these are actually held by the render backend
+	uint32_t* char_grid = nullptr;
+	float* line_verts = nullptr;
+	LineMaterial* line_materials = nullptr;
+	LineInstance* line_instances = nullptr;
 
 	int num_lines = 0;
+	LineBudget line_budget;
 
 	// The threading error reporter
 	ErrorReporter threading_error_reporter;
 
 	// Long thread controller
 	std::unique_ptr<LongThreadController> long_thread_controller;
+
+	// Worker threads for parallel work within a frame
+	std::unique_ptr<WorkerPool> worker_pool;
 };
\ No newline at end of file
@@ -84,4 +84,109 @@ void LongThreadController::clean_up_threads() {
 
 	// Step 3: Clear all state
 	threads.clear();
-}
\ No newline at end of file
+}
+
+// Worker pool
+
+WorkerPool::WorkerPool(int thread_count) {
+	if (thread_count <= 0) {
+		// hardware_concurrency can return 0 if it doesnt know
+		thread_count = max(1, (int)thread::hardware_concurrency()) - 1;
+	}
+
+	for (int i = 0; i < thread_count; i++) {
+		workers.emplace_back(&WorkerPool::worker_loop, this);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		lock_guard<mutex> lock(job_mutex);
+		exit_now = true;
+	}
+	job_cv.notify_all();
+
+	for (auto& worker : workers) {
+		if (worker.joinable()) {
+			worker.join();
+		}
+	}
+}
+
+void WorkerPool::run(int task_count, const function<void(int)>& task) {
+	if (task_count <= 0) {
+		return;
+	}
+
+	// Not worth waking anyone up
+	if (workers.empty() || task_count == 1) {
+		for (int i = 0; i < task_count; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(job_mutex);
+		job = &task;
+		job_count = task_count;
+		next_task = 0;
+		job_generation++;
+	}
+	job_cv.notify_all();
+
+	// Help out
+	do_tasks(task, task_count);
+
+	// Once we run out of tasks to grab, the only ones left are the ones workers
+	// are still chewing on. Wait for them so nobody is still inside task when
+	// we return and it goes out of scope.
+	unique_lock<mutex> lock(job_mutex);
+	done_cv.wait(lock, [this]() { return active_workers == 0; });
+	job = nullptr;
+}
+
+void WorkerPool::worker_loop() {
+	uint64_t seen_generation = 0;
+
+	while (true) {
+		const function<void(int)>* task;
+		int task_count;
+		{
+			unique_lock<mutex> lock(job_mutex);
+			job_cv.wait(lock, [&]() { return exit_now || job_generation != seen_generation; });
+			if (exit_now) {
+				return;
+			}
+			seen_generation = job_generation;
+
+			// Woke up too late, run() already finished this one
+			if (job == nullptr) {
+				continue;
+			}
+
+			// run() cant return (and the job cant change) while we are active
+			task = job;
+			task_count = job_count;
+			active_workers++;
+		}
+
+		do_tasks(*task, task_count);
+
+		{
+			lock_guard<mutex> lock(job_mutex);
+			active_workers--;
+		}
+		done_cv.notify_one();
+	}
+}
+
+void WorkerPool::do_tasks(const function<void(int)>& task, int task_count) {
+	while (true) {
+		int i = next_task.fetch_add(1);
+		if (i >= task_count) {
+			return;
+		}
+		task(i);
+	}
+}
@@ -2,10 +2,12 @@
 
 #include <any>
 #include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <mutex>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "scripts.h" 
 #include "error_reporter.hpp"
@@ -65,10 +67,60 @@ public:
 
 	void clean_up_threads();
 
+	// For errors that come out of a thread's work, goes to the shared reporter
+	void report_error(const std::string& error) {
+		error_reporter.report_error(error);
+	}
+
 private:
 	// All controllers share one error reporter you dont each need your own
 	ErrorReporter& error_reporter;
 
 	std::unordered_map<std::string, LongThreadState> threads;
 	mutable std::mutex thread_mutex; // Protects the map
+};
+
+// Worker pool is the opposite of long threads, a fixed set of threads that
+// live for the whole program and get handed short parallel jobs every frame,
+// like updating all the npcs. run() blocks until every task is done, and the
+// calling thread helps out instead of just waiting. Tasks run in whatever
+// order and on whatever thread so they should only touch their own data, if
+// you need ordering record what you want to do and apply it afterwards.
+class WorkerPool {
+public:
+	// 0 threads means one less than the number of cores, since the calling
+	// thread also works.
+	WorkerPool(int thread_count = 0);
+	~WorkerPool();
+
+	// Run task(0) ... task(task_count - 1) and wait for all of them
+	void run(int task_count, const std::function<void(int)>& task);
+
+	// How many threads end up working on a job, including the caller
+	int get_thread_count() const {
+		return (int)workers.size() + 1;
+	}
+
+private:
+	void worker_loop();
+
+	// Grab task indices until there are none left. Takes the job as arguments
+	// so nothing reads job or job_count without the mutex.
+	void do_tasks(const std::function<void(int)>& task, int task_count);
+
+	std::vector<std::thread> workers;
+
+	std::mutex job_mutex;
+	std::condition_variable job_cv;
+	std::condition_variable done_cv;
+
+	// Current job, only read or changed under the mutex. Workers copy it when
+	// they wake up.
+	const std::function<void(int)>* job = nullptr;
+	int job_count = 0;
+	uint64_t job_generation = 0;
+	int active_workers = 0;
+	bool exit_now = false;
+
+	std::atomic<int> next_task = 0;
 };
\ No newline at end of file
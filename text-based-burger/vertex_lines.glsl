@@ -1,17 +1,90 @@
 #version 460 core
-layout (location = 0) in vec2 aPos; // Position in NDC
+// Normal lines. There is no vertex buffer, the cpu only uploads the raw line
+// endpoints and every line gets expanded into a quad here. Every line is 6
+// vertices (two triangles) and gl_VertexID says which line and which corner.
+
+// raw vertices, two per line. Either two floats per vertex or with compact
+// vertices one uint holding two snorm16s, see line_quantize.h
+layout(std430, binding = 3) readonly buffer LineVertices {
+    uint vertices[];
+};
+
+// 16 bit palette materials, two packed in every uint
+layout(std430, binding = 1) readonly buffer LineMaterials {
+    uint materials[];
+};
+
+// Every material's packed color
+layout(std430, binding = 6) readonly buffer LinePalette {
+    uint palette[];
+};
 
 out vec2 TexCoords;
+
+// The fragment shader needs the whole line, not just this corner
+flat out vec2 lineStart;
+flat out vec2 lineEnd;
+flat out uint lineColor;
+
 uniform float aspectRatio;
 uniform float aspectRatioSmall;
+uniform float thickness;
+
+uniform bool compactVertices;
+uniform float compactRange; // LINE_QUANTIZE_RANGE
+
+vec2 line_vertex(int vertex) {
+    if (compactVertices) {
+        return unpackSnorm2x16(vertices[vertex]) * compactRange;
+    }
+    return uintBitsToFloat(uvec2(vertices[vertex * 2], vertices[vertex * 2 + 1]));
+}
+
+// Which end of the line and which side of it each of the 6 vertices is on.
+// v1 v2 v3, v1 v3 v4 going bottom left, top left, top right, bottom right
+const vec2 corners[6] = vec2[6](
+    vec2(0.0, -1.0), vec2(0.0, 1.0), vec2(1.0, 1.0),
+    vec2(0.0, -1.0), vec2(1.0, 1.0), vec2(1.0, -1.0)
+);
 
 void main() {
+    // gl_VertexID already includes the first vertex of the draw so this is
+    // the real line index even for the stenciled half
+    int line = gl_VertexID / 6;
+    vec2 corner = corners[gl_VertexID % 6];
+
+    vec2 a = line_vertex(line * 2);
+    vec2 b = line_vertex(line * 2 + 1);
+
+    lineStart = a;
+    lineEnd = b;
+    uint material = (materials[line >> 1] >> ((line & 1) * 16)) & 0xFFFFu;
+    lineColor = palette[material];
+
+    // Need to scale thickness the same way as everything else, x gets squashed
+    // by the aspect ratio
+    float thickness_x = thickness * 0.01 / (aspectRatioSmall * aspectRatio);
+    float thickness_y = thickness * 0.01;
+
+    vec2 pos = vec2(0.0); // Zero length lines collapse to nothing
+    vec2 dir = b - a;
+    float len = length(dir);
+    if (len > 0.0) {
+        dir /= len;
+
+        // Perpendicular for the width, and extend past both ends for the glow
+        vec2 perp = vec2(-dir.y * thickness_x, dir.x * thickness_y) * 0.5;
+        vec2 extend = vec2(dir.x * thickness_x, dir.y * thickness_y) * 0.5;
+
+        vec2 end = corner.x < 0.5 ? a - extend : b + extend;
+        pos = end + perp * corner.y;
+    }
 
     // Need to scale lines cords the same way we scale the small framebuffer, double work
     // but whatever. Other option is second intermediary buffer because lines need to be drawn
     // at a different resolution and i dont want to do that.
 
-    vec2 scaledpos = aPos * vec2(1.0 / (aspectRatioSmall * aspectRatio), 1);
+    vec2 scaledpos = pos * vec2(1.0 / (aspectRatioSmall * aspectRatio), 1);
     gl_Position = vec4(scaledpos, 0.0, 1.0); // Pass position to clip space
     TexCoords = scaledpos; // Pass texture coordinates to fragment shader
-}
\ No newline at end of file
+}
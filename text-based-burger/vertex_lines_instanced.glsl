@@ -0,0 +1,94 @@
+#version 460 core
+// Instanced mesh lines. There is no vertex buffer, everything gets pulled out
+// of the SSBOs with gl_VertexID. Every line of the mesh is 6 vertices (two
+// triangles) and every object using the mesh is one instance, so the cpu only
+// has to write one small record per object instead of every vertex.
+
+struct LineInstance {
+    vec2 position; // NDC
+    vec2 scale; // native pixels
+    float rotation;
+    uint material; // line palette index
+    uint first_line;
+    uint pad;
+};
+
+// Every mesh packed together, uploaded once per map. Two vertices per line.
+layout(std430, binding = 4) readonly buffer MeshLines {
+    vec2 mesh_vertices[];
+};
+
+layout(std430, binding = 5) readonly buffer LineInstances {
+    LineInstance instances[];
+};
+
+// Every material's packed color, same palette as the normal lines
+layout(std430, binding = 6) readonly buffer LinePalette {
+    uint palette[];
+};
+
+out vec2 TexCoords;
+
+// The fragment shader needs the whole line, not just this corner
+flat out vec2 lineStart;
+flat out vec2 lineEnd;
+flat out uint lineColor;
+
+uniform float aspectRatio;
+uniform float aspectRatioSmall;
+uniform float thickness;
+
+// Native pixels to NDC, 2 / screen size
+uniform vec2 ndc_scale;
+
+// Which end of the line and which side of it each of the 6 vertices is on.
+// Same order as the cpu quads: v1 v2 v3, v1 v3 v4
+const vec2 corners[6] = vec2[6](
+    vec2(0.0, -1.0), vec2(0.0, 1.0), vec2(1.0, 1.0),
+    vec2(0.0, -1.0), vec2(1.0, 1.0), vec2(1.0, -1.0)
+);
+
+void main() {
+    LineInstance inst = instances[gl_BaseInstance + gl_InstanceID];
+
+    int line = gl_VertexID / 6;
+    vec2 corner = corners[gl_VertexID % 6];
+
+    uint vert = (inst.first_line + uint(line)) * 2u;
+    vec2 a = mesh_vertices[vert];
+    vec2 b = mesh_vertices[vert + 1u];
+
+    // Scale, rotate, then place. Rotation has to happen in pixels or it would
+    // get squashed by the screen aspect.
+    float c = cos(inst.rotation);
+    float s = sin(inst.rotation);
+    mat2 rot = mat2(c, s, -s, c);
+
+    a = inst.position + (rot * (a * inst.scale)) * ndc_scale;
+    b = inst.position + (rot * (b * inst.scale)) * ndc_scale;
+
+    lineStart = a;
+    lineEnd = b;
+    lineColor = palette[inst.material];
+
+    // Expand into a quad the same way main.cpp does it for normal lines
+    float thickness_x = thickness * 0.01 / (aspectRatioSmall * aspectRatio);
+    float thickness_y = thickness * 0.01;
+
+    vec2 pos = vec2(0.0); // Zero length lines collapse to nothing
+    vec2 dir = b - a;
+    float len = length(dir);
+    if (len > 0.0) {
+        dir /= len;
+
+        vec2 perp = vec2(-dir.y * thickness_x, dir.x * thickness_y) * 0.5;
+        vec2 extend = vec2(dir.x * thickness_x, dir.y * thickness_y) * 0.5;
+
+        vec2 end = corner.x < 0.5 ? a - extend : b + extend;
+        pos = end + perp * corner.y;
+    }
+
+    vec2 scaledpos = pos * vec2(1.0 / (aspectRatioSmall * aspectRatio), 1);
+    gl_Position = vec4(scaledpos, 0.0, 1.0);
+    TexCoords = scaledpos;
+}